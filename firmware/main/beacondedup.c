@@ -0,0 +1,202 @@
+#include "beacondedup.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#define SET_BITS   4                 /* 16 sets x 8 ways = 128 BSSIDs */
+#define SET_COUNT  (1u << SET_BITS)
+#define WAYS       8
+
+#define BEACON_FIXED_LEN  12         /* TSF, beacon interval, capability */
+#define IE_TIM            5          /* DTIM count changes every beacon */
+
+/*
+ * Set-associative table: a BSSID only ever lives in one set, so entries can
+ * be replaced without tombstones. When a set is full the least recently
+ * heard BSSID is evicted (after its pending summary is handed out).
+ */
+typedef struct {
+    uint8_t  bssid[6];
+    uint8_t  used;
+    uint8_t  channel;
+    uint32_t body_hash;
+    uint32_t window_start;  /* rx_ctrl timestamp of the kept beacon */
+    uint32_t last_seen;     /* rx_ctrl timestamp of the latest beacon */
+    uint64_t last_tsf;
+    int32_t  rssi_sum;
+    uint16_t count;         /* Repeats suppressed since window_start */
+    int8_t   rssi_min;
+    int8_t   rssi_max;
+} dedup_entry_t;
+
+static dedup_entry_t s_table[SET_COUNT][WAYS];
+static uint32_t                s_window_us;
+static _Atomic bool            s_reset;
+static uint32_t                s_sweep_pos;
+
+static uint32_t s_suppressed;
+static uint32_t s_summaries;
+
+static inline uint32_t fnv1a(uint32_t h, const uint8_t *p, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* Hash the beacon body after the TSF, skipping the TIM element */
+static uint32_t body_hash(const uint8_t *body, uint32_t len)
+{
+    uint32_t h = fnv1a(2166136261u, body + 8, BEACON_FIXED_LEN - 8);
+    uint32_t pos = BEACON_FIXED_LEN;
+
+    while (pos + 2 <= len) {
+        uint32_t ie_len = 2 + body[pos + 1];
+        if (pos + ie_len > len) {
+            ie_len = len - pos;   /* Truncated IE: hash what is there */
+        }
+        if (body[pos] != IE_TIM) {
+            h = fnv1a(h, body + pos, ie_len);
+        }
+        pos += ie_len;
+    }
+    return h;
+}
+
+static void make_summary(dedup_entry_t *e, beacon_summary_t *s)
+{
+    s->msg_type  = MSG_TYPE_BEACON_SUMMARY;
+    s->channel   = e->channel;
+    memcpy(s->bssid, e->bssid, 6);
+    s->count     = e->count;
+    s->rssi_min  = e->rssi_min;
+    s->rssi_max  = e->rssi_max;
+    s->rssi_avg  = (int8_t)(e->rssi_sum / e->count);
+    s->reserved  = 0;
+    s->timestamp = e->last_seen;
+    s->last_tsf  = e->last_tsf;
+
+    e->count = 0;
+    s_summaries++;
+}
+
+/* Keep this beacon and start a new window with it */
+static void start_window(dedup_entry_t *e, uint32_t hash, uint8_t channel,
+                         uint32_t now_us)
+{
+    e->used = 1;
+    e->channel = channel;
+    e->body_hash = hash;
+    e->window_start = now_us;
+    e->last_seen = now_us;
+    e->count = 0;
+    e->rssi_sum = 0;
+}
+
+void beacondedup_set_window(uint32_t ms)
+{
+    s_window_us = ms * 1000;
+    atomic_store(&s_reset, true);
+}
+
+uint32_t beacondedup_get_window(void)
+{
+    return s_window_us / 1000;
+}
+
+bool beacondedup_check(const uint8_t *frame, uint16_t len, uint8_t channel,
+                       int8_t rssi, uint32_t now_us, beacon_summary_t *summary,
+                       bool *have_summary)
+{
+    *have_summary = false;
+
+    if (s_window_us == 0 || len < 2 || frame[0] != IEEE80211_FC0_BEACON) {
+        return false;
+    }
+    uint16_t hdr_len = (frame[1] & 0x80) ? 28 : 24;   /* +HT Control */
+    if (len < hdr_len + BEACON_FIXED_LEN) {
+        return false;
+    }
+
+    const uint8_t *bssid = frame + 16;
+    const uint8_t *body = frame + hdr_len;
+    uint32_t hash = body_hash(body, len - hdr_len);
+    dedup_entry_t *set = s_table[fnv1a(2166136261u, bssid, 6) & (SET_COUNT - 1)];
+    dedup_entry_t *e = NULL;
+    dedup_entry_t *victim = &set[0];
+
+    for (int w = 0; w < WAYS; w++) {
+        if (set[w].used && memcmp(set[w].bssid, bssid, 6) == 0) {
+            e = &set[w];
+            break;
+        }
+        if (!set[w].used) {
+            victim = &set[w];
+        } else if (victim->used && now_us - set[w].last_seen > now_us - victim->last_seen) {
+            victim = &set[w];
+        }
+    }
+
+    if (!e) {
+        e = victim;
+        if (e->used && e->count > 0) {
+            make_summary(e, summary);
+            *have_summary = true;
+        }
+        memcpy(e->bssid, bssid, 6);
+        start_window(e, hash, channel, now_us);
+        return false;
+    }
+
+    bool repeat = e->body_hash == hash && e->channel == channel &&
+                  now_us - e->window_start < s_window_us && e->count < UINT16_MAX;
+    if (!repeat) {
+        if (e->count > 0) {
+            make_summary(e, summary);
+            *have_summary = true;
+        }
+        start_window(e, hash, channel, now_us);
+        return false;
+    }
+
+    if (e->count == 0 || rssi < e->rssi_min) {
+        e->rssi_min = rssi;
+    }
+    if (e->count == 0 || rssi > e->rssi_max) {
+        e->rssi_max = rssi;
+    }
+    e->rssi_sum += rssi;
+    e->count++;
+    e->last_seen = now_us;
+    memcpy(&e->last_tsf, body, sizeof(e->last_tsf));
+    s_suppressed++;
+    return true;
+}
+
+bool beacondedup_sweep(uint32_t now_us, beacon_summary_t *summary)
+{
+    if (atomic_exchange(&s_reset, false)) {
+        memset(s_table, 0, sizeof(s_table));
+    }
+    if (s_window_us == 0) {
+        return false;
+    }
+
+    dedup_entry_t *e = &s_table[0][0] + (s_sweep_pos++ & (SET_COUNT * WAYS - 1));
+    if (e->used && e->count > 0 && now_us - e->window_start >= s_window_us) {
+        make_summary(e, summary);
+        return true;
+    }
+    return false;
+}
+
+uint32_t beacondedup_get_suppressed(void)
+{
+    return s_suppressed;
+}
+
+uint32_t beacondedup_get_summaries(void)
+{
+    return s_summaries;
+}
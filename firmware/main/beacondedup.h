@@ -0,0 +1,35 @@
+#pragma once
+
+#include "protocol.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BEACONDEDUP_MAX_WINDOW_MS  60000
+
+/*
+ * Per-BSSID beacon deduplication, run from the RX worker (sniffer.c).
+ *
+ * The first beacon from a BSSID in each window is kept. Later beacons whose
+ * body matches it (ignoring TSF, sequence number and the TIM element) are
+ * dropped and folded into a beacon_summary_t, which is handed back once the
+ * window ends. A beacon whose body changed is kept and starts a new window.
+ *
+ * All table state belongs to the RX worker; the command task only sets the
+ * window. Changing the window discards pending counts.
+ */
+void      beacondedup_set_window(uint32_t ms);   /* 0 = off */
+uint32_t  beacondedup_get_window(void);
+
+/* Check one frame. Returns true if it is a repeat beacon to drop. If the
+ * frame closes a window that had repeats, their summary is written to
+ * *summary and *have_summary is set. */
+bool      beacondedup_check(const uint8_t *frame, uint16_t len, uint8_t channel, int8_t rssi,
+                            uint32_t now_us, beacon_summary_t *summary, bool *have_summary);
+
+/* Look at one more table entry; returns true and fills *summary if its
+ * window has expired with repeats pending. Called once per received frame,
+ * so quiet BSSIDs get their summary while other traffic flows. */
+bool      beacondedup_sweep(uint32_t now_us, beacon_summary_t *summary);
+
+uint32_t  beacondedup_get_suppressed(void);
+uint32_t  beacondedup_get_summaries(void);
@@ -0,0 +1,127 @@
+#include "bench.h"
+#include "sniffer.h"
+#include "usb_serial.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#define BENCH_TASK_STACK     3072
+#define BENCH_TASK_PRIORITY  2    /* Below the sender and command tasks: it fills what they leave */
+
+static _Atomic bool     s_running;
+static _Atomic bool     s_stop;
+static uint32_t         s_ms;
+static uint16_t         s_len;
+static uint32_t         s_rate;
+static bench_done_cb_t  s_done;
+static uint8_t          s_frame[BENCH_MAX_LEN];
+
+/* ToDS data frame, then the sequence counter and a counting pattern; the
+ * sequence fields are filled in per frame */
+static void build_frame(uint16_t len)
+{
+    static const uint8_t bssid[6] = BENCH_BSSID;
+    static const uint8_t sta[6] = BENCH_STA;
+
+    memset(s_frame, 0, BENCH_SEQ_OFFSET);
+    s_frame[0] = 0x08;
+    s_frame[1] = 0x01;
+    memcpy(s_frame + 4, bssid, 6);
+    memcpy(s_frame + 10, sta, 6);
+    memcpy(s_frame + 16, bssid, 6);
+    for (uint16_t i = BENCH_SEQ_OFFSET + 4; i < len; i++) {
+        s_frame[i] = (uint8_t)i;
+    }
+}
+
+/* Stamp sequence number seq: the 12-bit 802.11 one and the full counter */
+static void set_seq(uint32_t seq)
+{
+    s_frame[22] = (uint8_t)(seq << 4);
+    s_frame[23] = (uint8_t)(seq >> 4);
+    memcpy(s_frame + BENCH_SEQ_OFFSET, &seq, sizeof(seq));
+}
+
+static void bench_task(void *arg)
+{
+    bench_result_t r = { 0 };
+
+    sniffer_capture_pause();
+    uint32_t tx_start = usb_serial_get_tx_bytes();
+    int64_t start = esp_timer_get_time();
+    int64_t end = start + (int64_t)s_ms * 1000;
+
+    while (!atomic_load(&s_stop)) {
+        int64_t now = esp_timer_get_time();
+        if (now >= end) {
+            break;
+        }
+        if (s_rate == 0) {
+            set_seq(r.frames);
+            if (sniffer_inject(s_frame, s_len, false)) {
+                r.frames++;
+            } else {
+                r.stalls++;
+                vTaskDelay(1);
+            }
+            continue;
+        }
+        /* Paced: catch up with the schedule, then sleep a tick */
+        uint32_t due = (uint32_t)((now - start) * s_rate / 1000000);
+        while (r.frames < due) {
+            set_seq(r.frames++);
+            if (!sniffer_inject(s_frame, s_len, true)) {
+                r.dropped++;
+            }
+        }
+        vTaskDelay(1);
+    }
+
+    r.ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+    r.usb_bytes = usb_serial_get_tx_bytes() - tx_start;
+    sniffer_capture_resume();
+
+    atomic_store(&s_running, false);
+    s_done(&r);
+    vTaskDelete(NULL);
+}
+
+esp_err_t bench_start(uint32_t ms, uint16_t len, uint32_t rate, bench_done_cb_t done)
+{
+    if (ms < BENCH_MIN_MS || ms > BENCH_MAX_MS || len < BENCH_MIN_LEN || len > BENCH_MAX_LEN ||
+        rate > BENCH_MAX_RATE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool idle = false;
+    if (!atomic_compare_exchange_strong(&s_running, &idle, true)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_ms = ms;
+    s_len = len;
+    s_rate = rate;
+    s_done = done;
+    atomic_store(&s_stop, false);
+    build_frame(len);
+    if (xTaskCreate(bench_task, "bench", BENCH_TASK_STACK, NULL, BENCH_TASK_PRIORITY,
+                    NULL) != pdPASS) {
+        atomic_store(&s_running, false);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void bench_stop(void)
+{
+    atomic_store(&s_stop, true);
+    sniffer_inject_cancel();   /* The RX worker may be waiting on a frame of this run */
+}
+
+bool bench_running(void)
+{
+    return atomic_load(&s_running);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "protocol.h"
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BENCH_MIN_MS       100
+#define BENCH_MAX_MS       60000
+#define BENCH_MIN_LEN      28       /* Data frame MAC header + sequence counter */
+#define BENCH_MAX_LEN      MAX_80211_FRAME_LEN
+#define BENCH_DEFAULT_LEN  1024
+
+#define BENCH_MAX_RATE     100000   /* Frames/s in paced mode */
+
+/* Synthetic frames: a ToDS data frame from BENCH_STA to BENCH_BSSID whose
+ * body starts with a uint32 LE sequence number, counting from 0 for every
+ * run, so the host can tell lost frames from ones never sent */
+#define BENCH_BSSID        { 0x02, 0x5d, 0x7a, 0xbe, 0x4c, 0x01 }
+#define BENCH_STA          { 0x02, 0x5d, 0x7a, 0xbe, 0x4c, 0x02 }
+#define BENCH_SEQ_OFFSET   24
+
+typedef struct {
+    uint32_t frames;      /* Sequence numbers used: frames queued + dropped */
+    uint32_t dropped;     /* Paced mode: frames that found the raw ring full */
+    uint32_t stalls;      /* Max-rate mode: times the raw ring was full and the generator waited a tick */
+    uint32_t ms;          /* Time it ran */
+    uint32_t usb_bytes;   /* Bytes the USB driver accepted meanwhile */
+} bench_result_t;
+
+typedef void (*bench_done_cb_t)(const bench_result_t *result);
+
+/*
+ * Link benchmark (BENCH command): a low-priority task replaces capture with
+ * synthetic frames fed into the raw ring, so everything from the RX worker
+ * to the host sees them as captured frames whatever the RF conditions. The
+ * worker's MACFILTER, PRESENCE, SHED and SNAPLEN settings apply to them.
+ * With rate 0 they are queued as fast as the rings take them, waiting when
+ * one is full: the rate reaching the host is the link ceiling. With a rate
+ * they are paced like real traffic and a full ring drops them, counted as
+ * DROP_RAW_FULL or DROP_RING_FULL. CH, HOP and BANDMODE are refused while it
+ * runs. done is called on the bench task when it finishes.
+ */
+esp_err_t bench_start(uint32_t ms, uint16_t len, uint32_t rate,
+                      bench_done_cb_t done);   /* ESP_ERR_INVALID_STATE if running */
+void      bench_stop(void);
+bool      bench_running(void);
@@ -2,8 +2,17 @@
 #include "protocol.h"
 #include "usb_serial.h"
 #include "sniffer.h"
+#include "macfilter.h"
+#include "beacondedup.h"
+#include "presence.h"
+#include "hop.h"
+#include "stats.h"
+#include "flow.h"
+#include "settings.h"
+#include "bench.h"
 
 #include "esp_wifi_types.h"
+#include "esp_system.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
@@ -11,10 +20,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#define CMD_TASK_STACK    2048
+#define CMD_TASK_STACK    4096
 #define CMD_TASK_PRIORITY 3
-#define CMD_LINE_MAX      128
-#define RESP_BUF_MAX      200
+#define CMD_LINE_MAX      256   /* Room for a HOP list of every channel */
+#define RESP_BUF_MAX      512   /* Room for a worst-case STATUS line */
 
 static void send_response(const char *text)
 {
@@ -27,7 +36,20 @@ static void send_response(const char *text)
     }
     memcpy(buf + 1, text, text_len);
 
-    usb_serial_send_slip_frame(buf, 1 + text_len);
+    usb_serial_send_frame(buf, 1 + text_len);
+}
+
+/* Runs on the bench task when BENCH finishes */
+static void bench_done(const bench_result_t *r)
+{
+    char resp[128];
+    snprintf(resp, sizeof(resp),
+             "OK BENCH DONE FRAMES %lu DROPPED %lu STALLS %lu MS %lu USB %lu RATE %lu",
+             (unsigned long)r->frames, (unsigned long)r->dropped, (unsigned long)r->stalls,
+             (unsigned long)r->ms,
+             (unsigned long)r->usb_bytes,
+             r->ms ? (unsigned long)((uint64_t)r->usb_bytes * 1000 / r->ms) : 0UL);
+    send_response(resp);
 }
 
 /* Parse space-separated filter tokens into a bitmask */
@@ -68,15 +90,112 @@ static const char *filter_mask_str(uint32_t mask, char *out, size_t out_len)
     return out;
 }
 
+/* Parse one snaplen value: 0-2500 or HDR (MAC header only) */
+static bool parse_snaplen(const char *token, uint16_t *out)
+{
+    if (strcasecmp(token, "HDR") == 0) {
+        *out = SNAPLEN_HDR;
+        return true;
+    }
+    char *end;
+    long val = strtol(token, &end, 10);
+    if (*end != '\0' || val < 0 || val > MAX_80211_FRAME_LEN) {
+        return false;
+    }
+    *out = (uint16_t)val;
+    return true;
+}
+
+static int parse_frame_type(const char *token)
+{
+    if (strcasecmp(token, "MGMT") == 0) return IEEE80211_FTYPE_MGMT;
+    if (strcasecmp(token, "DATA") == 0) return IEEE80211_FTYPE_DATA;
+    if (strcasecmp(token, "CTRL") == 0) return IEEE80211_FTYPE_CTRL;
+    return -1;
+}
+
+/* "MGMT <n> DATA <n> CTRL <n>" for responses and STATUS */
+static const char *snaplen_str(char *out, size_t out_len)
+{
+    static const struct { const char *name; uint8_t type; } types[] = {
+        { "MGMT", IEEE80211_FTYPE_MGMT },
+        { "DATA", IEEE80211_FTYPE_DATA },
+        { "CTRL", IEEE80211_FTYPE_CTRL },
+    };
+    size_t pos = 0;
+
+    out[0] = '\0';
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]) && pos < out_len; i++) {
+        uint16_t snaplen = sniffer_get_type_snaplen(types[i].type);
+        if (snaplen == SNAPLEN_HDR) {
+            pos += snprintf(out + pos, out_len - pos, "%s%s HDR", i ? " " : "", types[i].name);
+        } else {
+            pos += snprintf(out + pos, out_len - pos, "%s%s %u", i ? " " : "", types[i].name,
+                            snaplen);
+        }
+    }
+    return out;
+}
+
+/* Parse "ch[:weight],ch[:weight],..." into slots; returns the count, 0 if invalid */
+static uint8_t parse_hop_list(char *list, hop_slot_t *slots)
+{
+    uint8_t count = 0;
+    char *save;
+
+    for (char *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *end;
+        long ch = strtol(tok, &end, 10);
+        long weight = 1;
+        if (*end == ':') {
+            weight = strtol(end + 1, &end, 10);
+        }
+        if (*end != '\0' || ch < 1 || ch > 196 || weight < 1 || weight > HOP_MAX_WEIGHT ||
+            count >= HOP_MAX_CHANNELS) {
+            return 0;
+        }
+        slots[count].channel = (uint8_t)ch;
+        slots[count].weight = (uint8_t)weight;
+        count++;
+    }
+    return count;
+}
+
+/* Parse aa:bb:cc:dd:ee:ff (or with '-' separators) */
+static bool parse_mac(const char *text, uint8_t mac[6])
+{
+    unsigned int b[6];
+    char sep[5];
+    if (sscanf(text, "%2x%c%2x%c%2x%c%2x%c%2x%c%2x",
+               &b[0], &sep[0], &b[1], &sep[1], &b[2], &sep[2],
+               &b[3], &sep[3], &b[4], &sep[4], &b[5]) != 11) {
+        return false;
+    }
+    for (int i = 0; i < 5; i++) {
+        if (sep[i] != ':' && sep[i] != '-') {
+            return false;
+        }
+    }
+    for (int i = 0; i < 6; i++) {
+        mac[i] = (uint8_t)b[i];
+    }
+    return true;
+}
+
 static void handle_command(const char *line)
 {
-    /* CH <n> — switch channel */
+    /* CH <n> — switch channel (stops HOP) */
     if (strncasecmp(line, "CH ", 3) == 0) {
         int ch = atoi(line + 3);
         if (ch < 1 || ch > 196) {
             send_response("ERR invalid channel");
             return;
         }
+        if (bench_running()) {
+            send_response("ERR bench running");
+            return;
+        }
+        hop_stop();
         esp_err_t err = sniffer_set_channel((uint8_t)ch);
         if (err != ESP_OK) {
             send_response("ERR channel switch failed");
@@ -88,6 +207,73 @@ static void handle_command(const char *line)
         return;
     }
 
+    /* HOP <dwell_ms> <ch[:weight],...> — hop on the device, dwelling weight x
+     * dwell_ms on each channel (weight defaults to 1). HOP OFF stops. */
+    if (strncasecmp(line, "HOP ", 4) == 0) {
+        const char *arg = line + 4;
+        if (strcasecmp(arg, "OFF") == 0) {
+            hop_stop();
+            send_response("OK HOP OFF");
+            return;
+        }
+
+        if (bench_running()) {
+            send_response("ERR bench running");
+            return;
+        }
+
+        char list[CMD_LINE_MAX];
+        hop_slot_t slots[HOP_MAX_CHANNELS];
+        char *end;
+        long dwell = strtol(arg, &end, 10);
+        if (end == arg || *end != ' ' || dwell < HOP_MIN_DWELL_MS || dwell > HOP_MAX_DWELL_MS) {
+            send_response("ERR invalid hop dwell (10-60000 ms)");
+            return;
+        }
+        strncpy(list, end + 1, sizeof(list) - 1);
+        list[sizeof(list) - 1] = '\0';
+        uint8_t count = parse_hop_list(list, slots);
+        if (count == 0) {
+            send_response("ERR invalid hop list (use ch[:weight],... up to 48)");
+            return;
+        }
+        if (hop_start((uint32_t)dwell, slots, count) != ESP_OK) {
+            send_response("ERR channel switch failed");
+            return;
+        }
+        char resp[48];
+        snprintf(resp, sizeof(resp), "OK HOP %ld COUNT %u", dwell, count);
+        send_response(resp);
+        return;
+    }
+
+    /* BANDMODE <AUTO|FIXED> — AUTO lets a channel set cross bands without
+     * restarting promiscuous mode; FIXED pins the band of each channel */
+    if (strncasecmp(line, "BANDMODE ", 9) == 0) {
+        const char *arg = line + 9;
+        esp_err_t err;
+        if (bench_running()) {
+            send_response("ERR bench running");
+            return;
+        }
+        if (strcasecmp(arg, "AUTO") == 0) {
+            err = sniffer_set_band_auto(true);
+        } else if (strcasecmp(arg, "FIXED") == 0) {
+            err = sniffer_set_band_auto(false);
+        } else {
+            send_response("ERR invalid band mode (use AUTO FIXED)");
+            return;
+        }
+        if (err != ESP_OK) {
+            send_response("ERR band mode AUTO not supported");
+            return;
+        }
+        char resp[32];
+        snprintf(resp, sizeof(resp), "OK BANDMODE %s", sniffer_get_band_auto() ? "AUTO" : "FIXED");
+        send_response(resp);
+        return;
+    }
+
     /* FILTER <MGMT|DATA|CTRL|ALL> — set frame type filter */
     if (strncasecmp(line, "FILTER ", 7) == 0) {
         uint32_t mask = parse_filter_mask(line + 7);
@@ -108,23 +294,382 @@ static void handle_command(const char *line)
         return;
     }
 
-    /* SNAPLEN <n> — set capture truncation (0 = full frames) */
+    /* SNAPLEN <n|HDR> — set capture truncation for all frames (0 = full frames)
+     * SNAPLEN MGMT <n|HDR> DATA <n|HDR> CTRL <n|HDR> — per frame type, any subset */
     if (strncasecmp(line, "SNAPLEN ", 8) == 0) {
-        int val = atoi(line + 8);
-        if (val < 0 || val > MAX_80211_FRAME_LEN) {
-            send_response("ERR snaplen out of range (0-2500)");
+        char buf[64];
+        strncpy(buf, line + 8, sizeof(buf) - 1);
+        buf[sizeof(buf) - 1] = '\0';
+
+        uint16_t val;
+        char *token = strtok(buf, " ");
+        if (!token) {
+            send_response("ERR snaplen out of range (0-2500, HDR)");
+            return;
+        }
+        if (parse_snaplen(token, &val)) {
+            sniffer_set_snaplen(val);
+        } else {
+            /* Validate every pair before applying any of them */
+            uint16_t vals[4];
+            bool     set[4] = { false };
+            while (token) {
+                int type = parse_frame_type(token);
+                char *arg = strtok(NULL, " ");
+                if (type < 0 || !arg || !parse_snaplen(arg, &val)) {
+                    send_response("ERR snaplen out of range (0-2500, HDR)");
+                    return;
+                }
+                vals[type] = val;
+                set[type] = true;
+                token = strtok(NULL, " ");
+            }
+            for (int type = 0; type < 4; type++) {
+                if (set[type]) {
+                    sniffer_set_type_snaplen(type, vals[type]);
+                }
+            }
+        }
+
+        char sstr[48];
+        char resp[64];
+        snprintf(resp, sizeof(resp), "OK SNAPLEN %s", snaplen_str(sstr, sizeof(sstr)));
+        send_response(resp);
+        return;
+    }
+
+    /* MACFILTER ADD|DEL <mac>, MACFILTER CLEAR — addr1/2/3 allowlist (empty = all) */
+    if (strncasecmp(line, "MACFILTER ", 10) == 0) {
+        const char *arg = line + 10;
+        const char *op;
+        uint8_t mac[6];
+        esp_err_t err;
+
+        if (strcasecmp(arg, "CLEAR") == 0) {
+            macfilter_clear();
+            send_response("OK MACFILTER CLEAR");
+            return;
+        }
+        if (strncasecmp(arg, "ADD ", 4) == 0 && parse_mac(arg + 4, mac)) {
+            op = "ADD";
+            err = macfilter_add(mac);
+            if (err == ESP_ERR_NO_MEM) {
+                send_response("ERR macfilter full (max 32)");
+                return;
+            }
+        } else if (strncasecmp(arg, "DEL ", 4) == 0 && parse_mac(arg + 4, mac)) {
+            op = "DEL";
+            err = macfilter_del(mac);
+            if (err == ESP_ERR_NOT_FOUND) {
+                send_response("ERR macfilter entry not found");
+                return;
+            }
+        } else {
+            send_response("ERR invalid macfilter (use ADD <mac> DEL <mac> CLEAR)");
+            return;
+        }
+
+        char resp[64];
+        snprintf(resp, sizeof(resp), "OK MACFILTER %s %02x:%02x:%02x:%02x:%02x:%02x COUNT %lu",
+                 op, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
+                 (unsigned long)macfilter_get_count());
+        send_response(resp);
+        return;
+    }
+
+    /* PKTHDR <1|2> — packet record header: v1, or v2 with transport sequence
+     * numbers and a 64-bit timestamp */
+    if (strncasecmp(line, "PKTHDR ", 7) == 0) {
+        const char *arg = line + 7;
+        if (strcmp(arg, "1") == 0) {
+            sniffer_set_pkt_header(1);
+        } else if (strcmp(arg, "2") == 0) {
+            sniffer_set_pkt_header(2);
+        } else {
+            send_response("ERR invalid pkthdr (use 1 2)");
             return;
         }
-        sniffer_set_snaplen((uint16_t)val);
         char resp[32];
-        snprintf(resp, sizeof(resp), "OK SNAPLEN %d", val);
+        snprintf(resp, sizeof(resp), "OK PKTHDR %u", sniffer_get_pkt_header());
         send_response(resp);
         return;
     }
 
-    /* COMPRESS — not supported (tdefl_compressor needs ~160KB, too large) */
+    /* BATCH <ON|OFF> — pack several records per USB frame */
+    if (strncasecmp(line, "BATCH ", 6) == 0) {
+        const char *arg = line + 6;
+        if (strcasecmp(arg, "ON") == 0) {
+            sniffer_set_batch(true);
+        } else if (strcasecmp(arg, "OFF") == 0) {
+            sniffer_set_batch(false);
+        } else {
+            send_response("ERR invalid batch mode (use ON OFF)");
+            return;
+        }
+        char resp[32];
+        snprintf(resp, sizeof(resp), "OK BATCH %s", sniffer_get_batch() ? "ON" : "OFF");
+        send_response(resp);
+        return;
+    }
+
+    /* FRAMING <SLIP|LEN> — select wire framing. The reply still goes out in
+     * the old framing; everything after it uses the new one. */
+    if (strncasecmp(line, "FRAMING ", 8) == 0) {
+        const char *arg = line + 8;
+        usb_framing_t framing;
+        if (strcasecmp(arg, "SLIP") == 0) {
+            framing = USB_FRAMING_SLIP;
+        } else if (strcasecmp(arg, "LEN") == 0) {
+            framing = USB_FRAMING_LEN;
+        } else {
+            send_response("ERR invalid framing (use SLIP LEN)");
+            return;
+        }
+        char resp[32];
+        snprintf(resp, sizeof(resp), "OK FRAMING %s",
+                 framing == USB_FRAMING_LEN ? "LEN" : "SLIP");
+        send_response(resp);
+        usb_serial_set_framing(framing);
+        return;
+    }
+
+    /* COMPRESS <ON|OFF> — LZ4-compress batched records (needs BATCH ON) */
     if (strncasecmp(line, "COMPRESS ", 9) == 0) {
-        send_response("ERR compression not available (insufficient RAM)");
+        const char *arg = line + 9;
+        if (strcasecmp(arg, "ON") == 0) {
+            sniffer_set_compress(true);
+        } else if (strcasecmp(arg, "OFF") == 0) {
+            sniffer_set_compress(false);
+        } else {
+            send_response("ERR invalid compress mode (use ON OFF)");
+            return;
+        }
+        char resp[32];
+        snprintf(resp, sizeof(resp), "OK COMPRESS %s", sniffer_get_compress() ? "ON" : "OFF");
+        send_response(resp);
+        return;
+    }
+
+    /* BEACONDEDUP <ms> — fold repeat beacons per BSSID into summaries (0 = off) */
+    if (strncasecmp(line, "BEACONDEDUP ", 12) == 0) {
+        char *end;
+        long ms = strtol(line + 12, &end, 10);
+        if (end == line + 12 || *end != '\0' || ms < 0 || ms > BEACONDEDUP_MAX_WINDOW_MS) {
+            send_response("ERR invalid beacondedup window (0-60000 ms)");
+            return;
+        }
+        sniffer_set_beacondedup((uint32_t)ms);
+        char resp[32];
+        snprintf(resp, sizeof(resp), "OK BEACONDEDUP %ld", ms);
+        send_response(resp);
+        return;
+    }
+
+    /* PRESENCE <ms> [PASS] — count probe requests per channel into one
+     * summary record per window (0 = off); PASS keeps sending other frames */
+    if (strncasecmp(line, "PRESENCE ", 9) == 0) {
+        char *end;
+        long ms = strtol(line + 9, &end, 10);
+        if (end == line + 9) {
+            send_response("ERR invalid presence window (0, 1000-3600000 ms)");
+            return;
+        }
+        bool pass = false;
+        while (*end == ' ') {
+            end++;
+        }
+        if (strcasecmp(end, "PASS") == 0) {
+            pass = true;
+            end += 4;
+        }
+        if (*end != '\0' || (ms != 0 && (ms < PRESENCE_MIN_WINDOW_MS || ms > PRESENCE_MAX_WINDOW_MS))) {
+            send_response("ERR invalid presence window (0, 1000-3600000 ms)");
+            return;
+        }
+        if (presence_set_window((uint32_t)ms, pass) != ESP_OK) {
+            send_response("ERR no memory");
+            return;
+        }
+        char resp[40];
+        snprintf(resp, sizeof(resp), "OK PRESENCE %ld%s", ms, pass ? " PASS" : "");
+        send_response(resp);
+        return;
+    }
+
+    /* FLOW <bytes> — credit window for host flow control (0 = off).
+     * CREDIT <bytes> — host consumed that many frame payload bytes; no reply,
+     * since the reply would itself cost credit */
+    if (strncasecmp(line, "FLOW ", 5) == 0) {
+        char *end;
+        long bytes = strtol(line + 5, &end, 10);
+        if (end == line + 5 || *end != '\0' || (bytes != 0 && (bytes < FLOW_MIN_WINDOW || bytes > FLOW_MAX_WINDOW))) {
+            send_response("ERR invalid flow window (0, 4096-1048576 bytes)");
+            return;
+        }
+        flow_set_window((uint32_t)bytes);
+        char resp[32];
+        snprintf(resp, sizeof(resp), "OK FLOW %ld", bytes);
+        send_response(resp);
+        return;
+    }
+    if (strncasecmp(line, "CREDIT ", 7) == 0) {
+        char *end;
+        long bytes = strtol(line + 7, &end, 10);
+        if (*end != '\0' || bytes <= 0 || bytes > FLOW_MAX_WINDOW) {
+            send_response("ERR invalid credit");
+            return;
+        }
+        flow_credit((uint32_t)bytes);
+        return;
+    }
+
+    /* SHED <ON|OFF> — under overload drop data, then control frames first */
+    if (strncasecmp(line, "SHED ", 5) == 0) {
+        const char *arg = line + 5;
+        if (strcasecmp(arg, "ON") == 0) {
+            sniffer_set_shed(true);
+        } else if (strcasecmp(arg, "OFF") == 0) {
+            sniffer_set_shed(false);
+        } else {
+            send_response("ERR invalid shed mode (use ON OFF)");
+            return;
+        }
+        char resp[32];
+        snprintf(resp, sizeof(resp), "OK SHED %s", sniffer_get_shed() ? "ON" : "OFF");
+        send_response(resp);
+        return;
+    }
+
+    /* STATS <ms> — MSG_TYPE_STATS telemetry interval (0 = off) */
+    if (strncasecmp(line, "STATS ", 6) == 0) {
+        char *end;
+        long ms = strtol(line + 6, &end, 10);
+        if (end == line + 6 || *end != '\0' || (ms != 0 && (ms < STATS_MIN_MS || ms > STATS_MAX_MS))) {
+            send_response("ERR invalid stats interval (0, 100-60000 ms)");
+            return;
+        }
+        stats_set_interval((uint32_t)ms);
+        char resp[32];
+        snprintf(resp, sizeof(resp), "OK STATS %ld", ms);
+        send_response(resp);
+        return;
+    }
+
+    /* TIMESYNC <token> — echo the host's token with the time on the packet
+     * timestamp clock; the host pairs it with its send/receive times to
+     * estimate offset and drift */
+    if (strncasecmp(line, "TIMESYNC ", 9) == 0) {
+        const char *token = line + 9;
+        size_t len = strlen(token);
+        if (len == 0 || len > 20 || strspn(token, "0123456789") != len) {
+            send_response("ERR invalid timesync token (1-20 digits)");
+            return;
+        }
+        char resp[48];
+        snprintf(resp, sizeof(resp), "OK TIMESYNC %s %lu", token,
+                 (unsigned long)sniffer_get_rx_time());
+        send_response(resp);
+        return;
+    }
+
+    /* TXBUF <bytes> — USB driver TX buffer; stored, applied at the next boot */
+    if (strncasecmp(line, "TXBUF ", 6) == 0) {
+        char *end;
+        long bytes = strtol(line + 6, &end, 10);
+        if (*end != '\0' || bytes < SETTINGS_TXBUF_MIN || bytes > SETTINGS_TXBUF_MAX) {
+            send_response("ERR invalid txbuf (4096-65536 bytes)");
+            return;
+        }
+        if (settings_set_txbuf((uint32_t)bytes) != ESP_OK) {
+            send_response("ERR txbuf not stored");
+            return;
+        }
+        char resp[48];
+        snprintf(resp, sizeof(resp), "OK TXBUF %ld AT REBOOT", bytes);
+        send_response(resp);
+        return;
+    }
+
+    /* SENDPRIO <n> — sender task priority; stored and applied now */
+    if (strncasecmp(line, "SENDPRIO ", 9) == 0) {
+        char *end;
+        long prio = strtol(line + 9, &end, 10);
+        if (*end != '\0' || prio < SETTINGS_SEND_PRIO_MIN || prio > SETTINGS_SEND_PRIO_MAX) {
+            send_response("ERR invalid sendprio (1-20)");
+            return;
+        }
+        if (settings_set_send_prio((uint8_t)prio) != ESP_OK) {
+            send_response("ERR sendprio not stored");
+            return;
+        }
+        sniffer_set_sender_priority((uint8_t)prio);
+        hop_set_sender_priority((uint8_t)prio);
+        char resp[32];
+        snprintf(resp, sizeof(resp), "OK SENDPRIO %ld", prio);
+        send_response(resp);
+        return;
+    }
+
+    /* RXBUDGET <n> — frames the RX worker handles before letting the sender run */
+    if (strncasecmp(line, "RXBUDGET ", 9) == 0) {
+        char *end;
+        long frames = strtol(line + 9, &end, 10);
+        if (*end != '\0' || frames < RX_BUDGET_MIN || frames > RX_BUDGET_MAX) {
+            send_response("ERR invalid rxbudget (1-1024)");
+            return;
+        }
+        sniffer_set_rx_budget((uint16_t)frames);
+        char resp[32];
+        snprintf(resp, sizeof(resp), "OK RXBUDGET %ld", frames);
+        send_response(resp);
+        return;
+    }
+
+    /* REBOOT — restart, e.g. to apply TXBUF */
+    if (strcasecmp(line, "REBOOT") == 0) {
+        send_response("OK REBOOT");
+        vTaskDelay(pdMS_TO_TICKS(50));     /* Let the reply drain */
+        esp_restart();
+    }
+
+    /* BENCH <ms> [len [rate]] — synthetic sequence-numbered frames instead of
+     * capture, at the link's maximum rate or paced at rate frames/s;
+     * BENCH STOP ends early. The result follows as a second response when
+     * it finishes. */
+    if (strncasecmp(line, "BENCH ", 6) == 0) {
+        const char *arg = line + 6;
+        if (strcasecmp(arg, "STOP") == 0) {
+            bench_stop();
+            send_response("OK BENCH STOP");
+            return;
+        }
+        char *end;
+        long ms = strtol(arg, &end, 10);
+        long len = BENCH_DEFAULT_LEN;
+        long rate = 0;
+        if (end != arg && *end == ' ') {
+            len = strtol(end + 1, &end, 10);
+        }
+        if (end != arg && *end == ' ') {
+            rate = strtol(end + 1, &end, 10);
+        }
+        if (end == arg || *end != '\0' || ms < BENCH_MIN_MS || ms > BENCH_MAX_MS ||
+            len < BENCH_MIN_LEN || len > BENCH_MAX_LEN || rate < 0 || rate > BENCH_MAX_RATE) {
+            send_response("ERR invalid bench (BENCH <100-60000 ms> [28-2500 bytes [0-100000 /s]])");
+            return;
+        }
+        if (bench_running()) {
+            send_response("ERR bench running");
+            return;
+        }
+        hop_stop();
+        if (bench_start((uint32_t)ms, (uint16_t)len, (uint32_t)rate, bench_done) != ESP_OK) {
+            send_response("ERR bench failed");
+            return;
+        }
+        char resp[48];
+        snprintf(resp, sizeof(resp), "OK BENCH %ld %ld %ld", ms, len, rate);
+        send_response(resp);
         return;
     }
 
@@ -132,20 +677,46 @@ static void handle_command(const char *line)
     if (strncasecmp(line, "STATUS", 6) == 0) {
         char resp[RESP_BUF_MAX];
         char fstr[32];
+        char sstr[48];
         uint8_t ch = sniffer_get_channel();
         filter_mask_str(sniffer_get_filter(), fstr, sizeof(fstr));
         snprintf(resp, sizeof(resp),
-                 "CH %d BAND %s FILTER %s SNAPLEN %u COMPRESS %s "
-                 "QUEUE %lu CAP %lu DROP %lu HEAP %lu",
+                 "CH %d BAND %s FILTER %s SNAPLEN %s BATCH %s FRAMING %s COMPRESS %s CRATIO %lu "
+                 "QUEUE %lu CAP %lu DROP %lu HEAP %lu MACF %lu HIT %lu MISS %lu BDEDUP %lu BSUP %lu "
+                 "HOP %lu HOPS %lu BANDMODE %s SWLAT %lu/%lu/%lu SHED %s FLOW %lu TXBUF %lu SENDPRIO %u PKTHDR %u PRES %lu "
+                 "RXBUDGET %u RAWDROP %lu FILT %lu",
                  ch,
                  ch >= 36 ? "5G" : "2.4G",
                  fstr,
-                 sniffer_get_snaplen(),
+                 snaplen_str(sstr, sizeof(sstr)),
+                 sniffer_get_batch() ? "ON" : "OFF",
+                 usb_serial_get_framing() == USB_FRAMING_LEN ? "LEN" : "SLIP",
                  sniffer_get_compress() ? "ON" : "OFF",
+                 (unsigned long)sniffer_get_compress_ratio(),
                  (unsigned long)sniffer_get_queue_depth(),
                  (unsigned long)sniffer_get_captured(),
                  (unsigned long)sniffer_get_dropped(),
-                 (unsigned long)sniffer_get_free_heap());
+                 (unsigned long)sniffer_get_free_heap(),
+                 (unsigned long)macfilter_get_count(),
+                 (unsigned long)macfilter_get_hits(),
+                 (unsigned long)macfilter_get_misses(),
+                 (unsigned long)beacondedup_get_window(),
+                 (unsigned long)beacondedup_get_suppressed(),
+                 (unsigned long)hop_get_dwell(),
+                 (unsigned long)hop_get_hops(),
+                 sniffer_get_band_auto() ? "AUTO" : "FIXED",
+                 (unsigned long)sniffer_get_switch_us(SWITCH_SAME_BAND),
+                 (unsigned long)sniffer_get_switch_us(SWITCH_TO_5G),
+                 (unsigned long)sniffer_get_switch_us(SWITCH_TO_2G),
+                 sniffer_get_shed() ? "ON" : "OFF",
+                 (unsigned long)flow_get_window(),
+                 (unsigned long)usb_serial_get_tx_buffer_size(),
+                 (unsigned)settings_get()->send_prio,
+                 sniffer_get_pkt_header(),
+                 (unsigned long)presence_get_window(),
+                 (unsigned)sniffer_get_rx_budget(),
+                 (unsigned long)sniffer_get_drops(DROP_RAW_FULL),
+                 (unsigned long)sniffer_get_filtered());
         send_response(resp);
         return;
     }
@@ -155,27 +726,25 @@ static void handle_command(const char *line)
 
 static void cmd_task(void *arg)
 {
-    uint8_t read_buf[64];
+    uint8_t read_buf[128];
     char line_buf[CMD_LINE_MAX];
     size_t line_pos = 0;
 
     while (true) {
-        int n = usb_serial_read(read_buf, sizeof(read_buf));
-        if (n > 0) {
-            for (int i = 0; i < n; i++) {
-                uint8_t c = read_buf[i];
-                if (c == '\n' || c == '\r') {
-                    if (line_pos > 0) {
-                        line_buf[line_pos] = '\0';
-                        handle_command(line_buf);
-                        line_pos = 0;
-                    }
-                } else if (line_pos < CMD_LINE_MAX - 1) {
-                    line_buf[line_pos++] = (char)c;
+        /* Blocks until the host sends something: no polling wakeups, and
+         * CREDIT is acted on as soon as it arrives */
+        int n = usb_serial_read(read_buf, sizeof(read_buf), USB_SERIAL_WAIT_FOREVER);
+        for (int i = 0; i < n; i++) {
+            uint8_t c = read_buf[i];
+            if (c == '\n' || c == '\r') {
+                if (line_pos > 0) {
+                    line_buf[line_pos] = '\0';
+                    handle_command(line_buf);
+                    line_pos = 0;
                 }
+            } else if (line_pos < CMD_LINE_MAX - 1) {
+                line_buf[line_pos++] = (char)c;
             }
-        } else {
-            vTaskDelay(pdMS_TO_TICKS(10));
         }
     }
 }
@@ -0,0 +1,107 @@
+#include "compress.h"
+
+#include <string.h>
+
+#define HASH_BITS     10
+#define MIN_MATCH     4
+#define LAST_LITERALS 5     /* Block must end with at least this many literals */
+#define MF_LIMIT      12    /* Last match must start this far before the end */
+
+static uint16_t s_table[1u << HASH_BITS];
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(const uint8_t *p)
+{
+    return (read32(p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Write an LZ4 length continuation (255, 255, ..., rest) */
+static inline uint8_t *put_len(uint8_t *op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/* Emit one sequence: literals [anchor, anchor+lit_len), then a match of
+ * match_len at offset (match_len 0 = final literal-only sequence) */
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *oend, const uint8_t *anchor,
+                             size_t lit_len, uint16_t offset, size_t match_len)
+{
+    /* Token + worst-case length bytes + literals + offset */
+    if ((size_t)(oend - op) < 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1) {
+        return NULL;
+    }
+
+    uint8_t *token = op++;
+    *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15) {
+        op = put_len(op, lit_len - 15);
+    }
+    memcpy(op, anchor, lit_len);
+    op += lit_len;
+
+    if (match_len == 0) {
+        return op;
+    }
+
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    size_t ml = match_len - MIN_MATCH;
+    *token |= (uint8_t)(ml >= 15 ? 15 : ml);
+    if (ml >= 15) {
+        op = put_len(op, ml - 15);
+    }
+    return op;
+}
+
+size_t compress_block(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_cap)
+{
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *iend = src + len;
+    uint8_t *op = dst;
+    const uint8_t *oend = dst + dst_cap;
+
+    memset(s_table, 0, sizeof(s_table));
+
+    if (len > MF_LIMIT) {
+        const uint8_t *mflimit = iend - MF_LIMIT;
+        const uint8_t *matchlimit = iend - LAST_LITERALS;
+
+        while (ip < mflimit) {
+            uint32_t h = hash4(ip);
+            const uint8_t *ref = src + s_table[h];
+            s_table[h] = (uint16_t)(ip - src);
+
+            if (ref >= ip || ip - ref > 0xFFFF || read32(ref) != read32(ip)) {
+                ip++;
+                continue;
+            }
+
+            size_t match_len = MIN_MATCH;
+            while (ip + match_len < matchlimit && ref[match_len] == ip[match_len]) {
+                match_len++;
+            }
+
+            op = put_sequence(op, oend, anchor, ip - anchor, (uint16_t)(ip - ref), match_len);
+            if (!op) {
+                return 0;
+            }
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    op = put_sequence(op, oend, anchor, iend - anchor, 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * LZ4 block-format compressor (raw block, no frame header) with a 2 KB hash
+ * table, small enough for the ESP32-C5. Output decodes with any LZ4 block
+ * decoder, e.g. lz4.block.decompress() on the host.
+ *
+ * Returns the compressed length, or 0 if the result would not fit in dst_cap
+ * (i.e. the input is not worth compressing at that size). Inputs must be
+ * under 64 KB. Not reentrant: only the sender task calls it.
+ */
+size_t compress_block(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_cap);
@@ -0,0 +1,75 @@
+#include "flow.h"
+
+#include "freertos/semphr.h"
+
+#include <stdatomic.h>
+
+static _Atomic uint32_t  s_window;    /* 0 = flow control off */
+static _Atomic int32_t   s_balance;   /* May go negative by one frame */
+static _Atomic uint32_t  s_waits;
+static SemaphoreHandle_t s_credit;    /* Given whenever the balance grows */
+
+esp_err_t flow_init(void)
+{
+    s_credit = xSemaphoreCreateBinary();
+    return s_credit ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void flow_set_window(uint32_t bytes)
+{
+    atomic_store(&s_balance, (int32_t)bytes);
+    atomic_store(&s_window, bytes);
+    xSemaphoreGive(s_credit);
+}
+
+uint32_t flow_get_window(void)
+{
+    return atomic_load_explicit(&s_window, memory_order_relaxed);
+}
+
+void flow_credit(uint32_t bytes)
+{
+    int32_t window = (int32_t)atomic_load(&s_window);
+    int32_t cur = atomic_load(&s_balance);
+    int32_t next;
+
+    /* Never above the window: credit for frames sent before FLOW was set
+     * must not inflate it */
+    do {
+        next = cur + (int32_t)bytes;
+        if (next > window) {
+            next = window;
+        }
+    } while (!atomic_compare_exchange_weak(&s_balance, &cur, next));
+
+    xSemaphoreGive(s_credit);
+}
+
+void flow_charge(uint32_t bytes)
+{
+    if (atomic_load_explicit(&s_window, memory_order_relaxed)) {
+        atomic_fetch_sub(&s_balance, (int32_t)bytes);
+    }
+}
+
+bool flow_ready(void)
+{
+    return atomic_load_explicit(&s_window, memory_order_relaxed) == 0 ||
+           atomic_load(&s_balance) > 0;
+}
+
+void flow_wait(TickType_t timeout)
+{
+    atomic_fetch_add_explicit(&s_waits, 1, memory_order_relaxed);
+    xSemaphoreTake(s_credit, timeout);
+}
+
+int32_t flow_get_balance(void)
+{
+    return atomic_load_explicit(&s_window, memory_order_relaxed) ? atomic_load(&s_balance) : 0;
+}
+
+uint32_t flow_get_waits(void)
+{
+    return atomic_load_explicit(&s_waits, memory_order_relaxed);
+}
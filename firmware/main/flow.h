@@ -0,0 +1,32 @@
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FLOW_MIN_WINDOW  4096
+#define FLOW_MAX_WINDOW  (1024 * 1024)
+
+/*
+ * Credit-based flow control toward the host (FLOW / CREDIT commands).
+ *
+ * The host grants a window of frame payload bytes; every frame sent is
+ * charged its payload length, and the host hands back credit as it consumes
+ * frames. While the balance is used up the sender stops pulling from the
+ * ring instead of blocking inside a USB write, so overload shows up as ring
+ * fill, where the RX worker can shed deliberately (see SHED).
+ */
+esp_err_t flow_init(void);
+void      flow_set_window(uint32_t bytes);   /* 0 = off; resets the balance */
+uint32_t  flow_get_window(void);
+void      flow_credit(uint32_t bytes);       /* Host consumed this many bytes */
+void      flow_charge(uint32_t bytes);       /* A frame of this payload length is going out */
+
+/* Sender side: true if there is credit (or flow control is off) */
+bool      flow_ready(void);
+/* Wait up to timeout for new credit */
+void      flow_wait(TickType_t timeout);
+
+int32_t   flow_get_balance(void);
+uint32_t  flow_get_waits(void);
@@ -0,0 +1,147 @@
+#include "hop.h"
+#include "sniffer.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include <string.h>
+
+#define HOP_TASK_STACK     3072
+#define HOP_TASK_PRIORITY  6    /* Floor; always kept above the sender and RX worker */
+
+static hop_slot_t         s_slots[HOP_MAX_CHANNELS];
+static uint8_t            s_count;
+static uint8_t            s_pos;
+static uint32_t           s_dwell_ms;      /* 0 = not hopping */
+static uint32_t           s_hops;
+static esp_timer_handle_t s_timer;
+static TaskHandle_t       s_task;
+static SemaphoreHandle_t  s_lock;          /* Held across every hop and start/stop */
+
+/* One above SENDPRIO, so a switch is held up by neither USB nor the RX worker */
+static UBaseType_t hop_priority(uint8_t sender_priority)
+{
+    UBaseType_t prio = (UBaseType_t)sender_priority + 1;
+    return prio > HOP_TASK_PRIORITY ? prio : HOP_TASK_PRIORITY;
+}
+
+static void arm_timer(void)
+{
+    esp_timer_start_once(s_timer, (uint64_t)s_dwell_ms * s_slots[s_pos].weight * 1000);
+}
+
+/* esp_timer task context: keep it short, the WiFi calls happen in hop_task */
+static void hop_timer_cb(void *arg)
+{
+    xTaskNotifyGive(s_task);
+}
+
+static void hop_task(void *arg)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_dwell_ms > 0) {
+            s_pos = (s_pos + 1) % s_count;
+            sniffer_set_channel(s_slots[s_pos].channel);
+            s_hops++;
+            arm_timer();
+        }
+        xSemaphoreGive(s_lock);
+    }
+}
+
+/* Stable-partition slots by band, starting with the band of slots[0], so a
+ * pass over the list crosses bands at most twice (each crossing costs a
+ * promiscuous restart unless BANDMODE AUTO works) */
+static void group_by_band(hop_slot_t *slots, uint8_t count)
+{
+    hop_slot_t grouped[HOP_MAX_CHANNELS];
+    bool first_5g = slots[0].channel >= 36;
+    uint8_t n = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        bool want_5g = pass == 0 ? first_5g : !first_5g;
+        for (uint8_t i = 0; i < count; i++) {
+            if ((slots[i].channel >= 36) == want_5g) {
+                grouped[n++] = slots[i];
+            }
+        }
+    }
+    memcpy(slots, grouped, count * sizeof(slots[0]));
+}
+
+/* Cancel the timer and any wakeup it already sent; caller holds s_lock */
+static void cancel_pending(void)
+{
+    esp_timer_stop(s_timer);
+    xTaskNotifyStateClear(s_task);
+    ulTaskNotifyValueClear(s_task, UINT32_MAX);
+}
+
+esp_err_t hop_init(uint8_t sender_priority)
+{
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(hop_task, "hop", HOP_TASK_STACK, NULL, hop_priority(sender_priority),
+                    &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    const esp_timer_create_args_t args = {
+        .callback = hop_timer_cb,
+        .name     = "hop",
+    };
+    return esp_timer_create(&args, &s_timer);
+}
+
+void hop_set_sender_priority(uint8_t sender_priority)
+{
+    vTaskPrioritySet(s_task, hop_priority(sender_priority));
+}
+
+esp_err_t hop_start(uint32_t dwell_ms, const hop_slot_t *slots, uint8_t count)
+{
+    if (count == 0 || count > HOP_MAX_CHANNELS || dwell_ms == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cancel_pending();
+    memcpy(s_slots, slots, count * sizeof(slots[0]));
+    group_by_band(s_slots, count);
+    s_count = count;
+    s_pos = 0;
+    s_dwell_ms = dwell_ms;
+    esp_err_t err = sniffer_set_channel(s_slots[0].channel);
+    arm_timer();
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+void hop_stop(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cancel_pending();
+    s_dwell_ms = 0;
+    xSemaphoreGive(s_lock);
+}
+
+uint32_t hop_get_dwell(void)
+{
+    return s_dwell_ms;
+}
+
+uint8_t hop_get_count(void)
+{
+    return s_dwell_ms ? s_count : 0;
+}
+
+uint32_t hop_get_hops(void)
+{
+    return s_hops;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define HOP_MAX_CHANNELS  48
+#define HOP_MIN_DWELL_MS  10
+#define HOP_MAX_DWELL_MS  60000
+#define HOP_MAX_WEIGHT    16
+
+typedef struct {
+    uint8_t channel;
+    uint8_t weight;     /* Dwell on this channel is weight x the base dwell */
+} hop_slot_t;
+
+/*
+ * Firmware channel hopping. An esp_timer one-shot marks the end of each dwell
+ * and wakes a hop task, which switches channel and arms the timer for the
+ * next slot, so dwell is measured from when the new channel is set. The hop
+ * task runs above the sender and RX worker (SENDPRIO).
+ */
+esp_err_t hop_init(uint8_t sender_priority);
+
+/* Follow a SENDPRIO change, keeping the hop task above it */
+void      hop_set_sender_priority(uint8_t sender_priority);
+
+/* Start hopping over slots (copied), beginning at slots[0]. Channels are
+ * regrouped by band (order within a band is kept). Restarts if running. */
+esp_err_t hop_start(uint32_t dwell_ms, const hop_slot_t *slots, uint8_t count);
+
+/* Stop hopping; on return no further channel switch will be made */
+void      hop_stop(void);
+
+uint32_t  hop_get_dwell(void);     /* 0 when not hopping */
+uint8_t   hop_get_count(void);
+uint32_t  hop_get_hops(void);
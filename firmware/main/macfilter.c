@@ -0,0 +1,160 @@
+#include "macfilter.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#define SLOT_BITS  6                 /* 64 slots: load factor <= 0.5 */
+#define SLOT_COUNT (1u << SLOT_BITS)
+
+/*
+ * Open-addressed table with linear probing, looked up from the RX worker.
+ * The command task never edits the live table: it rebuilds the spare one from
+ * s_entries and swaps the pointer, so a lookup always sees a consistent table.
+ */
+typedef struct {
+    uint8_t  mac[SLOT_COUNT][6];
+    uint8_t  used[SLOT_COUNT];
+    uint32_t count;
+} mac_table_t;
+
+static mac_table_t                 s_tables[2];
+static _Atomic(mac_table_t *)      s_active = &s_tables[0];
+static _Atomic bool                s_in_lookup;   /* The RX worker is inside macfilter_match */
+
+/* Authoritative list, only touched by the command task */
+static uint8_t  s_entries[MACFILTER_MAX_ENTRIES][6];
+static uint32_t s_entry_count;
+
+static uint32_t s_hits;
+static uint32_t s_misses;
+
+static inline uint32_t mac_hash(const uint8_t *mac)
+{
+    /* Low bytes vary most (OUI is shared across a vendor's devices) */
+    uint32_t x = (uint32_t)mac[2] | ((uint32_t)mac[3] << 8) |
+                 ((uint32_t)mac[4] << 16) | ((uint32_t)mac[5] << 24);
+    x ^= (uint32_t)mac[0] | ((uint32_t)mac[1] << 8);
+    return (x * 2654435761u) >> (32 - SLOT_BITS);
+}
+
+static bool table_contains(const mac_table_t *t, const uint8_t *mac)
+{
+    for (uint32_t i = mac_hash(mac), n = 0; n < SLOT_COUNT; i = (i + 1) & (SLOT_COUNT - 1), n++) {
+        if (!t->used[i]) {
+            return false;
+        }
+        if (memcmp(t->mac[i], mac, 6) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void publish(void)
+{
+    mac_table_t *cur = atomic_load(&s_active);
+    mac_table_t *next = (cur == &s_tables[0]) ? &s_tables[1] : &s_tables[0];
+
+    memset(next, 0, sizeof(*next));
+    for (uint32_t e = 0; e < s_entry_count; e++) {
+        uint32_t i = mac_hash(s_entries[e]);
+        while (next->used[i]) {
+            i = (i + 1) & (SLOT_COUNT - 1);
+        }
+        memcpy(next->mac[i], s_entries[e], 6);
+        next->used[i] = 1;
+    }
+    next->count = s_entry_count;
+
+    atomic_store(&s_active, next);
+
+    /* The worker runs at SENDPRIO, which may be below this task, so a lookup
+     * on the old table can be preempted for any length of time. Wait it out
+     * before the next rebuild reuses that table; a lookup that starts after
+     * the swap already sees the new one. */
+    while (atomic_load(&s_in_lookup)) {
+        vTaskDelay(1);
+    }
+}
+
+static int find_entry(const uint8_t mac[6])
+{
+    for (uint32_t e = 0; e < s_entry_count; e++) {
+        if (memcmp(s_entries[e], mac, 6) == 0) {
+            return (int)e;
+        }
+    }
+    return -1;
+}
+
+esp_err_t macfilter_add(const uint8_t mac[6])
+{
+    if (find_entry(mac) >= 0) {
+        return ESP_OK;
+    }
+    if (s_entry_count >= MACFILTER_MAX_ENTRIES) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(s_entries[s_entry_count++], mac, 6);
+    publish();
+    return ESP_OK;
+}
+
+esp_err_t macfilter_del(const uint8_t mac[6])
+{
+    int e = find_entry(mac);
+    if (e < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    memmove(s_entries[e], s_entries[e + 1], (s_entry_count - e - 1) * 6);
+    s_entry_count--;
+    publish();
+    return ESP_OK;
+}
+
+void macfilter_clear(void)
+{
+    s_entry_count = 0;
+    publish();
+}
+
+bool macfilter_match(const uint8_t *frame, uint16_t len)
+{
+    atomic_store(&s_in_lookup, true);
+    const mac_table_t *t = atomic_load(&s_active);
+
+    if (t->count == 0) {
+        atomic_store(&s_in_lookup, false);
+        return true;
+    }
+
+    /* addr1 is in every frame; ACK/CTS stop there, mgmt/data carry addr3 */
+    bool hit = (len >= 10 && table_contains(t, frame + 4)) ||
+               (len >= 16 && table_contains(t, frame + 10)) ||
+               (len >= 22 && table_contains(t, frame + 16));
+    atomic_store(&s_in_lookup, false);
+    if (hit) {
+        s_hits++;
+    } else {
+        s_misses++;
+    }
+    return hit;
+}
+
+uint32_t macfilter_get_count(void)
+{
+    return s_entry_count;
+}
+
+uint32_t macfilter_get_hits(void)
+{
+    return s_hits;
+}
+
+uint32_t macfilter_get_misses(void)
+{
+    return s_misses;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MACFILTER_MAX_ENTRIES  32
+
+esp_err_t macfilter_add(const uint8_t mac[6]);
+esp_err_t macfilter_del(const uint8_t mac[6]);
+void      macfilter_clear(void);
+
+/* True if the frame should be kept: the allowlist is empty, or addr1, addr2
+ * or addr3 (where present) is on it. Called from the RX worker. */
+bool      macfilter_match(const uint8_t *frame, uint16_t len);
+
+uint32_t  macfilter_get_count(void);
+uint32_t  macfilter_get_hits(void);
+uint32_t  macfilter_get_misses(void);
@@ -1,11 +1,21 @@
+#include "settings.h"
 #include "usb_serial.h"
+#include "flow.h"
 #include "sniffer.h"
 #include "cmd.h"
+#include "hop.h"
+#include "stats.h"
+#include "presence.h"
 #include "esp_err.h"
 
 void app_main(void)
 {
-    ESP_ERROR_CHECK(usb_serial_init());
-    ESP_ERROR_CHECK(sniffer_init(1));
+    ESP_ERROR_CHECK(settings_init());
+    ESP_ERROR_CHECK(flow_init());
+    ESP_ERROR_CHECK(usb_serial_init(settings_get()->txbuf));
+    ESP_ERROR_CHECK(sniffer_init(1, settings_get()->send_prio));
+    ESP_ERROR_CHECK(hop_init(settings_get()->send_prio));
+    ESP_ERROR_CHECK(stats_init());
+    ESP_ERROR_CHECK(presence_init());
     ESP_ERROR_CHECK(cmd_init());
 }
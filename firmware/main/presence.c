@@ -0,0 +1,223 @@
+#include "presence.h"
+#include "protocol.h"
+#include "sniffer.h"
+#include "usb_serial.h"
+
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#define PRESENCE_TASK_STACK     3072
+#define PRESENCE_TASK_PRIORITY  2    /* Same as stats: below the sender and command tasks */
+
+typedef struct {
+    uint8_t  channel;       /* 0 = unused */
+    uint8_t  exact_count;
+    uint8_t  flags;         /* PRESENCE_FLAG_* */
+    uint32_t probes;
+    uint8_t  regs[PRESENCE_HLL_REGS];
+    uint8_t  exact[PRESENCE_EXACT_MAX][6];
+} presence_slot_t;
+
+typedef struct {
+    presence_slot_t slots[PRESENCE_MAX_CHANNELS];
+    uint32_t        start;  /* sniffer_get_rx_time() when the bank became active */
+} presence_bank_t;
+
+/*
+ * The RX worker only writes the active bank. To end a window the task
+ * makes the other bank active and then waits out a presence_check() that
+ * may still be inside the old one (s_in_cb), after which the old bank is
+ * its own.
+ */
+static presence_bank_t *s_banks;     /* [2], allocated by the first PRESENCE */
+static _Atomic uint8_t  s_active;
+static _Atomic bool     s_in_cb;
+static TaskHandle_t     s_task;
+static uint32_t         s_window_ms;
+static bool             s_pass;
+static uint32_t         s_window_no;
+
+static _Atomic uint32_t s_probes;
+static _Atomic uint32_t s_overflow;
+
+/* FNV-1a, then the murmur3 finalizer: the sketch needs well-mixed high bits */
+static inline uint32_t mac_hash(const uint8_t *mac)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        h = (h ^ mac[i]) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static void count_station(presence_slot_t *slot, const uint8_t *mac)
+{
+    uint32_t h = mac_hash(mac);
+    uint32_t idx = h >> (32 - PRESENCE_HLL_BITS);
+    uint32_t rest = h << PRESENCE_HLL_BITS;
+    uint8_t rank = rest ? (uint8_t)(__builtin_clz(rest) + 1) : 32 - PRESENCE_HLL_BITS + 1;
+    if (rank > slot->regs[idx]) {
+        slot->regs[idx] = rank;
+    }
+
+    for (uint8_t i = 0; i < slot->exact_count; i++) {
+        if (memcmp(slot->exact[i], mac, 6) == 0) {
+            return;
+        }
+    }
+    if (slot->exact_count < PRESENCE_EXACT_MAX) {
+        memcpy(slot->exact[slot->exact_count++], mac, 6);
+    } else {
+        slot->flags |= PRESENCE_FLAG_EXACT_FULL;
+    }
+}
+
+bool presence_check(const uint8_t *frame, uint16_t len, uint8_t channel)
+{
+    if (len < 16 || frame[0] != IEEE80211_FC0_PROBE_REQ) {
+        return false;
+    }
+    atomic_fetch_add_explicit(&s_probes, 1, memory_order_relaxed);
+
+    atomic_store(&s_in_cb, true);
+    presence_bank_t *bank = &s_banks[atomic_load(&s_active)];
+    presence_slot_t *slot = NULL;
+    for (int i = 0; i < PRESENCE_MAX_CHANNELS; i++) {
+        presence_slot_t *s = &bank->slots[i];
+        if (s->channel == channel || s->channel == 0) {
+            slot = s;
+            break;
+        }
+    }
+    if (slot) {
+        slot->channel = channel;
+        slot->probes++;
+        count_station(slot, frame + 10);   /* addr2: the probing station */
+    } else {
+        atomic_fetch_add_explicit(&s_overflow, 1, memory_order_relaxed);
+    }
+    atomic_store(&s_in_cb, false);
+    return true;
+}
+
+/* Start a window in the other bank; returns the one just closed */
+static presence_bank_t *swap_banks(void)
+{
+    uint8_t old = atomic_load(&s_active);
+    presence_bank_t *next = &s_banks[old ^ 1];
+
+    memset(next->slots, 0, sizeof(next->slots));
+    next->start = sniffer_get_rx_time();
+    atomic_store(&s_active, old ^ 1);
+    while (atomic_load(&s_in_cb)) {
+        vTaskDelay(1);
+    }
+    return &s_banks[old];
+}
+
+static void send_slot(presence_header_t *hdr, const presence_slot_t *slot)
+{
+    size_t exact_len = slot->exact_count * 6;
+
+    hdr->channel     = slot->channel;
+    hdr->exact_count = slot->exact_count;
+    hdr->flags       = slot->flags;
+    hdr->probes      = slot->probes;
+
+    usb_serial_frame_begin(sizeof(*hdr) + PRESENCE_HLL_REGS + exact_len);
+    usb_serial_frame_write((const uint8_t *)hdr, sizeof(*hdr));
+    usb_serial_frame_write(slot->regs, PRESENCE_HLL_REGS);
+    usb_serial_frame_write(&slot->exact[0][0], exact_len);
+    usb_serial_frame_end();
+    hdr->part++;
+}
+
+static void send_window(const presence_bank_t *bank)
+{
+    uint8_t parts = 0;
+    while (parts < PRESENCE_MAX_CHANNELS && bank->slots[parts].channel) {
+        parts++;
+    }
+
+    presence_header_t hdr = {
+        .msg_type     = MSG_TYPE_PRESENCE,
+        .hll_bits     = PRESENCE_HLL_BITS,
+        .parts        = parts ? parts : 1,
+        .window       = s_window_no++,
+        .window_start = bank->start,
+        .window_ms    = (sniffer_get_rx_time() - bank->start) / 1000,
+    };
+    /* Nothing heard: one empty record (slot 0 is all zeros) closes the window */
+    send_slot(&hdr, &bank->slots[0]);
+    for (uint8_t i = 1; i < parts; i++) {
+        send_slot(&hdr, &bank->slots[i]);
+    }
+}
+
+static void presence_task(void *arg)
+{
+    while (true) {
+        uint32_t window = s_window_ms;
+        /* A notification means the window changed: restart without sending */
+        if (ulTaskNotifyTake(pdTRUE, window ? pdMS_TO_TICKS(window) : portMAX_DELAY)) {
+            if (s_banks) {
+                swap_banks();
+            }
+            s_window_no = 0;
+            continue;
+        }
+        send_window(swap_banks());
+    }
+}
+
+esp_err_t presence_init(void)
+{
+    BaseType_t ret = xTaskCreate(presence_task, "presence", PRESENCE_TASK_STACK, NULL,
+                                 PRESENCE_TASK_PRIORITY, &s_task);
+    return (ret == pdPASS) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t presence_set_window(uint32_t ms, bool pass)
+{
+    /* Only allocated once asked for, and then kept: the worker may be
+     * looking at it until the task has swapped */
+    if (ms && !s_banks) {
+        s_banks = heap_caps_calloc(2, sizeof(presence_bank_t), MALLOC_CAP_8BIT);
+        if (!s_banks) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    s_pass = pass;
+    s_window_ms = ms;
+    xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+uint32_t presence_get_window(void)
+{
+    return s_window_ms;
+}
+
+bool presence_get_pass(void)
+{
+    return s_pass;
+}
+
+uint32_t presence_get_probes(void)
+{
+    return atomic_load_explicit(&s_probes, memory_order_relaxed);
+}
+
+uint32_t presence_get_overflow(void)
+{
+    return atomic_load_explicit(&s_overflow, memory_order_relaxed);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PRESENCE_MIN_WINDOW_MS    1000
+#define PRESENCE_MAX_WINDOW_MS    3600000
+#define PRESENCE_MAX_CHANNELS     16     /* Channels tracked per window */
+
+/*
+ * Probe request counting (PRESENCE), run from the RX worker (sniffer.c).
+ *
+ * Each probe request is counted under the channel it was heard on: its
+ * transmitter address goes into a HyperLogLog sketch and, while there is
+ * room, an exact list. Only a MSG_TYPE_PRESENCE record per channel leaves
+ * the device, sent straight to USB by a low-priority task when the window
+ * ends. Two banks alternate, so the worker never waits for the sender.
+ *
+ * With pass off (the default) every other frame is dropped too, and the
+ * summaries are all the device sends.
+ */
+esp_err_t presence_init(void);
+esp_err_t presence_set_window(uint32_t ms, bool pass);   /* 0 = off */
+uint32_t  presence_get_window(void);
+bool      presence_get_pass(void);
+
+/* True if the frame was a probe request, now counted */
+bool      presence_check(const uint8_t *frame, uint16_t len, uint8_t channel);
+
+uint32_t  presence_get_probes(void);     /* Probe requests counted since boot */
+uint32_t  presence_get_overflow(void);   /* ...of which on channels beyond PRESENCE_MAX_CHANNELS */
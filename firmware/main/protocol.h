@@ -6,9 +6,15 @@
 #define MSG_TYPE_PACKET   0x01
 #define MSG_TYPE_RESPONSE 0x02
 #define MSG_TYPE_LOG      0x03
+#define MSG_TYPE_BATCH    0x04
+#define MSG_TYPE_BEACON_SUMMARY 0x05
+#define MSG_TYPE_STATS    0x06
+#define MSG_TYPE_PACKET_V2 0x07
+#define MSG_TYPE_PRESENCE 0x08
 
 /* --- Packet flags (in pkt_header_t.flags) --- */
 #define PKT_FLAG_COMPRESSED  0x01
+#define PKT_FLAG_SYNTHETIC   0x02   /* BENCH frame, not captured */
 
 /* --- SLIP framing (RFC 1055) --- */
 #define SLIP_END     0xC0
@@ -16,13 +22,36 @@
 #define SLIP_ESC_END 0xDC
 #define SLIP_ESC_ESC 0xDD
 
+/* --- Length-prefixed framing (FRAMING LEN) ---
+ * sync0 sync1 | uint16 length | payload | uint32 CRC-32 of length + payload.
+ * Little-endian; the CRC is the standard CRC-32 (same as zlib.crc32). */
+#define LEN_SYNC0      0xA5
+#define LEN_SYNC1      0x5A
+#define LEN_MAX_FRAME  8192
+
 /* --- 802.11 constants --- */
 #define IEEE80211_FCS_LEN    4
 #define MAX_80211_FRAME_LEN  2500
 
+/* Frame Control byte 0 of a beacon (type MGMT, subtype 8) */
+#define IEEE80211_FC0_BEACON  0x80
+/* ...and of a probe request (type MGMT, subtype 4) */
+#define IEEE80211_FC0_PROBE_REQ  0x40
+
+/* Frame Control type field: (fc[0] >> 2) & 3 */
+#define IEEE80211_FTYPE_MGMT  0
+#define IEEE80211_FTYPE_CTRL  1
+#define IEEE80211_FTYPE_DATA  2
+#define IEEE80211_FTYPE_EXT   3
+
 /* --- Buffer sizes --- */
 #define SLIP_BUF_SIZE  5120
 
+/* --- Batching: flush a partial batch on whichever limit is hit first --- */
+#define BATCH_MAX_LEN      4096   /* Max record bytes per batch */
+#define BATCH_MAX_RECORDS  128
+#define BATCH_FLUSH_MS     5      /* Max time a record waits in a partial batch */
+
 /* --- Default snaplen (0 = no truncation) --- */
 #define DEFAULT_SNAPLEN  0
 
@@ -37,3 +66,118 @@ typedef struct __attribute__((packed)) {
 } pkt_header_t;
 
 _Static_assert(sizeof(pkt_header_t) == 10, "pkt_header_t must be 10 bytes");
+
+/* --- Packet metadata header v2 (PKTHDR 2, wire format, little-endian) ---
+ * pkt_header_t plus a transport sequence number, one per packet record that
+ * made it into the capture ring, so the host can count records lost on the
+ * way (USB write timeouts, corrupt or truncated frames). Ring-full drops
+ * happen before a number is taken; STATS counts those. The timestamp is the
+ * v1 one extended to 64 bits across its wraps. */
+typedef struct __attribute__((packed)) {
+    uint8_t  msg_type;    /* MSG_TYPE_PACKET_V2 */
+    uint8_t  channel;
+    int8_t   rssi;
+    uint8_t  flags;
+    uint16_t sig_len;
+    uint32_t seq;         /* +1 per packet record, wraps; restarts at 0 on boot */
+    uint64_t timestamp;
+} pkt_header_v2_t;
+
+_Static_assert(sizeof(pkt_header_v2_t) == 18, "pkt_header_v2_t must be 18 bytes");
+
+/* --- Batch header (wire format, little-endian) ---
+ * Followed by `count` records, each a uint16 length and then that many bytes
+ * of one message as it would be sent on its own (e.g. pkt_header_t + payload).
+ * With PKT_FLAG_COMPRESSED in flags, the records are instead sent as a uint16
+ * raw length followed by one LZ4 block that decompresses to them. */
+typedef struct __attribute__((packed)) {
+    uint8_t  msg_type;    /* MSG_TYPE_BATCH */
+    uint8_t  flags;       /* PKT_FLAG_* bits that apply to the whole batch */
+    uint16_t count;       /* Number of records */
+} batch_header_t;
+
+_Static_assert(sizeof(batch_header_t) == 4, "batch_header_t must be 4 bytes");
+
+/* --- Beacon summary (wire format, little-endian) ---
+ * Sent by BEACONDEDUP in place of the repeats of one BSSID's beacon within a
+ * window. The first beacon of each window is still sent in full. */
+typedef struct __attribute__((packed)) {
+    uint8_t  msg_type;    /* MSG_TYPE_BEACON_SUMMARY */
+    uint8_t  channel;     /* WiFi channel the repeats were heard on */
+    uint8_t  bssid[6];
+    uint16_t count;       /* Repeats suppressed in this window */
+    int8_t   rssi_min;
+    int8_t   rssi_max;
+    int8_t   rssi_avg;
+    uint8_t  reserved;
+    uint32_t timestamp;   /* rx_ctrl timestamp of the last repeat */
+    uint64_t last_tsf;    /* TSF field of the last repeat */
+} beacon_summary_t;
+
+_Static_assert(sizeof(beacon_summary_t) == 26, "beacon_summary_t must be 26 bytes");
+
+/* --- Telemetry record (wire format, little-endian) ---
+ * Sent every STATS interval. "cumulative" fields count since boot and wrap;
+ * the rest cover the interval_ms just ended. */
+#define STATS_VERSION  3    /* 2: shed and flow fields appended, 3: raw ring fields */
+
+typedef struct __attribute__((packed)) {
+    uint8_t  msg_type;        /* MSG_TYPE_STATS */
+    uint8_t  version;         /* STATS_VERSION */
+    uint16_t interval_ms;     /* Time covered by the interval fields */
+    uint32_t uptime_ms;
+    uint32_t captured;        /* cumulative */
+    uint32_t drop_ring_full;  /* cumulative: no room in the capture ring */
+    uint32_t drop_usb;        /* cumulative: records in frames cut short by a USB timeout */
+    uint32_t usb_timeouts;    /* cumulative: USB writes cut short */
+    uint32_t usb_bytes_per_s;
+    uint32_t ring_size;       /* bytes */
+    uint32_t ring_hwm;        /* peak bytes in use */
+    uint32_t ring_used;       /* bytes in use when sent */
+    uint32_t cb_count;        /* RX callbacks */
+    uint32_t cb_cycles_min;
+    uint32_t cb_cycles_avg;
+    uint32_t cb_cycles_max;
+    uint32_t switch_count;    /* channel switches */
+    uint32_t switch_us;       /* time spent in them */
+    uint32_t free_heap;
+    uint32_t shed_truncated;  /* cumulative: data frames cut to the header by SHED */
+    uint32_t shed_dropped;    /* cumulative: data/control frames dropped by SHED */
+    uint32_t flow_waits;      /* cumulative: sender waits for host credit */
+    int32_t  flow_credit;     /* bytes the host still allows (0 with FLOW off) */
+    uint32_t drop_raw_full;   /* cumulative: no room in the raw ring (RX worker behind) */
+    uint32_t filtered;        /* cumulative: discarded by MACFILTER, BEACONDEDUP or PRESENCE */
+    uint32_t raw_size;        /* bytes */
+    uint32_t raw_hwm;         /* peak bytes in use */
+} stats_record_t;
+
+_Static_assert(sizeof(stats_record_t) == 100, "stats_record_t must be 100 bytes");
+
+/* --- Presence summary (PRESENCE, wire format, little-endian) ---
+ * One per channel heard per window, or a single record with channel 0 for a
+ * window without probe requests. Followed by (1 << hll_bits) HyperLogLog
+ * registers and then exact_count transmitter addresses. A register holds
+ * the largest rank seen (leading zeros + 1 of the hash bits after the
+ * register index); registers of the same hll_bits merge by taking the
+ * maximum. The exact list is complete unless PRESENCE_FLAG_EXACT_FULL. */
+#define PRESENCE_HLL_BITS      9
+#define PRESENCE_HLL_REGS      (1 << PRESENCE_HLL_BITS)
+#define PRESENCE_EXACT_MAX     32
+#define PRESENCE_FLAG_EXACT_FULL  0x01   /* More stations than listed */
+
+typedef struct __attribute__((packed)) {
+    uint8_t  msg_type;      /* MSG_TYPE_PRESENCE */
+    uint8_t  channel;
+    uint8_t  hll_bits;      /* log2 of the register count */
+    uint8_t  exact_count;   /* Addresses after the registers */
+    uint8_t  flags;         /* PRESENCE_FLAG_* */
+    uint8_t  part;          /* This record's number within the window, from 0 */
+    uint8_t  parts;         /* Records sent for the window */
+    uint8_t  reserved;
+    uint32_t window;        /* Window number since PRESENCE was set */
+    uint32_t window_start;  /* On the pkt_header_t.timestamp clock */
+    uint32_t window_ms;
+    uint32_t probes;        /* Probe requests counted on this channel */
+} presence_header_t;
+
+_Static_assert(sizeof(presence_header_t) == 24, "presence_header_t must be 24 bytes");
@@ -0,0 +1,115 @@
+#include "ring.h"
+
+#include "esp_attr.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RING_WRAP  0xFFFF   /* Length sentinel: rest of buffer unused, continue at 0 */
+
+static inline void put_len(uint8_t *p, uint16_t len)
+{
+    memcpy(p, &len, sizeof(len));
+}
+
+static inline uint16_t get_len(const uint8_t *p)
+{
+    uint16_t len;
+    memcpy(&len, p, sizeof(len));
+    return len;
+}
+
+esp_err_t ring_init(ring_t *r, uint32_t size)
+{
+    r->buf = malloc(size);
+    if (!r->buf) {
+        return ESP_ERR_NO_MEM;
+    }
+    r->size = size;
+    r->write_next = 0;
+    r->read_pos = 0;
+    r->read_next = 0;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    return ESP_OK;
+}
+
+/* Reserve room for a record body of len bytes. Returns NULL if the ring is full.
+ * head never catches up to tail, so head == tail always means empty. */
+uint8_t * IRAM_ATTR ring_reserve(ring_t *r, uint16_t len)
+{
+    uint32_t need = RING_HDR_LEN + len;
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    uint32_t at;
+
+    if (head >= tail) {
+        uint32_t room = r->size - head;
+        if (room > need || (room == need && tail != 0)) {
+            at = head;
+        } else if (tail > need) {
+            if (room >= RING_HDR_LEN) {
+                put_len(r->buf + head, RING_WRAP);
+            }
+            at = 0;
+        } else {
+            return NULL;
+        }
+    } else if (tail - head > need) {
+        at = head;
+    } else {
+        return NULL;
+    }
+
+    put_len(r->buf + at, len);
+    r->write_next = (at + need == r->size) ? 0 : at + need;
+    return r->buf + at + RING_HDR_LEN;
+}
+
+/* Publish the record returned by the last ring_reserve() */
+void IRAM_ATTR ring_commit(ring_t *r)
+{
+    atomic_store_explicit(&r->head, r->write_next, memory_order_release);
+}
+
+/* Return the next committed record after those already skipped, without
+ * consuming it, or NULL if there is none */
+uint8_t *ring_peek(ring_t *r, uint16_t *len)
+{
+    uint32_t pos = r->read_pos;
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    if (pos == head) {
+        return NULL;
+    }
+    if (r->size - pos < RING_HDR_LEN || get_len(r->buf + pos) == RING_WRAP) {
+        pos = 0;
+        r->read_pos = 0;
+    }
+
+    uint16_t l = get_len(r->buf + pos);
+    uint32_t next = pos + RING_HDR_LEN + l;
+    r->read_next = (next == r->size) ? 0 : next;
+    *len = l;
+    return r->buf + pos + RING_HDR_LEN;
+}
+
+/* Step past the record returned by the last ring_peek(); it stays valid until
+ * ring_release() */
+void ring_skip(ring_t *r)
+{
+    r->read_pos = r->read_next;
+}
+
+/* Hand every skipped record back to the producer */
+void ring_release(ring_t *r)
+{
+    atomic_store_explicit(&r->tail, r->read_pos, memory_order_release);
+}
+
+uint32_t IRAM_ATTR ring_used(ring_t *r)
+{
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    return (head >= tail) ? head - tail : r->size - tail + head;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* Length prefix stored in front of every ring record (little-endian uint16,
+ * same as a batch record on the wire) */
+#define RING_HDR_LEN  sizeof(uint16_t)
+
+/*
+ * Single-producer/single-consumer byte ring of variable-length records.
+ *
+ * Each record is stored contiguously as a 16-bit length followed by its body,
+ * with no padding between records, so the producer can copy straight into
+ * place and the consumer can read a run of records in place. A record that does not fit before the end of the buffer is
+ * placed at offset 0 and the gap is marked with a wrap sentinel.
+ *
+ * The consumer can walk several records (peek, skip, peek, skip, ...) and then
+ * release them all at once, so a batch can be built from records in place.
+ *
+ * The producer owns head/write_next, the consumer owns tail/read_pos/read_next.
+ * No locks and no heap calls after ring_init().
+ */
+typedef struct {
+    uint8_t          *buf;
+    uint32_t          size;
+    _Atomic uint32_t  head;        /* end of last committed record */
+    _Atomic uint32_t  tail;        /* start of oldest unreleased record */
+    uint32_t          write_next;  /* producer: head after pending commit */
+    uint32_t          read_pos;    /* consumer: first record not yet skipped */
+    uint32_t          read_next;   /* consumer: read_pos after skipping the peeked record */
+} ring_t;
+
+esp_err_t ring_init(ring_t *r, uint32_t size);
+
+/* Producer side */
+uint8_t  *ring_reserve(ring_t *r, uint16_t len);
+void      ring_commit(ring_t *r);
+
+/* Consumer side */
+uint8_t  *ring_peek(ring_t *r, uint16_t *len);
+void      ring_skip(ring_t *r);
+void      ring_release(ring_t *r);
+
+uint32_t  ring_used(ring_t *r);
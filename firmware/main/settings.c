@@ -0,0 +1,101 @@
+#include "settings.h"
+
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#define SETTINGS_NAMESPACE  "5dra"
+
+static settings_t s_settings = {
+    .txbuf     = SETTINGS_TXBUF_DEFAULT,
+    .send_prio = SETTINGS_SEND_PRIO_DEFAULT,
+};
+
+esp_err_t settings_init(void)
+{
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ret = nvs_flash_erase();
+        if (ret == ESP_OK) {
+            ret = nvs_flash_init();
+        }
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    nvs_handle_t nvs;
+    if (nvs_open(SETTINGS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return ESP_OK;      /* Nothing stored yet */
+    }
+    uint32_t txbuf;
+    if (nvs_get_u32(nvs, "txbuf", &txbuf) == ESP_OK &&
+        txbuf >= SETTINGS_TXBUF_MIN && txbuf <= SETTINGS_TXBUF_MAX) {
+        s_settings.txbuf = txbuf;
+    }
+    uint8_t prio;
+    if (nvs_get_u8(nvs, "sendprio", &prio) == ESP_OK &&
+        prio >= SETTINGS_SEND_PRIO_MIN && prio <= SETTINGS_SEND_PRIO_MAX) {
+        s_settings.send_prio = prio;
+    }
+    nvs_close(nvs);
+    return ESP_OK;
+}
+
+const settings_t *settings_get(void)
+{
+    return &s_settings;
+}
+
+static esp_err_t store_u32(const char *key, uint32_t value)
+{
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(SETTINGS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_set_u32(nvs, key, value);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return ret;
+}
+
+static esp_err_t store_u8(const char *key, uint8_t value)
+{
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(SETTINGS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_set_u8(nvs, key, value);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return ret;
+}
+
+esp_err_t settings_set_txbuf(uint32_t bytes)
+{
+    if (bytes < SETTINGS_TXBUF_MIN || bytes > SETTINGS_TXBUF_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = store_u32("txbuf", bytes);
+    if (ret == ESP_OK) {
+        s_settings.txbuf = bytes;
+    }
+    return ret;
+}
+
+esp_err_t settings_set_send_prio(uint8_t prio)
+{
+    if (prio < SETTINGS_SEND_PRIO_MIN || prio > SETTINGS_SEND_PRIO_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = store_u8("sendprio", prio);
+    if (ret == ESP_OK) {
+        s_settings.send_prio = prio;
+    }
+    return ret;
+}
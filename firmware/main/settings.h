@@ -0,0 +1,31 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+
+#define SETTINGS_TXBUF_DEFAULT      16384
+#define SETTINGS_TXBUF_MIN          4096
+#define SETTINGS_TXBUF_MAX          65536
+#define SETTINGS_SEND_PRIO_DEFAULT  5
+#define SETTINGS_SEND_PRIO_MIN      1
+#define SETTINGS_SEND_PRIO_MAX      20    /* Stay below the WiFi task */
+
+/*
+ * Throughput settings kept in NVS (namespace "5dra"), so a tuned device keeps
+ * them across power cycles. This is the application's own namespace: it does
+ * not need CONFIG_ESP_WIFI_NVS_ENABLED, which only covers the WiFi driver's
+ * calibration and config data.
+ */
+typedef struct {
+    uint32_t txbuf;       /* USB Serial/JTAG driver TX buffer, bytes; applied at boot */
+    uint8_t  send_prio;   /* Sender task priority */
+} settings_t;
+
+/* Initialize NVS (also needed by the WiFi driver) and load the settings;
+ * missing or out-of-range values fall back to the defaults */
+esp_err_t         settings_init(void);
+const settings_t *settings_get(void);
+
+/* Store a new value; the caller applies it */
+esp_err_t settings_set_txbuf(uint32_t bytes);
+esp_err_t settings_set_send_prio(uint8_t prio);
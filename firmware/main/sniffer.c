@@ -1,45 +1,222 @@
 #include "sniffer.h"
 #include "protocol.h"
 #include "usb_serial.h"
+#include "ring.h"
+#include "macfilter.h"
+#include "beacondedup.h"
+#include "presence.h"
+#include "compress.h"
+#include "flow.h"
 
 #include "esp_wifi.h"
 #include "esp_wifi_types.h"
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "esp_system.h"
-#include "nvs_flash.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "esp_mac.h"
+#include "esp_cpu.h"
 
+#include <stdatomic.h>
 #include <string.h>
 #include <stdlib.h>
 
 #define SENDER_TASK_STACK     4096
-#define SENDER_TASK_PRIORITY  5
+#define RX_TASK_STACK         4096
+#define RAW_RING_SIZE         (32 * 1024)
+#define RAW_COPY_MIN          36      /* Longest MAC header (mac_header_len) */
+#define INJECT_WAIT_MS        100     /* Longest a BENCH frame waits for room in the capture ring */
 #define HEAP_RESERVE          40960   /* 40KB headroom for stacks, buffers, etc. */
 #define MIN_QUEUE_DEPTH       32
 #define MAX_QUEUE_DEPTH       2048
 #define AVG_PAYLOAD_ESTIMATE  256     /* For queue sizing when snaplen=0 */
+#define HDR_PAYLOAD_ESTIMATE  28      /* For queue sizing when snaplen=HDR */
 
+/* Overload shedding, by ring fill: data frames header-only, then data frames
+ * dropped, then control frames dropped. Management frames are only lost when
+ * the ring is actually full. */
+enum { SHED_DATA_HDR, SHED_DATA_DROP, SHED_CTRL_DROP, SHED_LEVELS };
+static const uint8_t SHED_PERCENT[SHED_LEVELS] = { 50, 75, 90 };
+
+/* Ring bytes used by one captured frame: length prefix + wire header + payload */
+#define RING_RECORD_LEN(payload)  (RING_HDR_LEN + sizeof(pkt_header_t) + (payload))
+
+/* A frame as the RX callback (or BENCH) leaves it in the raw ring, followed
+ * by the copied bytes; everything else is decided by the RX worker */
 typedef struct {
-    uint8_t  *payload;
-    uint16_t  length;
-    uint8_t   channel;
-    int8_t    rssi;
-    uint32_t  timestamp_us;
-} queued_packet_t;
-
-static QueueHandle_t s_packet_queue;
-static uint8_t   s_current_channel;
-static uint32_t  s_captured;
-static uint32_t  s_dropped;
-static uint32_t  s_queue_depth;
-static uint16_t  s_snaplen;          /* 0 = no truncation */
-
-/* ---- Promiscuous callback (runs in WiFi task context) ---- */
-static void IRAM_ATTR wifi_sniffer_cb(void *recv_buf, wifi_promiscuous_pkt_type_t type)
+    uint32_t timestamp;   /* rx_ctrl.timestamp */
+    uint8_t  channel;     /* Received on */
+    int8_t   rssi;
+    uint8_t  flags;       /* PKT_FLAG_* bits for the wire header, plus RAW_FLAG_* */
+    uint8_t  reserved;
+} raw_header_t;
+
+#define RAW_FLAG_WAIT  0x80   /* Wait for room in the capture ring instead of dropping */
+
+static ring_t        s_raw;              /* RX callback -> RX worker */
+static ring_t        s_ring;             /* RX worker (or BENCH) -> sender */
+static TaskHandle_t  s_rx_task;
+static TaskHandle_t  s_sender_task;
+static uint16_t      s_raw_copy[4];      /* Per IEEE80211_FTYPE_*: bytes worth copying */
+static uint16_t      s_rx_budget = RX_BUDGET_DEFAULT;
+static _Atomic uint32_t s_raw_hwm;       /* Peak raw ring bytes in use since last taken */
+static _Atomic uint32_t s_filtered;
+static uint8_t       s_current_channel;
+static _Atomic uint32_t s_captured;
+static _Atomic uint32_t s_drops[DROP_CAUSES];
+static _Atomic uint32_t s_ring_hwm;      /* Peak ring bytes in use since last taken */
+static bool          s_shed = true;      /* Shed data, then control frames as the ring fills */
+static uint32_t      s_shed_at[SHED_LEVELS];        /* Ring bytes in use where each level starts */
+static _Atomic uint32_t s_shed_truncated;
+static _Atomic uint32_t s_shed_dropped;
+static uint16_t      s_snaplen[4];       /* Per IEEE80211_FTYPE_*: 0 = no truncation */
+static bool          s_pkt_v2;           /* PKTHDR 2: pkt_header_v2_t records */
+static uint32_t      s_pkt_seq;          /* Next v2 sequence number */
+static uint32_t      s_ts_last;          /* Last packet timestamp, and how often */
+static uint32_t      s_ts_wraps;         /* it wrapped, for the v2 64-bit timestamp */
+static bool          s_batch;            /* Pack records into MSG_TYPE_BATCH frames (BATCH ON) */
+static bool          s_compress;         /* LZ4-compress batch bodies */
+static uint32_t      s_compress_in;      /* Batch bytes offered to the compressor */
+static uint32_t      s_compress_out;     /* ...and bytes actually sent for them */
+static SemaphoreHandle_t s_chan_lock;    /* Serializes channel and band mode changes */
+static bool          s_capture_paused;   /* BENCH: promiscuous mode stays off, under s_chan_lock */
+static _Atomic bool  s_inject_wait;      /* BENCH frames with RAW_FLAG_WAIT may still wait */
+static bool          s_band_auto;        /* WIFI_BAND_MODE_AUTO: switch bands without a promiscuous cycle */
+static uint64_t      s_switch_us[SWITCH_KINDS];     /* Total time spent in sniffer_set_channel */
+static uint32_t      s_switch_count[SWITCH_KINDS];
+static _Atomic uint32_t s_switch_total_us;          /* All kinds; wraps, for deltas */
+static _Atomic uint32_t s_switch_total;
+
+/* RX callback cost, written by the WiFi task and taken by sniffer_take_cb_stats */
+static _Atomic uint32_t s_cb_count;
+static _Atomic uint32_t s_cb_cycles;
+static _Atomic uint32_t s_cb_min = UINT32_MAX;
+static _Atomic uint32_t s_cb_max;
+
+/* Latest rx_ctrl.timestamp paired with esp_timer, for sniffer_get_rx_time.
+ * The WiFi task fills the idle slot and then bumps the generation, whose low
+ * bit names the current slot, so readers need no lock. */
+typedef struct {
+    uint32_t rx_ts;
+    uint32_t timer_us;
+} rx_clock_t;
+
+static rx_clock_t       s_rx_clock[2];
+static _Atomic uint32_t s_rx_clock_gen;
+
+/* ---- 802.11 MAC header length from Frame Control ---- */
+static uint16_t mac_header_len(const uint8_t *frame)
+{
+    uint8_t ftype   = (frame[0] >> 2) & 0x03;
+    uint8_t subtype = (frame[0] >> 4) & 0x0F;
+    bool    order   = frame[1] & 0x80;
+
+    switch (ftype) {
+    case IEEE80211_FTYPE_CTRL:
+        /* CTS and ACK carry only addr1 */
+        return (subtype == 12 || subtype == 13) ? 10 : 16;
+    case IEEE80211_FTYPE_DATA: {
+        uint16_t len = 24;
+        bool qos = subtype & 0x08;
+        if ((frame[1] & 0x03) == 0x03) {
+            len += 6;   /* addr4 (ToDS and FromDS) */
+        }
+        if (qos) {
+            len += 2;   /* QoS Control */
+        }
+        if (qos && order) {
+            len += 4;   /* HT Control */
+        }
+        return len;
+    }
+    default:
+        return order ? 28 : 24;
+    }
+}
+
+static inline void IRAM_ATTR count_drop(sniffer_drop_t cause, uint32_t n)
+{
+    atomic_fetch_add_explicit(&s_drops[cause], n, memory_order_relaxed);
+}
+
+static inline void count_filtered(void)
+{
+    atomic_fetch_add_explicit(&s_filtered, 1, memory_order_relaxed);
+}
+
+/* Only the producer raises a mark; a reset racing with it loses one sample */
+static inline void IRAM_ATTR raise_hwm(_Atomic uint32_t *hwm, ring_t *r)
+{
+    uint32_t used = ring_used(r);
+    if (used > atomic_load_explicit(hwm, memory_order_relaxed)) {
+        atomic_store_explicit(hwm, used, memory_order_relaxed);
+    }
+}
+
+/* ---- Packet record wire header, v1 or v2 ----
+ * Sequence and wrap state belong to the capture ring's only producer, the
+ * RX worker. */
+static inline size_t pkt_header_len(bool v2)
+{
+    return v2 ? sizeof(pkt_header_v2_t) : sizeof(pkt_header_t);
+}
+
+static inline void put_pkt_header(uint8_t *slot, bool v2, uint8_t channel, int8_t rssi,
+                                  uint8_t flags, uint16_t len, uint32_t ts)
+{
+    /* Going back more than half the range is a wrap, not reordering */
+    if (ts < s_ts_last && s_ts_last - ts > 0x80000000u) {
+        s_ts_wraps++;
+    }
+    s_ts_last = ts;
+    uint32_t seq = s_pkt_seq++;
+
+    if (v2) {
+        pkt_header_v2_t hdr = {
+            .msg_type  = MSG_TYPE_PACKET_V2,
+            .channel   = channel,
+            .rssi      = rssi,
+            .flags     = flags,
+            .sig_len   = len,
+            .seq       = seq,
+            .timestamp = (uint64_t)s_ts_wraps << 32 | ts,
+        };
+        memcpy(slot, &hdr, sizeof(hdr));
+    } else {
+        pkt_header_t hdr = {
+            .msg_type  = MSG_TYPE_PACKET,
+            .channel   = channel,
+            .rssi      = rssi,
+            .flags     = flags,
+            .sig_len   = len,
+            .timestamp = ts,
+        };
+        memcpy(slot, &hdr, sizeof(hdr));
+    }
+}
+
+/* ---- Queue a device-generated record (e.g. a beacon summary) ---- */
+static bool push_record(const void *rec, uint16_t len)
+{
+    uint8_t *slot = ring_reserve(&s_ring, len);
+    if (!slot) {
+        count_drop(DROP_RING_FULL, 1);
+        return false;
+    }
+    memcpy(slot, rec, len);
+    ring_commit(&s_ring);
+    return true;
+}
+
+/* ---- Promiscuous callback body (runs in WiFi task context) ----
+ * Inside the WiFi driver's task, so it only copies the frame into the raw
+ * ring; filtering and framing are the RX worker's. The copy stops where
+ * nothing of the frame would be sent anyway. */
+static inline void IRAM_ATTR sniffer_rx(void *recv_buf, wifi_promiscuous_pkt_type_t type)
 {
     if (type == WIFI_PKT_MISC) {
         return;
@@ -51,74 +228,352 @@ static void IRAM_ATTR wifi_sniffer_cb(void *recv_buf, wifi_promiscuous_pkt_type_
         return;
     }
 
+    uint32_t gen = atomic_load_explicit(&s_rx_clock_gen, memory_order_relaxed) + 1;
+    s_rx_clock[gen & 1].rx_ts    = pkt->rx_ctrl.timestamp;
+    s_rx_clock[gen & 1].timer_us = (uint32_t)esp_timer_get_time();
+    atomic_store_explicit(&s_rx_clock_gen, gen, memory_order_release);
+
     uint16_t sig_len = pkt->rx_ctrl.sig_len;
     if (sig_len <= IEEE80211_FCS_LEN) {
         return;
     }
     sig_len -= IEEE80211_FCS_LEN;
 
-    if (sig_len > MAX_80211_FRAME_LEN) {
-        sig_len = MAX_80211_FRAME_LEN;
+    uint8_t ftype = (pkt->payload[0] >> 2) & 0x03;
+    uint16_t copy_len = s_raw_copy[ftype];
+    if (copy_len > sig_len) {
+        copy_len = sig_len;
     }
 
-    /* Apply snaplen truncation before malloc — saves RAM and bandwidth */
-    uint16_t copy_len = sig_len;
-    if (s_snaplen > 0 && copy_len > s_snaplen) {
-        copy_len = s_snaplen;
+    uint8_t *slot = ring_reserve(&s_raw, sizeof(raw_header_t) + copy_len);
+    if (!slot) {
+        count_drop(DROP_RAW_FULL, 1);
+        return;
     }
 
-    uint8_t *copy = malloc(copy_len);
-    if (!copy) {
-        s_dropped++;
-        return;
+    /* Tag with the channel the frame was received on: while hopping,
+     * s_current_channel may already name the next channel */
+    raw_header_t raw = {
+        .timestamp = pkt->rx_ctrl.timestamp,
+        .channel   = pkt->rx_ctrl.channel ? pkt->rx_ctrl.channel : s_current_channel,
+        .rssi      = pkt->rx_ctrl.rssi,
+    };
+    memcpy(slot, &raw, sizeof(raw));
+    memcpy(slot + sizeof(raw), pkt->payload, copy_len);
+    ring_commit(&s_raw);
+    raise_hwm(&s_raw_hwm, &s_raw);
+
+    xTaskNotifyGive(s_rx_task);
+}
+
+static void IRAM_ATTR wifi_sniffer_cb(void *recv_buf, wifi_promiscuous_pkt_type_t type)
+{
+    uint32_t start = esp_cpu_get_cycle_count();
+
+    sniffer_rx(recv_buf, type);
+
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+    atomic_fetch_add_explicit(&s_cb_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_cb_cycles, cycles, memory_order_relaxed);
+    if (cycles < atomic_load_explicit(&s_cb_min, memory_order_relaxed)) {
+        atomic_store_explicit(&s_cb_min, cycles, memory_order_relaxed);
+    }
+    if (cycles > atomic_load_explicit(&s_cb_max, memory_order_relaxed)) {
+        atomic_store_explicit(&s_cb_max, cycles, memory_order_relaxed);
+    }
+}
+
+/* ---- RX worker: policy and framing for one raw ring record ----
+ * Returns true if it queued anything for the sender. */
+static bool rx_process(const uint8_t *rec, uint16_t len)
+{
+    raw_header_t raw;
+    memcpy(&raw, rec, sizeof(raw));
+    const uint8_t *frame = rec + sizeof(raw);
+    uint16_t frame_len = len - sizeof(raw);
+    bool queued = false;
+
+    /* Allowlist check first, so rejected frames cost a few lookups and no copy */
+    if (!macfilter_match(frame, frame_len)) {
+        count_filtered();
+        return false;
+    }
+
+    /* Presence counting: probe requests only feed the per-channel sketches,
+     * and without PASS nothing else is sent either */
+    if (presence_get_window() > 0 &&
+        (presence_check(frame, frame_len, raw.channel) || !presence_get_pass())) {
+        count_filtered();
+        return false;
+    }
+
+    /* Beacon dedup: repeats within the window become one summary record */
+    if (beacondedup_get_window() > 0) {
+        beacon_summary_t summary;
+        bool have_summary;
+        if (beacondedup_sweep(raw.timestamp, &summary)) {
+            queued |= push_record(&summary, sizeof(summary));
+        }
+        bool repeat = beacondedup_check(frame, frame_len, raw.channel, raw.rssi, raw.timestamp,
+                                        &summary, &have_summary);
+        if (have_summary) {
+            queued |= push_record(&summary, sizeof(summary));
+        }
+        if (repeat) {
+            count_filtered();
+            return queued;
+        }
     }
-    memcpy(copy, pkt->payload, copy_len);
 
-    queued_packet_t item = {
-        .payload      = copy,
-        .length       = copy_len,
-        .channel      = s_current_channel,
-        .rssi         = pkt->rx_ctrl.rssi,
-        .timestamp_us = pkt->rx_ctrl.timestamp,
+    /* Apply per-type snaplen before copying — saves ring space and bandwidth */
+    uint8_t ftype = (frame[0] >> 2) & 0x03;
+    uint16_t copy_len = frame_len;
+    uint16_t snaplen = s_snaplen[ftype];
+
+    if (s_shed && ftype != IEEE80211_FTYPE_MGMT) {
+        uint32_t used = ring_used(&s_ring);
+        if ((ftype == IEEE80211_FTYPE_DATA && used >= s_shed_at[SHED_DATA_DROP]) ||
+            used >= s_shed_at[SHED_CTRL_DROP]) {
+            atomic_fetch_add_explicit(&s_shed_dropped, 1, memory_order_relaxed);
+            return queued;
+        }
+        if (ftype == IEEE80211_FTYPE_DATA && used >= s_shed_at[SHED_DATA_HDR]) {
+            snaplen = SNAPLEN_HDR;
+            atomic_fetch_add_explicit(&s_shed_truncated, 1, memory_order_relaxed);
+        }
+    }
+    if (snaplen == SNAPLEN_HDR && frame_len >= 2) {
+        snaplen = mac_header_len(frame);
+    }
+    if (snaplen > 0 && copy_len > snaplen) {
+        copy_len = snaplen;
+    }
+
+    /* Build the wire header in place so the sender can ship the record as-is */
+    bool v2 = s_pkt_v2;
+    size_t hdr_len = pkt_header_len(v2);
+    uint8_t *slot = ring_reserve(&s_ring, hdr_len + copy_len);
+    if (!slot && (raw.flags & RAW_FLAG_WAIT)) {
+        /* A sender out of FLOW credit may never drain the ring: give up after
+         * INJECT_WAIT_MS, and drop the rest of the run's frames at once */
+        TickType_t start = xTaskGetTickCount();
+        while (!slot && atomic_load(&s_inject_wait)) {
+            if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(INJECT_WAIT_MS)) {
+                atomic_store(&s_inject_wait, false);
+                break;
+            }
+            xTaskNotifyGive(s_sender_task);
+            vTaskDelay(1);
+            slot = ring_reserve(&s_ring, hdr_len + copy_len);
+        }
+    }
+    if (!slot) {
+        count_drop(DROP_RING_FULL, 1);
+        return queued;
+    }
+
+    put_pkt_header(slot, v2, raw.channel, raw.rssi, raw.flags & ~RAW_FLAG_WAIT, copy_len,
+                   raw.timestamp);
+    memcpy(slot + hdr_len, frame, copy_len);
+    ring_commit(&s_ring);
+    atomic_fetch_add_explicit(&s_captured, 1, memory_order_relaxed);
+    raise_hwm(&s_ring_hwm, &s_ring);
+    return true;
+}
+
+/* ---- RX worker task: drain the raw ring into the capture ring ----
+ * Runs at the sender's priority. After s_rx_budget frames it yields, so
+ * a burst cannot keep the sender from draining the capture ring. */
+static void rx_task(void *arg)
+{
+    while (true) {
+        uint16_t budget = s_rx_budget;
+        uint16_t done = 0;
+        bool queued = false;
+        uint16_t len;
+        uint8_t *rec;
+
+        while (done < budget && (rec = ring_peek(&s_raw, &len)) != NULL) {
+            queued |= rx_process(rec, len);
+            ring_skip(&s_raw);
+            ring_release(&s_raw);
+            done++;
+        }
+        if (queued) {
+            xTaskNotifyGive(s_sender_task);
+        }
+        if (done == budget) {
+            taskYIELD();
+            continue;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+/* ---- Batch assembly: records stay in the ring until the batch is sent ----
+ * A ring record is a uint16 length followed by its body, which is exactly the
+ * batch record layout, so a batch body is just a few runs of consecutive ring
+ * records (more than one only where the ring wrapped). The runs are handed to
+ * the USB layer in place: captured bytes are copied once, into the ring.
+ * Compression needs contiguous input, so compressed batches stop at a wrap. */
+#define BATCH_MAX_SPANS  4
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t       len;
+} batch_span_t;
+
+typedef struct {
+    batch_span_t spans[BATCH_MAX_SPANS];
+    uint8_t      nspans;
+    uint16_t     count;
+    uint32_t     len;
+    TickType_t   opened;
+} batch_t;
+
+/* Append the record just peeked from the ring; false if the batch is full */
+static bool batch_add(batch_t *b, const uint8_t *rec, uint16_t len)
+{
+    const uint8_t *start = rec - RING_HDR_LEN;
+    uint32_t stride = RING_HDR_LEN + len;
+    batch_span_t *last = b->nspans ? &b->spans[b->nspans - 1] : NULL;
+    bool contiguous = last && last->data + last->len == start;
+    uint8_t max_spans = s_compress ? 1 : BATCH_MAX_SPANS;
+
+    if (b->count >= BATCH_MAX_RECORDS || b->len + stride > BATCH_MAX_LEN ||
+        (!contiguous && b->nspans >= max_spans)) {
+        return false;
+    }
+
+    if (b->count == 0) {
+        b->opened = xTaskGetTickCount();
+    }
+    if (contiguous) {
+        last->len += stride;
+    } else {
+        b->spans[b->nspans].data = start;
+        b->spans[b->nspans].len = stride;
+        b->nspans++;
+    }
+    b->count++;
+    b->len += stride;
+    return true;
+}
+
+/* Compress a single-span batch into out; returns 0 if it does not shrink */
+static size_t batch_compress(const batch_t *b, uint8_t *out)
+{
+    if (b->nspans != 1) {
+        return 0;
+    }
+    /* Must beat the raw body including the uint16 raw length it adds */
+    return compress_block(b->spans[0].data, b->len, out, b->len - sizeof(uint16_t) - 1);
+}
+
+static void batch_send(batch_t *b)
+{
+    static uint8_t packed[BATCH_MAX_LEN];
+
+    batch_header_t bhdr = {
+        .msg_type = MSG_TYPE_BATCH,
+        .flags    = 0,
+        .count    = b->count,
     };
 
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    if (xQueueSendFromISR(s_packet_queue, &item, &xHigherPriorityTaskWoken) != pdTRUE) {
-        free(copy);
-        s_dropped++;
+    size_t packed_len = s_compress ? batch_compress(b, packed) : 0;
+    bool sent;
+    if (packed_len > 0) {
+        uint16_t raw_len = b->len;
+        bhdr.flags |= PKT_FLAG_COMPRESSED;
+        usb_serial_frame_begin(sizeof(bhdr) + sizeof(raw_len) + packed_len);
+        usb_serial_frame_write((const uint8_t *)&bhdr, sizeof(bhdr));
+        usb_serial_frame_write((const uint8_t *)&raw_len, sizeof(raw_len));
+        usb_serial_frame_write(packed, packed_len);
+        sent = usb_serial_frame_end();
     } else {
-        s_captured++;
+        usb_serial_frame_begin(sizeof(bhdr) + b->len);
+        usb_serial_frame_write((const uint8_t *)&bhdr, sizeof(bhdr));
+        for (uint8_t i = 0; i < b->nspans; i++) {
+            usb_serial_frame_write(b->spans[i].data, b->spans[i].len);
+        }
+        sent = usb_serial_frame_end();
+    }
+    if (!sent) {
+        count_drop(DROP_USB_TIMEOUT, b->count);
     }
 
-    if (xHigherPriorityTaskWoken) {
-        portYIELD_FROM_ISR();
+    if (s_compress) {
+        s_compress_in += b->len;
+        s_compress_out += packed_len > 0 ? sizeof(uint16_t) + packed_len : b->len;
     }
+
+    b->nspans = 0;
+    b->count = 0;
+    b->len = 0;
 }
 
-/* ---- Sender task: dequeue packets and SLIP-send ---- */
+/* ---- Sender task: drain ring records, batch and send ---- */
 static void sender_task(void *arg)
 {
-    static uint8_t frame_buf[sizeof(pkt_header_t) + MAX_80211_FRAME_LEN];
+    static batch_t batch;
 
-    queued_packet_t item;
     while (true) {
-        if (xQueueReceive(s_packet_queue, &item, portMAX_DELAY) == pdTRUE) {
-            pkt_header_t hdr = {
-                .msg_type  = MSG_TYPE_PACKET,
-                .channel   = item.channel,
-                .rssi      = item.rssi,
-                .flags     = 0,
-                .sig_len   = item.length,
-                .timestamp = item.timestamp_us,
-            };
-
-            memcpy(frame_buf, &hdr, sizeof(hdr));
-            memcpy(frame_buf + sizeof(hdr), item.payload, item.length);
-
-            usb_serial_send_slip_frame(frame_buf, sizeof(hdr) + item.length);
-            free(item.payload);
+        /* Out of host credit: leave records in the ring rather than block in
+         * a USB write; the RX worker sheds if it fills */
+        if (!flow_ready()) {
+            flow_wait(pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        uint16_t len;
+        uint8_t *rec = ring_peek(&s_ring, &len);
+
+        if (rec && !s_batch && batch.count == 0) {
+            if (!usb_serial_send_frame(rec, len)) {
+                count_drop(DROP_USB_TIMEOUT, 1);
+            }
+            ring_skip(&s_ring);
+            ring_release(&s_ring);
+            continue;
+        }
+
+        if (rec && batch_add(&batch, rec, len)) {
+            ring_skip(&s_ring);
+            continue;
+        }
+
+        /* Flush when full, or when the oldest record has waited long enough */
+        TickType_t waited = xTaskGetTickCount() - batch.opened;
+        if (batch.count > 0 && (rec || waited >= pdMS_TO_TICKS(BATCH_FLUSH_MS))) {
+            batch_send(&batch);
+            ring_release(&s_ring);
+            continue;
+        }
+
+        ulTaskNotifyTake(pdTRUE, batch.count > 0 ? pdMS_TO_TICKS(BATCH_FLUSH_MS) - waited
+                                                 : portMAX_DELAY);
+    }
+}
+
+/* ---- Expected ring bytes per frame under the current snaplens ---- */
+static uint32_t payload_estimate(void)
+{
+    static const uint8_t types[] = {
+        IEEE80211_FTYPE_MGMT, IEEE80211_FTYPE_DATA, IEEE80211_FTYPE_CTRL,
+    };
+    uint32_t total = 0;
+
+    for (size_t i = 0; i < sizeof(types); i++) {
+        uint16_t snaplen = s_snaplen[types[i]];
+        if (snaplen == SNAPLEN_HDR) {
+            total += HDR_PAYLOAD_ESTIMATE;
+        } else if (snaplen > 0) {
+            total += snaplen;
+        } else {
+            total += AVG_PAYLOAD_ESTIMATE;
         }
     }
+    return total / sizeof(types);
 }
 
 /* ---- Calculate optimal queue depth based on free heap ---- */
@@ -127,10 +582,16 @@ static uint32_t calculate_queue_depth(void)
     uint32_t free_heap = esp_get_free_heap_size();
     uint32_t available = (free_heap > HEAP_RESERVE) ? (free_heap - HEAP_RESERVE) : 0;
 
-    /* Each queued packet costs: queue slot (sizeof struct) + heap-allocated payload.
-     * Use snaplen if set, otherwise conservative average estimate. */
-    uint32_t payload_est = (s_snaplen > 0) ? s_snaplen : AVG_PAYLOAD_ESTIMATE;
-    uint32_t per_packet = sizeof(queued_packet_t) + payload_est;
+    /* The ring is one allocation, so it is bounded by the largest free block,
+     * not just by total free heap */
+    uint32_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    if (available > largest) {
+        available = largest;
+    }
+
+    /* Each queued packet costs one ring record.
+     * Use the per-type snaplens if set, otherwise conservative average estimate. */
+    uint32_t per_packet = RING_RECORD_LEN(payload_estimate());
 
     uint32_t depth = available / per_packet;
     if (depth < MIN_QUEUE_DEPTH) depth = MIN_QUEUE_DEPTH;
@@ -138,19 +599,37 @@ static uint32_t calculate_queue_depth(void)
     return depth;
 }
 
+/* Bytes of each frame type the RX callback copies: the snaplen, but never
+ * less than the longest MAC header, which MACFILTER, PRESENCE and SHED read.
+ * Beacon dedup compares whole beacons, so with it on management frames are
+ * copied whole. */
+static void update_raw_copy(void)
+{
+    for (size_t i = 0; i < sizeof(s_snaplen) / sizeof(s_snaplen[0]); i++) {
+        uint16_t snaplen = s_snaplen[i];
+        if (snaplen == 0 || (snaplen != SNAPLEN_HDR && snaplen > MAX_80211_FRAME_LEN) ||
+            (i == IEEE80211_FTYPE_MGMT && beacondedup_get_window() > 0)) {
+            s_raw_copy[i] = MAX_80211_FRAME_LEN;
+        } else if (snaplen == SNAPLEN_HDR || snaplen < RAW_COPY_MIN) {
+            s_raw_copy[i] = RAW_COPY_MIN;
+        } else {
+            s_raw_copy[i] = snaplen;
+        }
+    }
+}
+
 /* ---- Public API ---- */
 
-esp_err_t sniffer_init(uint8_t initial_channel)
+esp_err_t sniffer_init(uint8_t initial_channel, uint8_t sender_priority)
 {
     esp_err_t ret;
 
-    /* NVS — required by WiFi driver even if NVS storage is disabled */
-    ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
+    /* NVS is already up (settings_init): the WiFi driver needs it even with
+     * its own NVS storage disabled */
+    s_chan_lock = xSemaphoreCreateMutex();
+    if (!s_chan_lock) {
+        return ESP_ERR_NO_MEM;
     }
-    ESP_ERROR_CHECK(ret);
 
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
@@ -160,12 +639,26 @@ esp_err_t sniffer_init(uint8_t initial_channel)
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_NULL));
     ESP_ERROR_CHECK(esp_wifi_start());
 
-    /* Calculate queue depth based on remaining heap after WiFi init */
-    s_queue_depth = calculate_queue_depth();
-    s_packet_queue = xQueueCreate(s_queue_depth, sizeof(queued_packet_t));
-    if (!s_packet_queue) {
-        return ESP_ERR_NO_MEM;
+    /* The raw ring comes first; the capture ring gets what heap is left */
+    ret = ring_init(&s_raw, RAW_RING_SIZE);
+    if (ret != ESP_OK) {
+        return ret;
     }
+    update_raw_copy();
+
+    /* Size the capture ring once, based on remaining heap after WiFi init */
+    ret = ring_init(&s_ring, calculate_queue_depth() * RING_RECORD_LEN(payload_estimate()));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    for (int i = 0; i < SHED_LEVELS; i++) {
+        s_shed_at[i] = (uint32_t)((uint64_t)s_ring.size * SHED_PERCENT[i] / 100);
+    }
+
+    /* Both tasks must exist before the first callback notifies them */
+    xTaskCreate(sender_task, "sniffer_send", SENDER_TASK_STACK, NULL, sender_priority,
+                &s_sender_task);
+    xTaskCreate(rx_task, "sniffer_rx", RX_TASK_STACK, NULL, sender_priority, &s_rx_task);
 
     /* Set up promiscuous mode — default: all frame types */
     wifi_promiscuous_filter_t filter = {
@@ -181,34 +674,154 @@ esp_err_t sniffer_init(uint8_t initial_channel)
     s_current_channel = initial_channel;
     ESP_ERROR_CHECK(esp_wifi_set_channel(initial_channel, WIFI_SECOND_CHAN_NONE));
 
-    /* Start sender task */
-    xTaskCreate(sender_task, "sniffer_send", SENDER_TASK_STACK, NULL, SENDER_TASK_PRIORITY, NULL);
-
     return ESP_OK;
 }
 
+void sniffer_set_sender_priority(uint8_t priority)
+{
+    /* The RX worker's budget only works against a sender of equal priority */
+    vTaskPrioritySet(s_sender_task, priority);
+    vTaskPrioritySet(s_rx_task, priority);
+}
+
+void sniffer_set_rx_budget(uint16_t frames)
+{
+    s_rx_budget = frames;
+}
+
+uint16_t sniffer_get_rx_budget(void)
+{
+    return s_rx_budget;
+}
+
+/* ---- BENCH: synthetic frames in place of captured ones ---- */
+
+void sniffer_capture_pause(void)
+{
+    /* s_capture_paused keeps channel and band changes from turning capture
+     * back on, without holding the lock for the whole run. Disabling
+     * promiscuous mode is carried out by the WiFi task, which is also where
+     * the RX callback runs, so none is in flight once this returns and
+     * the injector is the raw ring's only producer. Waiting for the RX worker
+     * to empty it keeps captured frames out of the run. */
+    xSemaphoreTake(s_chan_lock, portMAX_DELAY);
+    s_capture_paused = true;
+    atomic_store(&s_inject_wait, true);
+    ESP_ERROR_CHECK(esp_wifi_set_promiscuous(false));
+    xSemaphoreGive(s_chan_lock);
+    while (ring_used(&s_raw) > 0) {
+        vTaskDelay(1);
+    }
+}
+
+void sniffer_inject_cancel(void)
+{
+    atomic_store(&s_inject_wait, false);
+}
+
+void sniffer_capture_resume(void)
+{
+    sniffer_inject_cancel();
+    xSemaphoreTake(s_chan_lock, portMAX_DELAY);
+    s_capture_paused = false;
+    ESP_ERROR_CHECK(esp_wifi_set_promiscuous(true));
+    xSemaphoreGive(s_chan_lock);
+}
+
+/* Queued like a received frame, so the RX worker's filters, snaplen and
+ * framing are part of what BENCH measures */
+bool sniffer_inject(const uint8_t *frame, uint16_t len, bool count_full)
+{
+    uint8_t *slot = ring_reserve(&s_raw, sizeof(raw_header_t) + len);
+    if (!slot) {
+        if (count_full) {
+            count_drop(DROP_RAW_FULL, 1);
+        }
+        return false;
+    }
+
+    raw_header_t raw = {
+        .timestamp = sniffer_get_rx_time(),
+        .channel   = s_current_channel,
+        .flags     = PKT_FLAG_SYNTHETIC | (count_full ? 0 : RAW_FLAG_WAIT),
+    };
+    memcpy(slot, &raw, sizeof(raw));
+    memcpy(slot + sizeof(raw), frame, len);
+    ring_commit(&s_raw);
+    raise_hwm(&s_raw_hwm, &s_raw);
+    xTaskNotifyGive(s_rx_task);
+    return true;
+}
+
+/* Band switch the slow way: promiscuous off, band mode, channel, back on */
+static void set_channel_fixed_band(uint8_t channel)
+{
+    ESP_ERROR_CHECK(esp_wifi_set_promiscuous(false));
+    if (channel >= 36) {
+        ESP_ERROR_CHECK(esp_wifi_set_band_mode(WIFI_BAND_MODE_5G_ONLY));
+    } else {
+        ESP_ERROR_CHECK(esp_wifi_set_band_mode(WIFI_BAND_MODE_2G_ONLY));
+    }
+    ESP_ERROR_CHECK(esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE));
+    if (!s_capture_paused) {
+        ESP_ERROR_CHECK(esp_wifi_set_promiscuous(true));
+    }
+}
+
 esp_err_t sniffer_set_channel(uint8_t channel)
 {
     bool new_is_5g = (channel >= 36);
     bool old_is_5g = (s_current_channel >= 36);
+    sniffer_switch_t kind = (new_is_5g == old_is_5g) ? SWITCH_SAME_BAND
+                          : new_is_5g ? SWITCH_TO_5G : SWITCH_TO_2G;
 
-    if (new_is_5g != old_is_5g) {
-        ESP_ERROR_CHECK(esp_wifi_set_promiscuous(false));
-        if (new_is_5g) {
-            ESP_ERROR_CHECK(esp_wifi_set_band_mode(WIFI_BAND_MODE_5G_ONLY));
-        } else {
-            ESP_ERROR_CHECK(esp_wifi_set_band_mode(WIFI_BAND_MODE_2G_ONLY));
-        }
-        ESP_ERROR_CHECK(esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE));
-        ESP_ERROR_CHECK(esp_wifi_set_promiscuous(true));
-    } else {
+    xSemaphoreTake(s_chan_lock, portMAX_DELAY);
+    int64_t start = esp_timer_get_time();
+
+    if (kind == SWITCH_SAME_BAND) {
         ESP_ERROR_CHECK(esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE));
+    } else if (!s_band_auto || esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE) != ESP_OK) {
+        /* The driver refused a cross-band channel in AUTO: stay on the fixed path */
+        s_band_auto = false;
+        set_channel_fixed_band(channel);
     }
 
+    uint32_t took = (uint32_t)(esp_timer_get_time() - start);
+    s_switch_us[kind] += took;
+    s_switch_count[kind]++;
+    atomic_fetch_add_explicit(&s_switch_total_us, took, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_switch_total, 1, memory_order_relaxed);
     s_current_channel = channel;
+    xSemaphoreGive(s_chan_lock);
     return ESP_OK;
 }
 
+esp_err_t sniffer_set_band_auto(bool enable)
+{
+    xSemaphoreTake(s_chan_lock, portMAX_DELAY);
+    ESP_ERROR_CHECK(esp_wifi_set_promiscuous(false));
+
+    esp_err_t err = ESP_OK;
+    if (enable) {
+        err = esp_wifi_set_band_mode(WIFI_BAND_MODE_AUTO);
+        if (err == ESP_OK) {
+            err = esp_wifi_set_channel(s_current_channel, WIFI_SECOND_CHAN_NONE);
+        }
+    }
+    if (!enable || err != ESP_OK) {
+        ESP_ERROR_CHECK(esp_wifi_set_band_mode(s_current_channel >= 36 ? WIFI_BAND_MODE_5G_ONLY
+                                                                       : WIFI_BAND_MODE_2G_ONLY));
+        ESP_ERROR_CHECK(esp_wifi_set_channel(s_current_channel, WIFI_SECOND_CHAN_NONE));
+    }
+    s_band_auto = enable && err == ESP_OK;
+
+    if (!s_capture_paused) {
+        ESP_ERROR_CHECK(esp_wifi_set_promiscuous(true));
+    }
+    xSemaphoreGive(s_chan_lock);
+    return err;
+}
+
 esp_err_t sniffer_set_filter(uint32_t mask)
 {
     wifi_promiscuous_filter_t filter = { .filter_mask = mask };
@@ -217,13 +830,46 @@ esp_err_t sniffer_set_filter(uint32_t mask)
 
 void sniffer_set_snaplen(uint16_t snaplen)
 {
-    s_snaplen = snaplen;
+    for (size_t i = 0; i < sizeof(s_snaplen) / sizeof(s_snaplen[0]); i++) {
+        s_snaplen[i] = snaplen;
+    }
+    update_raw_copy();
+}
+
+void sniffer_set_type_snaplen(uint8_t frame_type, uint16_t snaplen)
+{
+    s_snaplen[frame_type & 0x03] = snaplen;
+    update_raw_copy();
+}
+
+void sniffer_set_beacondedup(uint32_t ms)
+{
+    beacondedup_set_window(ms);
+    update_raw_copy();
+}
+
+void sniffer_set_pkt_header(uint8_t version)
+{
+    /* Records already in the ring keep the header they were queued with */
+    s_pkt_v2 = version == 2;
+}
+
+uint8_t sniffer_get_pkt_header(void)
+{
+    return s_pkt_v2 ? 2 : 1;
+}
+
+void sniffer_set_batch(bool enable)
+{
+    s_batch = enable;
 }
 
 void sniffer_set_compress(bool enable)
 {
-    /* Compression disabled — tdefl_compressor is ~160KB, too large for ESP32-C5 */
-    (void)enable;
+    /* LZ4 block compression (compress.c) — tdefl would need ~160KB */
+    s_compress = enable;
+    s_compress_in = 0;
+    s_compress_out = 0;
 }
 
 uint8_t sniffer_get_channel(void)
@@ -238,29 +884,149 @@ uint32_t sniffer_get_filter(void)
     return filter.filter_mask;
 }
 
-uint16_t sniffer_get_snaplen(void)
+uint16_t sniffer_get_type_snaplen(uint8_t frame_type)
+{
+    return s_snaplen[frame_type & 0x03];
+}
+
+bool sniffer_get_band_auto(void)
+{
+    return s_band_auto;
+}
+
+/* Mean sniffer_set_channel() time in microseconds for one kind of switch */
+uint32_t sniffer_get_switch_us(sniffer_switch_t kind)
+{
+    return s_switch_count[kind] ? (uint32_t)(s_switch_us[kind] / s_switch_count[kind]) : 0;
+}
+
+void sniffer_set_shed(bool enable)
 {
-    return s_snaplen;
+    s_shed = enable;
+}
+
+bool sniffer_get_shed(void)
+{
+    return s_shed;
+}
+
+uint32_t sniffer_get_shed_truncated(void)
+{
+    return atomic_load_explicit(&s_shed_truncated, memory_order_relaxed);
+}
+
+uint32_t sniffer_get_shed_dropped(void)
+{
+    return atomic_load_explicit(&s_shed_dropped, memory_order_relaxed);
+}
+
+bool sniffer_get_batch(void)
+{
+    return s_batch;
 }
 
 bool sniffer_get_compress(void)
 {
-    return false;
+    return s_compress;
+}
+
+/* Bytes sent per 100 bytes of batch body since COMPRESS ON (100 = no gain) */
+uint32_t sniffer_get_compress_ratio(void)
+{
+    return s_compress_in ? (uint32_t)((uint64_t)s_compress_out * 100 / s_compress_in) : 100;
+}
+
+/* Now, on the clock of pkt_header_t.timestamp: the last frame's rx timestamp
+ * advanced by the esp_timer time since it arrived. esp_timer alone until a
+ * frame has been received. */
+uint32_t sniffer_get_rx_time(void)
+{
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    rx_clock_t pair;
+    uint32_t gen;
+
+    do {
+        gen = atomic_load_explicit(&s_rx_clock_gen, memory_order_acquire);
+        if (gen == 0) {
+            return now;
+        }
+        pair = s_rx_clock[gen & 1];
+    } while (atomic_load_explicit(&s_rx_clock_gen, memory_order_acquire) != gen);
+
+    return pair.rx_ts + (now - pair.timer_us);
 }
 
 uint32_t sniffer_get_captured(void)
 {
-    return s_captured;
+    return atomic_load_explicit(&s_captured, memory_order_relaxed);
 }
 
+/* All causes */
 uint32_t sniffer_get_dropped(void)
 {
-    return s_dropped;
+    uint32_t total = 0;
+    for (int i = 0; i < DROP_CAUSES; i++) {
+        total += atomic_load_explicit(&s_drops[i], memory_order_relaxed);
+    }
+    return total;
+}
+
+uint32_t sniffer_get_drops(sniffer_drop_t cause)
+{
+    return atomic_load_explicit(&s_drops[cause], memory_order_relaxed);
+}
+
+uint32_t sniffer_get_filtered(void)
+{
+    return atomic_load_explicit(&s_filtered, memory_order_relaxed);
+}
+
+uint32_t sniffer_get_raw_size(void)
+{
+    return s_raw.size;
+}
+
+uint32_t sniffer_take_raw_hwm(void)
+{
+    return atomic_exchange_explicit(&s_raw_hwm, ring_used(&s_raw), memory_order_relaxed);
+}
+
+uint32_t sniffer_get_ring_size(void)
+{
+    return s_ring.size;
+}
+
+uint32_t sniffer_get_ring_used(void)
+{
+    return ring_used(&s_ring);
+}
+
+uint32_t sniffer_take_ring_hwm(void)
+{
+    return atomic_exchange_explicit(&s_ring_hwm, ring_used(&s_ring), memory_order_relaxed);
+}
+
+void sniffer_take_cb_stats(sniffer_cb_stats_t *out)
+{
+    out->count = atomic_exchange_explicit(&s_cb_count, 0, memory_order_relaxed);
+    uint32_t cycles = atomic_exchange_explicit(&s_cb_cycles, 0, memory_order_relaxed);
+    uint32_t min = atomic_exchange_explicit(&s_cb_min, UINT32_MAX, memory_order_relaxed);
+    out->max = atomic_exchange_explicit(&s_cb_max, 0, memory_order_relaxed);
+    out->min = out->count ? min : 0;
+    out->avg = out->count ? cycles / out->count : 0;
+}
+
+/* Wrapping totals over all switch kinds, for per-interval deltas */
+uint32_t sniffer_get_switch_total(uint32_t *total_us)
+{
+    *total_us = atomic_load_explicit(&s_switch_total_us, memory_order_relaxed);
+    return atomic_load_explicit(&s_switch_total, memory_order_relaxed);
 }
 
+/* Ring capacity in frames at the current snaplens */
 uint32_t sniffer_get_queue_depth(void)
 {
-    return s_queue_depth;
+    return s_ring.size / RING_RECORD_LEN(payload_estimate());
 }
 
 uint32_t sniffer_get_free_heap(void)
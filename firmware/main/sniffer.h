@@ -4,17 +4,91 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-esp_err_t sniffer_init(uint8_t initial_channel);
+/* Per-type snaplen value: keep only the 802.11 MAC header */
+#define SNAPLEN_HDR  0xFFFF
+
+/* Frames the RX worker handles before yielding to the sender (RXBUDGET) */
+#define RX_BUDGET_MIN      1
+#define RX_BUDGET_MAX      1024
+#define RX_BUDGET_DEFAULT  32
+
+/* Channel switch kinds, for switch latency */
+typedef enum {
+    SWITCH_SAME_BAND,
+    SWITCH_TO_5G,
+    SWITCH_TO_2G,
+    SWITCH_KINDS,
+} sniffer_switch_t;
+
+/* Why a captured frame never reached the host */
+typedef enum {
+    DROP_RAW_FULL,       /* No room in the raw ring: the RX worker fell behind */
+    DROP_RING_FULL,      /* No room in the capture ring */
+    DROP_USB_TIMEOUT,    /* Its frame was cut short by a USB write timeout */
+    DROP_CAUSES,
+} sniffer_drop_t;
+
+/* RX callback cost in CPU cycles over one sampling interval: the copy into
+ * the raw ring, not the RX worker's filtering */
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t avg;
+    uint32_t max;
+} sniffer_cb_stats_t;
+
+esp_err_t sniffer_init(uint8_t initial_channel, uint8_t sender_priority);
+void      sniffer_set_sender_priority(uint8_t priority);   /* Sender and RX worker */
+void      sniffer_set_rx_budget(uint16_t frames);
+uint16_t  sniffer_get_rx_budget(void);
 esp_err_t sniffer_set_channel(uint8_t channel);
 esp_err_t sniffer_set_filter(uint32_t mask);
+esp_err_t sniffer_set_band_auto(bool enable);
 void      sniffer_set_snaplen(uint16_t snaplen);
+void      sniffer_set_type_snaplen(uint8_t frame_type, uint16_t snaplen);
+void      sniffer_set_beacondedup(uint32_t ms);   /* beacondedup_set_window, and the copy bound */
+void      sniffer_set_pkt_header(uint8_t version);   /* 1: pkt_header_t, 2: pkt_header_v2_t */
+void      sniffer_set_batch(bool enable);
 void      sniffer_set_compress(bool enable);
+void      sniffer_set_shed(bool enable);
 
 uint8_t   sniffer_get_channel(void);
 uint32_t  sniffer_get_filter(void);
-uint16_t  sniffer_get_snaplen(void);
+uint16_t  sniffer_get_type_snaplen(uint8_t frame_type);
+bool      sniffer_get_band_auto(void);
+uint32_t  sniffer_get_switch_us(sniffer_switch_t kind);
+uint8_t   sniffer_get_pkt_header(void);
+bool      sniffer_get_batch(void);
 bool      sniffer_get_compress(void);
+bool      sniffer_get_shed(void);
+uint32_t  sniffer_get_shed_truncated(void);   /* Data frames cut to the header by SHED */
+uint32_t  sniffer_get_shed_dropped(void);     /* Data/control frames dropped by SHED */
+uint32_t  sniffer_get_compress_ratio(void);
 uint32_t  sniffer_get_captured(void);
 uint32_t  sniffer_get_dropped(void);
+uint32_t  sniffer_get_drops(sniffer_drop_t cause);
+uint32_t  sniffer_get_filtered(void);         /* Discarded by MACFILTER, BEACONDEDUP or PRESENCE */
+uint32_t  sniffer_get_raw_size(void);
+uint32_t  sniffer_get_ring_size(void);
+uint32_t  sniffer_get_ring_used(void);
+uint32_t  sniffer_get_switch_total(uint32_t *total_us);
+uint32_t  sniffer_get_rx_time(void);          /* Now, in pkt_header_t.timestamp microseconds */
+
+/* Read and restart the per-interval measurements */
+uint32_t  sniffer_take_ring_hwm(void);
+uint32_t  sniffer_take_raw_hwm(void);
+void      sniffer_take_cb_stats(sniffer_cb_stats_t *out);
 uint32_t  sniffer_get_queue_depth(void);
 uint32_t  sniffer_get_free_heap(void);
+
+/* BENCH only: stop capture (channel changes meanwhile leave it off) so sniffer_inject
+ * can queue synthetic frames, flagged PKT_FLAG_SYNTHETIC, into the raw ring as
+ * the only producer. The RX worker handles them like received frames, and they
+ * count as captured. sniffer_inject returns false while the raw ring is full,
+ * counted as a DROP_RAW_FULL with count_full. Without count_full the worker
+ * waits for room in the capture ring instead of dropping, until a timeout,
+ * sniffer_inject_cancel or sniffer_capture_resume. */
+void      sniffer_capture_pause(void);
+void      sniffer_capture_resume(void);
+void      sniffer_inject_cancel(void);
+bool      sniffer_inject(const uint8_t *frame, uint16_t len, bool count_full);
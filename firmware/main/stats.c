@@ -0,0 +1,104 @@
+#include "stats.h"
+#include "protocol.h"
+#include "sniffer.h"
+#include "usb_serial.h"
+#include "flow.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define STATS_TASK_STACK     3072
+#define STATS_TASK_PRIORITY  2    /* Below the sender and command tasks */
+
+static TaskHandle_t s_task;
+static uint32_t     s_interval_ms = STATS_DEFAULT_MS;
+
+/* Baselines for the per-interval deltas */
+static int64_t  s_last_us;
+static uint32_t s_last_tx_bytes;
+static uint32_t s_last_switches;
+static uint32_t s_last_switch_us;
+
+static void send_stats(void)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t elapsed_ms = (uint32_t)((now - s_last_us) / 1000);
+    uint32_t tx_bytes = usb_serial_get_tx_bytes();
+    uint32_t switch_us;
+    uint32_t switches = sniffer_get_switch_total(&switch_us);
+    sniffer_cb_stats_t cb;
+    sniffer_take_cb_stats(&cb);
+
+    stats_record_t rec = {
+        .msg_type        = MSG_TYPE_STATS,
+        .version         = STATS_VERSION,
+        .interval_ms     = elapsed_ms > UINT16_MAX ? UINT16_MAX : elapsed_ms,
+        .uptime_ms       = (uint32_t)(now / 1000),
+        .captured        = sniffer_get_captured(),
+        .drop_ring_full  = sniffer_get_drops(DROP_RING_FULL),
+        .drop_usb        = sniffer_get_drops(DROP_USB_TIMEOUT),
+        .usb_timeouts    = usb_serial_get_tx_timeouts(),
+        .usb_bytes_per_s = elapsed_ms ? (uint32_t)((uint64_t)(tx_bytes - s_last_tx_bytes) * 1000
+                                                   / elapsed_ms) : 0,
+        .ring_size       = sniffer_get_ring_size(),
+        .ring_hwm        = sniffer_take_ring_hwm(),
+        .ring_used       = sniffer_get_ring_used(),
+        .cb_count        = cb.count,
+        .cb_cycles_min   = cb.min,
+        .cb_cycles_avg   = cb.avg,
+        .cb_cycles_max   = cb.max,
+        .switch_count    = switches - s_last_switches,
+        .switch_us       = switch_us - s_last_switch_us,
+        .free_heap       = sniffer_get_free_heap(),
+        .shed_truncated  = sniffer_get_shed_truncated(),
+        .shed_dropped    = sniffer_get_shed_dropped(),
+        .flow_waits      = flow_get_waits(),
+        .flow_credit     = flow_get_balance(),
+        .drop_raw_full   = sniffer_get_drops(DROP_RAW_FULL),
+        .filtered        = sniffer_get_filtered(),
+        .raw_size        = sniffer_get_raw_size(),
+        .raw_hwm         = sniffer_take_raw_hwm(),
+    };
+
+    s_last_us = now;
+    s_last_tx_bytes = tx_bytes;
+    s_last_switches = switches;
+    s_last_switch_us = switch_us;
+
+    usb_serial_send_frame((const uint8_t *)&rec, sizeof(rec));
+}
+
+static void stats_task(void *arg)
+{
+    s_last_us = esp_timer_get_time();
+    s_last_tx_bytes = usb_serial_get_tx_bytes();
+    s_last_switches = sniffer_get_switch_total(&s_last_switch_us);
+
+    while (true) {
+        uint32_t interval = s_interval_ms;
+        /* A notification means the interval changed: re-read it */
+        if (ulTaskNotifyTake(pdTRUE, interval ? pdMS_TO_TICKS(interval) : portMAX_DELAY)) {
+            continue;
+        }
+        send_stats();
+    }
+}
+
+esp_err_t stats_init(void)
+{
+    BaseType_t ret = xTaskCreate(stats_task, "stats", STATS_TASK_STACK, NULL,
+                                 STATS_TASK_PRIORITY, &s_task);
+    return (ret == pdPASS) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void stats_set_interval(uint32_t ms)
+{
+    s_interval_ms = ms;
+    xTaskNotifyGive(s_task);
+}
+
+uint32_t stats_get_interval(void)
+{
+    return s_interval_ms;
+}
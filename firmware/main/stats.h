@@ -0,0 +1,16 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+
+#define STATS_DEFAULT_MS  1000
+#define STATS_MIN_MS      100
+#define STATS_MAX_MS      60000
+
+/*
+ * Periodic MSG_TYPE_STATS telemetry (see protocol.h), sent straight to USB by
+ * a low-priority task so the host can chart device health without polling.
+ */
+esp_err_t stats_init(void);
+void      stats_set_interval(uint32_t ms);   /* 0 = off */
+uint32_t  stats_get_interval(void);
@@ -1,52 +1,219 @@
 #include "usb_serial.h"
 #include "protocol.h"
+#include "flow.h"
 #include "driver/usb_serial_jtag.h"
+#include "esp_rom_crc.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
-/* Scratch buffer for SLIP encoding — only sender task writes, no mutex needed */
-static uint8_t s_slip_buf[SLIP_BUF_SIZE];
+#include <stdatomic.h>
+#include <string.h>
 
-esp_err_t usb_serial_init(void)
+/* In LEN framing, writes at least this big skip the TX scratch buffer and are
+ * handed to the driver straight from the caller's memory */
+#define TX_DIRECT_MIN  256
+
+/* Full-speed bulk packet size. Direct writes are cut on this boundary so the
+ * driver moves whole packets instead of a short one per write. */
+#define USB_PACKET_SIZE  64
+
+/* Host to device: command lines and CREDIT, a few bytes each */
+#define USB_RX_BUF_SIZE  1024
+
+/* TX scratch buffer for framing — guarded by s_tx_lock, since both the
+ * sender task and the command task send frames */
+static uint8_t s_tx_buf[SLIP_BUF_SIZE];
+static size_t  s_tx_len;
+static SemaphoreHandle_t s_tx_lock;
+
+static usb_framing_t s_framing = USB_FRAMING_SLIP;
+static uint32_t      s_crc;      /* Running CRC of the LEN frame being sent */
+static bool          s_tx_short; /* A write in the current frame timed out */
+static size_t        s_tx_frame; /* Payload length of the current frame, as charged */
+
+static uint32_t         s_tx_buffer_size;
+static _Atomic uint32_t s_tx_bytes;
+static _Atomic uint32_t s_tx_timeouts;
+
+esp_err_t usb_serial_init(uint32_t tx_buffer_size)
 {
+    s_tx_lock = xSemaphoreCreateMutex();
+    if (!s_tx_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_tx_buffer_size = tx_buffer_size;
     usb_serial_jtag_driver_config_t cfg = {
-        .tx_buffer_size = 16384,
-        .rx_buffer_size = 256,
+        .tx_buffer_size = tx_buffer_size,
+        .rx_buffer_size = USB_RX_BUF_SIZE,
     };
     return usb_serial_jtag_driver_install(&cfg);
 }
 
-void usb_serial_send_slip_frame(const uint8_t *data, size_t len)
+/* Hand bytes to the driver; a short write means the host stopped reading
+ * for the whole timeout and the rest of the frame is lost */
+static void usb_write(const uint8_t *data, size_t len)
 {
-    size_t idx = 0;
+    int n = usb_serial_jtag_write_bytes(data, len, pdMS_TO_TICKS(100));
+    if (n > 0) {
+        atomic_fetch_add_explicit(&s_tx_bytes, (uint32_t)n, memory_order_relaxed);
+    }
+    if (n < (int)len) {
+        s_tx_short = true;
+        atomic_fetch_add_explicit(&s_tx_timeouts, 1, memory_order_relaxed);
+    }
+}
 
-    /* Leading END byte for mid-stream resynchronization (RFC 1055) */
-    s_slip_buf[idx++] = SLIP_END;
+static void tx_flush(void)
+{
+    if (s_tx_len > 0) {
+        usb_write(s_tx_buf, s_tx_len);
+        s_tx_len = 0;
+    }
+}
 
-    for (size_t i = 0; i < len && idx < SLIP_BUF_SIZE - 2; i++) {
+/* Copy bytes into the TX buffer unmodified, flushing as it fills */
+static void tx_put(const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        size_t n = SLIP_BUF_SIZE - s_tx_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(s_tx_buf + s_tx_len, data, n);
+        s_tx_len += n;
+        data += n;
+        len -= n;
+        if (s_tx_len == SLIP_BUF_SIZE) {
+            tx_flush();
+        }
+    }
+}
+
+static void slip_put(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        /* Worst case one input byte becomes two output bytes */
+        if (s_tx_len > SLIP_BUF_SIZE - 2) {
+            tx_flush();
+        }
         switch (data[i]) {
         case SLIP_END:
-            s_slip_buf[idx++] = SLIP_ESC;
-            s_slip_buf[idx++] = SLIP_ESC_END;
+            s_tx_buf[s_tx_len++] = SLIP_ESC;
+            s_tx_buf[s_tx_len++] = SLIP_ESC_END;
             break;
         case SLIP_ESC:
-            s_slip_buf[idx++] = SLIP_ESC;
-            s_slip_buf[idx++] = SLIP_ESC_ESC;
+            s_tx_buf[s_tx_len++] = SLIP_ESC;
+            s_tx_buf[s_tx_len++] = SLIP_ESC_ESC;
             break;
         default:
-            s_slip_buf[idx++] = data[i];
+            s_tx_buf[s_tx_len++] = data[i];
             break;
         }
     }
+}
+
+void usb_serial_frame_begin(size_t len)
+{
+    xSemaphoreTake(s_tx_lock, portMAX_DELAY);
+    s_tx_short = false;
+    s_tx_frame = len;
+    flow_charge(len);
 
-    /* Trailing END byte */
-    if (idx < SLIP_BUF_SIZE) {
-        s_slip_buf[idx++] = SLIP_END;
+    if (s_framing == USB_FRAMING_LEN) {
+        uint8_t hdr[4] = { LEN_SYNC0, LEN_SYNC1, (uint8_t)len, (uint8_t)(len >> 8) };
+        s_crc = esp_rom_crc32_le(0, hdr + 2, 2);
+        tx_put(hdr, sizeof(hdr));
+    } else {
+        /* Leading END byte for mid-stream resynchronization (RFC 1055) */
+        uint8_t end = SLIP_END;
+        tx_put(&end, 1);
     }
+}
 
-    usb_serial_jtag_write_bytes(s_slip_buf, idx, pdMS_TO_TICKS(100));
+void usb_serial_frame_write(const uint8_t *data, size_t len)
+{
+    if (s_framing == USB_FRAMING_LEN) {
+        s_crc = esp_rom_crc32_le(s_crc, data, len);
+        if (len >= TX_DIRECT_MIN) {
+            /* Top the buffered bytes up to a packet boundary, write the
+             * whole packets in place and keep the tail for what follows */
+            size_t head = (USB_PACKET_SIZE - s_tx_len % USB_PACKET_SIZE) % USB_PACKET_SIZE;
+            tx_put(data, head);
+            tx_flush();
+            size_t bulk = (len - head) & ~(size_t)(USB_PACKET_SIZE - 1);
+            usb_write(data + head, bulk);
+            tx_put(data + head + bulk, len - head - bulk);
+        } else {
+            tx_put(data, len);
+        }
+    } else {
+        slip_put(data, len);
+    }
+}
+
+bool usb_serial_frame_end(void)
+{
+    if (s_framing == USB_FRAMING_LEN) {
+        uint8_t crc[4] = {
+            (uint8_t)s_crc, (uint8_t)(s_crc >> 8),
+            (uint8_t)(s_crc >> 16), (uint8_t)(s_crc >> 24),
+        };
+        tx_put(crc, sizeof(crc));
+    } else {
+        /* Trailing END byte */
+        uint8_t end = SLIP_END;
+        tx_put(&end, 1);
+    }
+    tx_flush();
+    bool ok = !s_tx_short;
+    if (!ok) {
+        /* The host never decodes a frame cut short, so it never credits it */
+        flow_credit(s_tx_frame);
+    }
+
+    xSemaphoreGive(s_tx_lock);
+    return ok;
+}
+
+bool usb_serial_send_frame(const uint8_t *data, size_t len)
+{
+    usb_serial_frame_begin(len);
+    usb_serial_frame_write(data, len);
+    return usb_serial_frame_end();
+}
+
+void usb_serial_set_framing(usb_framing_t framing)
+{
+    /* Never switch in the middle of a frame */
+    xSemaphoreTake(s_tx_lock, portMAX_DELAY);
+    s_framing = framing;
+    xSemaphoreGive(s_tx_lock);
+}
+
+usb_framing_t usb_serial_get_framing(void)
+{
+    return s_framing;
+}
+
+int usb_serial_read(uint8_t *buf, size_t maxlen, uint32_t timeout_ms)
+{
+    TickType_t ticks = timeout_ms == USB_SERIAL_WAIT_FOREVER ? portMAX_DELAY
+                                                             : pdMS_TO_TICKS(timeout_ms);
+    return usb_serial_jtag_read_bytes(buf, maxlen, ticks);
+}
+
+uint32_t usb_serial_get_tx_buffer_size(void)
+{
+    return s_tx_buffer_size;
+}
+
+uint32_t usb_serial_get_tx_bytes(void)
+{
+    return atomic_load_explicit(&s_tx_bytes, memory_order_relaxed);
 }
 
-int usb_serial_read(uint8_t *buf, size_t maxlen)
+uint32_t usb_serial_get_tx_timeouts(void)
 {
-    return usb_serial_jtag_read_bytes(buf, maxlen, 0);
+    return atomic_load_explicit(&s_tx_timeouts, memory_order_relaxed);
 }
@@ -1,9 +1,35 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-esp_err_t usb_serial_init(void);
-void usb_serial_send_slip_frame(const uint8_t *data, size_t len);
-int usb_serial_read(uint8_t *buf, size_t maxlen);
+/* Wire framing for everything sent to the host. SLIP is the default; LEN
+ * (see protocol.h) is negotiated with the FRAMING command. */
+typedef enum {
+    USB_FRAMING_SLIP,
+    USB_FRAMING_LEN,
+} usb_framing_t;
+
+#define USB_SERIAL_WAIT_FOREVER  UINT32_MAX
+
+esp_err_t usb_serial_init(uint32_t tx_buffer_size);
+bool usb_serial_send_frame(const uint8_t *data, size_t len);   /* false if a write timed out */
+int usb_serial_read(uint8_t *buf, size_t maxlen, uint32_t timeout_ms);
+
+/* Streamed frame: begin with the total payload length, any number of writes
+ * adding up to it, then end. Holds the TX lock until end, so a frame can be
+ * assembled from several buffers without a copy. */
+void usb_serial_frame_begin(size_t len);
+void usb_serial_frame_write(const uint8_t *data, size_t len);
+bool usb_serial_frame_end(void);   /* false if any write in the frame timed out */
+
+/* Bytes accepted by the driver, and writes cut short by the TX timeout */
+uint32_t usb_serial_get_tx_bytes(void);
+uint32_t usb_serial_get_tx_timeouts(void);
+uint32_t usb_serial_get_tx_buffer_size(void);
+
+/* Takes effect from the next frame */
+void          usb_serial_set_framing(usb_framing_t framing);
+usb_framing_t usb_serial_get_framing(void);
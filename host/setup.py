@@ -0,0 +1,11 @@
+"""Build the optional native decoder used by sniffer.py and sniffer_gui.py:
+
+    python3 setup.py build_ext --inplace
+"""
+
+from setuptools import Extension, setup
+
+setup(
+    name="sniffdecode",
+    ext_modules=[Extension("_sniffdecode", ["sniffdecode.c"])],
+)
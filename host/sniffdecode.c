@@ -0,0 +1,628 @@
+/*
+ * _sniffdecode — native stream decoder for the 5dra sniffer host tools.
+ *
+ * Decoder.feed(chunk) undoes SLIP or FRAMING LEN framing, expands
+ * MSG_TYPE_BATCH frames (including LZ4-compressed ones) and returns every
+ * MSG_TYPE_PACKET(_V2) record as one struct-of-arrays batch: a single payload
+ * buffer plus packed per-packet columns. All other messages (responses,
+ * stats, beacon summaries, ...) are returned whole in `others` for the
+ * Python parse_frame().
+ *
+ * Mirrors FrameDecoder/parse_batch in sniffer.py, which remain the fallback
+ * when this module is not built (python3 setup.py build_ext --inplace).
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#define MSG_TYPE_PACKET     0x01
+#define MSG_TYPE_RESPONSE   0x02
+#define MSG_TYPE_BATCH      0x04
+#define MSG_TYPE_PACKET_V2  0x07
+#define PKT_FLAG_COMPRESSED 0x01
+#define PKT_HEADER_LEN      10
+#define PKT_HEADER_V2_LEN   18
+#define SEQ_RESET_GAP       0x80000000u
+
+#define SLIP_END     0xC0
+#define SLIP_ESC     0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+#define LEN_SYNC0      0xA5
+#define LEN_SYNC1      0x5A
+#define LEN_MAX_FRAME  8192
+
+enum { FRAMING_SLIP, FRAMING_LEN };
+
+/* ---- Growable byte buffer ---- */
+
+typedef struct {
+    uint8_t *data;
+    size_t   len;
+    size_t   cap;
+} buf_t;
+
+static int buf_reserve(buf_t *b, size_t extra)
+{
+    if (b->len + extra <= b->cap) {
+        return 0;
+    }
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + extra) {
+        cap *= 2;
+    }
+    uint8_t *p = PyMem_Realloc(b->data, cap);
+    if (!p) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    b->data = p;
+    b->cap = cap;
+    return 0;
+}
+
+static int buf_put(buf_t *b, const void *src, size_t len)
+{
+    if (buf_reserve(b, len) < 0) {
+        return -1;
+    }
+    memcpy(b->data + b->len, src, len);
+    b->len += len;
+    return 0;
+}
+
+static void buf_free(buf_t *b)
+{
+    PyMem_Free(b->data);
+    b->data = NULL;
+    b->len = b->cap = 0;
+}
+
+/* ---- CRC-32 (same as zlib.crc32 and esp_rom_crc32_le) ---- */
+
+static uint32_t s_crc_table[256];
+
+static void crc_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        s_crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32(const uint8_t *p, size_t len)
+{
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) {
+        c = s_crc_table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFu;
+}
+
+/* ---- LZ4 block decoder; returns 0, or -1 on malformed input ---- */
+
+static int lz4_decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len)
+{
+    const uint8_t *ip = src, *iend = src + src_len;
+    uint8_t *op = dst, *oend = dst + dst_len;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+        if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit) return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip >= iend) {
+            break;   /* Last sequence is literals only */
+        }
+
+        if (iend - ip < 2) return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t mlen = token & 0x0F;
+        if (mlen == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                mlen += b;
+            } while (b == 255);
+        }
+        mlen += 4;
+        if (offset == 0 || offset > (size_t)(op - dst) || (size_t)(oend - op) < mlen) return -1;
+        const uint8_t *match = op - offset;
+        while (mlen--) {
+            *op++ = *match++;   /* Byte copy handles overlapping matches */
+        }
+    }
+    return op == oend ? 0 : -1;
+}
+
+/* ---- Batch result: struct-of-arrays ---- */
+
+static PyTypeObject PacketBatchType;
+
+static PyStructSequence_Field s_batch_fields[] = {
+    { "count",     "number of packets" },
+    { "buf",       "bytes: all packet payloads back to back" },
+    { "channel",   "bytes, uint8 per packet" },
+    { "rssi",      "bytes, int8 per packet (cast('b'))" },
+    { "flags",     "bytes, uint8 per packet" },
+    { "sig_len",   "bytes, uint16 per packet (cast('H'))" },
+    { "timestamp", "bytes, uint64 per packet (cast('Q'))" },
+    { "offset",    "bytes, uint32 per packet: payload start in buf (cast('I'))" },
+    { "length",    "bytes, uint16 per packet: payload length (cast('H'))" },
+    { "others",    "list of non-packet messages, as bytes" },
+    { "consumed",  "payload bytes of all frames decoded (for CREDIT)" },
+    { NULL, NULL },
+};
+
+static PyStructSequence_Desc s_batch_desc = {
+    "_sniffdecode.PacketBatch",
+    "Packets decoded from one feed() call, as parallel columns",
+    s_batch_fields,
+    11,
+};
+
+/* PKTHDR 2 sequence numbers seen, kept across feeds (Decoder.seq_*) */
+typedef struct {
+    int        started;
+    uint32_t   last;
+    Py_ssize_t received, lost, resets;
+} seq_state_t;
+
+typedef struct {
+    buf_t     payload;
+    buf_t     channel, rssi, flags, sig_len, timestamp, offset, length;
+    Py_ssize_t count;
+    PyObject  *others;       /* list */
+    size_t     consumed;
+    seq_state_t *seq;
+} batch_t;
+
+static void batch_free(batch_t *b)
+{
+    buf_free(&b->payload);
+    buf_free(&b->channel);
+    buf_free(&b->rssi);
+    buf_free(&b->flags);
+    buf_free(&b->sig_len);
+    buf_free(&b->timestamp);
+    buf_free(&b->offset);
+    buf_free(&b->length);
+    Py_CLEAR(b->others);
+}
+
+static int add_other(batch_t *b, const uint8_t *msg, size_t len)
+{
+    PyObject *o = PyBytes_FromStringAndSize((const char *)msg, (Py_ssize_t)len);
+    if (!o) {
+        return -1;
+    }
+    int r = PyList_Append(b->others, o);
+    Py_DECREF(o);
+    return r;
+}
+
+static void note_seq(seq_state_t *st, uint32_t seq)
+{
+    if (st->started) {
+        uint32_t gap = seq - st->last - 1;
+        if (gap < SEQ_RESET_GAP) {
+            st->lost += gap;
+        } else {
+            st->resets++;
+        }
+    }
+    st->started = 1;
+    st->last = seq;
+    st->received++;
+}
+
+/* One message as sent on its own (a PACKET, RESPONSE, ...) */
+static int add_message(batch_t *b, const uint8_t *msg, size_t len)
+{
+    if (len < 1) {
+        return 0;
+    }
+    size_t hdr_len;
+    uint64_t ts = 0;
+    if (msg[0] == MSG_TYPE_PACKET) {
+        hdr_len = PKT_HEADER_LEN;
+        if (len < hdr_len) {
+            return 0;
+        }
+        memcpy(&ts, msg + 6, 4);
+    } else if (msg[0] == MSG_TYPE_PACKET_V2) {
+        hdr_len = PKT_HEADER_V2_LEN;
+        if (len < hdr_len) {
+            return 0;
+        }
+        uint32_t seq;
+        memcpy(&seq, msg + 6, 4);
+        memcpy(&ts, msg + 10, 8);
+        note_seq(b->seq, seq);
+    } else {
+        return add_other(b, msg, len);
+    }
+
+    uint32_t off = (uint32_t)b->payload.len;
+    uint16_t plen = (uint16_t)(len - hdr_len);
+    if (buf_put(&b->payload, msg + hdr_len, plen) < 0 ||
+        buf_put(&b->channel, msg + 1, 1) < 0 ||
+        buf_put(&b->rssi, msg + 2, 1) < 0 ||
+        buf_put(&b->flags, msg + 3, 1) < 0 ||
+        buf_put(&b->sig_len, msg + 4, 2) < 0 ||
+        buf_put(&b->timestamp, &ts, 8) < 0 ||
+        buf_put(&b->offset, &off, 4) < 0 ||
+        buf_put(&b->length, &plen, 2) < 0) {
+        return -1;
+    }
+    b->count++;
+    return 0;
+}
+
+static int add_batch_records(batch_t *b, const uint8_t *body, size_t len, unsigned count)
+{
+    size_t pos = 0;
+    for (unsigned i = 0; i < count; i++) {
+        if (pos + 2 > len) {
+            break;
+        }
+        size_t rec_len = body[pos] | (body[pos + 1] << 8);
+        pos += 2;
+        if (pos + rec_len > len) {
+            break;
+        }
+        if (add_message(b, body + pos, rec_len) < 0) {
+            return -1;
+        }
+        pos += rec_len;
+    }
+    return 0;
+}
+
+/* One decoded frame: expand batches, pass the rest to add_message */
+static int add_frame(batch_t *b, const uint8_t *frame, size_t len)
+{
+    b->consumed += len;
+    if (len < 1 || frame[0] != MSG_TYPE_BATCH) {
+        return add_message(b, frame, len);
+    }
+    if (len < 4) {
+        return 0;
+    }
+
+    uint8_t flags = frame[1];
+    unsigned count = frame[2] | (frame[3] << 8);
+    if (!(flags & PKT_FLAG_COMPRESSED)) {
+        return add_batch_records(b, frame + 4, len - 4, count);
+    }
+
+    if (len < 6) {
+        return 0;
+    }
+    size_t raw_len = frame[4] | (frame[5] << 8);
+    uint8_t *raw = PyMem_Malloc(raw_len ? raw_len : 1);
+    if (!raw) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    int r = 0;
+    if (lz4_decompress(frame + 6, len - 6, raw, raw_len) == 0) {
+        r = add_batch_records(b, raw, raw_len, count);
+    }
+    PyMem_Free(raw);
+    return r;
+}
+
+/* ---- Decoder object ---- */
+
+typedef struct {
+    PyObject_HEAD
+    int        framing;
+    Py_ssize_t crc_errors;
+    seq_state_t seq;
+    buf_t      pending;     /* Unconsumed input from earlier feeds */
+    buf_t      scratch;     /* SLIP unescape buffer */
+} DecoderObject;
+
+/* True if frame is "OK FRAMING <mode>": switch framing right after it */
+static int check_switch(DecoderObject *self, const uint8_t *frame, size_t len)
+{
+    static const char ack[] = "OK FRAMING ";
+    size_t n = sizeof(ack) - 1;
+    if (len < 1 + n || frame[0] != MSG_TYPE_RESPONSE || memcmp(frame + 1, ack, n) != 0) {
+        return 0;
+    }
+    const uint8_t *mode = frame + 1 + n;
+    size_t mlen = len - 1 - n;
+    if (mlen == 3 && memcmp(mode, "LEN", 3) == 0) {
+        self->framing = FRAMING_LEN;
+    } else if (mlen == 4 && memcmp(mode, "SLIP", 4) == 0) {
+        self->framing = FRAMING_SLIP;
+    }
+    return 1;
+}
+
+/* Each feed_* returns the number of input bytes consumed, or -1 on error.
+ * They stop early after a framing switch so the caller can go on in the
+ * other framing. */
+
+static Py_ssize_t feed_slip(DecoderObject *self, batch_t *b, const uint8_t *data, size_t n)
+{
+    size_t start = 0;
+    for (;;) {
+        const uint8_t *end = memchr(data + start, SLIP_END, n - start);
+        if (!end) {
+            return (Py_ssize_t)start;
+        }
+        size_t e = (size_t)(end - data);
+        if (e > start) {
+            buf_t *s = &self->scratch;
+            s->len = 0;
+            if (buf_reserve(s, e - start) < 0) {
+                return -1;
+            }
+            for (size_t i = start; i < e; i++) {
+                uint8_t c = data[i];
+                if (c == SLIP_ESC && i + 1 < e) {
+                    uint8_t nx = data[i + 1];
+                    if (nx == SLIP_ESC_END) {
+                        c = SLIP_END;
+                        i++;
+                    } else if (nx == SLIP_ESC_ESC) {
+                        c = SLIP_ESC;
+                        i++;
+                    }
+                }
+                s->data[s->len++] = c;
+            }
+            if (add_frame(b, s->data, s->len) < 0) {
+                return -1;
+            }
+            if (check_switch(self, s->data, s->len)) {
+                return (Py_ssize_t)(e + 1);
+            }
+        }
+        start = e + 1;
+    }
+}
+
+static Py_ssize_t feed_len(DecoderObject *self, batch_t *b, const uint8_t *data, size_t n)
+{
+    size_t pos = 0;
+    while (n - pos >= 4) {
+        if (data[pos] != LEN_SYNC0 || data[pos + 1] != LEN_SYNC1) {
+            pos++;
+            continue;
+        }
+        size_t length = data[pos + 2] | (data[pos + 3] << 8);
+        if (length > LEN_MAX_FRAME) {
+            pos++;
+            continue;
+        }
+        size_t end = pos + 4 + length + 4;
+        if (end > n) {
+            break;
+        }
+        const uint8_t *c = data + end - 4;
+        uint32_t crc = c[0] | (c[1] << 8) | (c[2] << 16) | ((uint32_t)c[3] << 24);
+        if (crc32(data + pos + 2, length + 2) != crc) {
+            self->crc_errors++;
+            pos++;
+            continue;
+        }
+        if (add_frame(b, data + pos + 4, length) < 0) {
+            return -1;
+        }
+        pos = end;
+        if (check_switch(self, data + pos - 4 - length, length)) {
+            return (Py_ssize_t)pos;
+        }
+    }
+    return (Py_ssize_t)pos;
+}
+
+static PyObject *build_result(batch_t *b)
+{
+    PyObject *res = PyStructSequence_New(&PacketBatchType);
+    if (!res) {
+        return NULL;
+    }
+    buf_t *cols[] = {
+        &b->payload, &b->channel, &b->rssi, &b->flags,
+        &b->sig_len, &b->timestamp, &b->offset, &b->length,
+    };
+    PyStructSequence_SET_ITEM(res, 0, PyLong_FromSsize_t(b->count));
+    for (int i = 0; i < 8; i++) {
+        PyStructSequence_SET_ITEM(res, 1 + i,
+            PyBytes_FromStringAndSize((const char *)cols[i]->data, (Py_ssize_t)cols[i]->len));
+    }
+    Py_INCREF(b->others);
+    PyStructSequence_SET_ITEM(res, 9, b->others);
+    PyStructSequence_SET_ITEM(res, 10, PyLong_FromSize_t(b->consumed));
+
+    for (int i = 0; i < 11; i++) {
+        if (!PyStructSequence_GET_ITEM(res, i)) {
+            Py_DECREF(res);
+            return NULL;
+        }
+    }
+    return res;
+}
+
+static PyObject *Decoder_feed(DecoderObject *self, PyObject *arg)
+{
+    Py_buffer view;
+    if (PyObject_GetBuffer(arg, &view, PyBUF_SIMPLE) < 0) {
+        return NULL;
+    }
+
+    batch_t b = { 0 };
+    b.seq = &self->seq;
+    b.others = PyList_New(0);
+    if (!b.others || buf_put(&self->pending, view.buf, (size_t)view.len) < 0) {
+        PyBuffer_Release(&view);
+        batch_free(&b);
+        return NULL;
+    }
+    PyBuffer_Release(&view);
+
+    const uint8_t *data = self->pending.data;
+    size_t n = self->pending.len;
+    size_t pos = 0;
+    for (;;) {
+        int framing = self->framing;
+        Py_ssize_t used = framing == FRAMING_LEN ? feed_len(self, &b, data + pos, n - pos)
+                                                 : feed_slip(self, &b, data + pos, n - pos);
+        if (used < 0) {
+            batch_free(&b);
+            return NULL;
+        }
+        pos += (size_t)used;
+        if (self->framing == framing) {
+            break;
+        }
+    }
+    memmove(self->pending.data, data + pos, n - pos);
+    self->pending.len = n - pos;
+
+    PyObject *res = build_result(&b);
+    batch_free(&b);
+    return res;
+}
+
+static PyObject *Decoder_get_framing(DecoderObject *self, void *closure)
+{
+    return PyUnicode_FromString(self->framing == FRAMING_LEN ? "LEN" : "SLIP");
+}
+
+static int Decoder_set_framing(DecoderObject *self, PyObject *value, void *closure)
+{
+    if (value && PyUnicode_Check(value)) {
+        const char *s = PyUnicode_AsUTF8(value);
+        if (s && strcmp(s, "LEN") == 0) {
+            self->framing = FRAMING_LEN;
+            return 0;
+        }
+        if (s && strcmp(s, "SLIP") == 0) {
+            self->framing = FRAMING_SLIP;
+            return 0;
+        }
+    }
+    PyErr_SetString(PyExc_ValueError, "framing must be 'SLIP' or 'LEN'");
+    return -1;
+}
+
+static int Decoder_init(DecoderObject *self, PyObject *args, PyObject *kwds)
+{
+    if (!PyArg_ParseTuple(args, ":Decoder")) {
+        return -1;
+    }
+    self->framing = FRAMING_SLIP;
+    self->crc_errors = 0;
+    memset(&self->seq, 0, sizeof(self->seq));
+    self->pending.len = 0;
+    return 0;
+}
+
+static void Decoder_dealloc(DecoderObject *self)
+{
+    buf_free(&self->pending);
+    buf_free(&self->scratch);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyMethodDef Decoder_methods[] = {
+    { "feed", (PyCFunction)Decoder_feed, METH_O,
+      "feed(data) -> PacketBatch: decode a chunk of the serial stream" },
+    { NULL, NULL, 0, NULL },
+};
+
+static PyMemberDef Decoder_members[] = {
+    { "crc_errors", T_PYSSIZET, offsetof(DecoderObject, crc_errors), 0,
+      "LEN frames dropped for a bad CRC" },
+    { "seq_received", T_PYSSIZET, offsetof(DecoderObject, seq.received), READONLY,
+      "PKTHDR 2 packets decoded" },
+    { "seq_lost", T_PYSSIZET, offsetof(DecoderObject, seq.lost), READONLY,
+      "PKTHDR 2 packets missing from the sequence" },
+    { "seq_resets", T_PYSSIZET, offsetof(DecoderObject, seq.resets), READONLY,
+      "times the sequence went back (device restart)" },
+    { NULL, 0, 0, 0, NULL },
+};
+
+static PyGetSetDef Decoder_getset[] = {
+    { "framing", (getter)Decoder_get_framing, (setter)Decoder_set_framing,
+      "current wire framing, 'SLIP' or 'LEN'", NULL },
+    { NULL, NULL, NULL, NULL, NULL },
+};
+
+static PyTypeObject DecoderType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name      = "_sniffdecode.Decoder",
+    .tp_doc       = "Stateful SLIP/LEN stream decoder returning packet batches",
+    .tp_basicsize = sizeof(DecoderObject),
+    .tp_flags     = Py_TPFLAGS_DEFAULT,
+    .tp_new       = PyType_GenericNew,
+    .tp_init      = (initproc)Decoder_init,
+    .tp_dealloc   = (destructor)Decoder_dealloc,
+    .tp_methods   = Decoder_methods,
+    .tp_members   = Decoder_members,
+    .tp_getset    = Decoder_getset,
+};
+
+static struct PyModuleDef s_module = {
+    PyModuleDef_HEAD_INIT,
+    "_sniffdecode",
+    "Native frame decoder for the 5dra sniffer host tools",
+    -1,
+    NULL,
+};
+
+PyMODINIT_FUNC PyInit__sniffdecode(void)
+{
+    crc_init();
+
+    if (PyType_Ready(&DecoderType) < 0) {
+        return NULL;
+    }
+    if (PacketBatchType.tp_name == NULL &&
+        PyStructSequence_InitType2(&PacketBatchType, &s_batch_desc) < 0) {
+        return NULL;
+    }
+
+    PyObject *m = PyModule_Create(&s_module);
+    if (!m) {
+        return NULL;
+    }
+    Py_INCREF(&DecoderType);
+    if (PyModule_AddObject(m, "Decoder", (PyObject *)&DecoderType) < 0) {
+        Py_DECREF(&DecoderType);
+        Py_DECREF(m);
+        return NULL;
+    }
+    Py_INCREF(&PacketBatchType);
+    if (PyModule_AddObject(m, "PacketBatch", (PyObject *)&PacketBatchType) < 0) {
+        Py_DECREF(&PacketBatchType);
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
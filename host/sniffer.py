@@ -2,40 +2,119 @@
 """
 5dra WiFi Packet Sniffer — Host CLI
 
-Reads SLIP-encoded 802.11 frames from ESP32-C5 over USB CDC,
-displays live packet info, and writes PCAP files.
+Reads SLIP or length-prefixed 802.11 frames from ESP32-C5 over USB CDC,
+displays live packet info, and writes PCAPNG files.
 
 Usage:
-    python sniffer.py /dev/cu.usbmodem* -c 6 -w capture.pcap
+    python sniffer.py /dev/cu.usbmodem* -c 6 -w capture.pcapng
     python sniffer.py /dev/cu.usbmodem* --filter mgmt --snaplen 128
+    python sniffer.py /dev/cu.usbmodem* --snaplen "MGMT 0 DATA HDR CTRL HDR"
 """
 
 import argparse
+import csv
+import heapq
+import itertools
+import json
+import math
+import os
 import struct
 import sys
 import threading
 import time
+import zlib
+from collections import OrderedDict, deque
 import serial
 
+try:
+    import lz4.block as lz4_block
+except ImportError:
+    lz4_block = None
+
+try:
+    import _sniffdecode        # python3 setup.py build_ext --inplace
+except ImportError:
+    _sniffdecode = None
+
 # --- SLIP constants ---
 SLIP_END     = 0xC0
 SLIP_ESC     = 0xDB
 SLIP_ESC_END = 0xDC
 SLIP_ESC_ESC = 0xDD
 
+# --- Length-prefixed framing (FRAMING LEN) ---
+LEN_SYNC      = b"\xA5\x5A"
+LEN_MAX_FRAME = 8192
+
+# FLOW credit window requested by the host tools (bytes of frame payload)
+FLOW_WINDOW = 32768
+FLOW_IDLE_S = 5.0             # Silence after which FLOW is re-sent, in case credit leaked
+
 # --- Message types ---
 MSG_TYPE_PACKET   = 0x01
 MSG_TYPE_RESPONSE = 0x02
 MSG_TYPE_LOG      = 0x03
+MSG_TYPE_BATCH    = 0x04
+MSG_TYPE_BEACON_SUMMARY = 0x05
+MSG_TYPE_STATS    = 0x06
+MSG_TYPE_PACKET_V2 = 0x07   # PKTHDR 2: parsed as MSG_TYPE_PACKET with "seq"
+MSG_TYPE_PRESENCE = 0x08
 
-# --- Packet flags ---
+# A sequence number further back than this is a device restart, not a gap
+SEQ_RESET_GAP = 1 << 31
+
+# MSG_TYPE_STATS record (protocol.h stats_record_t)
+STATS_FIELDS = (
+    "version", "interval_ms", "uptime_ms", "captured", "drop_ring_full",
+    "drop_usb", "usb_timeouts", "usb_bytes_per_s", "ring_size", "ring_hwm",
+    "ring_used", "cb_count", "cb_cycles_min", "cb_cycles_avg",
+    "cb_cycles_max", "switch_count", "switch_us", "free_heap",
+    "shed_truncated", "shed_dropped", "flow_waits", "flow_credit",
+    "drop_raw_full", "filtered", "raw_size", "raw_hwm",
+)
+STATS_STRUCT = struct.Struct("<BBH19Ii4I")
+
+# --- Packet flags (also used in batch header flags) ---
 PKT_FLAG_COMPRESSED = 0x01
 
-# --- PCAP constants ---
-PCAP_MAGIC     = 0xA1B2C3D4
-PCAP_VERSION   = (2, 4)
+# --- PCAPNG constants ---
 PCAP_SNAPLEN   = 65535
-PCAP_LINKTYPE  = 105  # LINKTYPE_IEEE802_11
+LINKTYPE_IEEE802_11_RADIOTAP = 127
+PCAPNG_SHB     = 0x0A0D0D0A   # Section Header Block
+PCAPNG_IDB     = 0x00000001   # Interface Description Block
+PCAPNG_EPB     = 0x00000006   # Enhanced Packet Block
+PCAPNG_OPT_END = 0
+PCAPNG_OPT_COMMENT = 1
+PCAPNG_OPT_IF_NAME = 2
+PCAPNG_OPT_SHB_USERAPPL = 4
+PCAPNG_OPT_IF_TSRESOL = 9
+
+# Writer thread pacing
+PCAPNG_FLUSH_S     = 0.5
+PCAPNG_FLUSH_BYTES = 1 << 20
+PCAPNG_FSYNC_S     = 5.0
+PCAPNG_MAX_PENDING = 200000   # Queued records before new ones are dropped
+PCAPNG_DEDUP_HOLD_US = 500_000   # How long the writer waits for other devices' copies
+CLOCK_MAX_SKEW_US  = 2_000_000
+
+# TIMESYNC: offset/drift fit per device
+CLOCK_MAX_DRIFT      = 200e-6       # Beyond any crystal: a bad fit, clamp it
+TIMESYNC_INTERVAL_S  = 10.0
+TIMESYNC_FAST_S      = 1.0          # ...for the first TIMESYNC_FAST_COUNT exchanges
+TIMESYNC_FAST_COUNT  = 5
+TIMESYNC_SAMPLES     = 32           # Exchanges kept for the fit
+TIMESYNC_MIN_SPAN_US = 20_000_000   # Device time the samples must span to fit drift
+
+# Multi-device streams
+MERGE_LATENCY_S = 0.25      # Longest a packet waits for the other devices' streams
+DEDUP_WINDOW_MS = 10        # Copies of one frame from different devices, --dedup-ms
+
+# Radiotap header: version, pad, length, present, Flags, (align), channel
+# frequency, channel flags, dBm antenna signal
+RADIOTAP_HDR = struct.Struct("<BBHIBxHHb")
+RADIOTAP_PRESENT = (1 << 1) | (1 << 3) | (1 << 5)
+RADIOTAP_CHAN_2GHZ = 0x0080
+RADIOTAP_CHAN_5GHZ = 0x0100
 
 # --- 802.11 frame type/subtype names ---
 FRAME_TYPES = {
@@ -63,6 +142,23 @@ FRAME_TYPES = {
     (2, 12): "QoS Null",
 }
 
+# Streaming analytics (Aggregates)
+AGG_MAX_BSSIDS = 4096
+AGG_MAX_STATIONS = 16384
+AGG_MAX_PROBED = 8                        # Probed SSIDs remembered per station
+AGG_RSSI_ALPHA = 1 / 16                   # RSSI EMA weight of a new frame
+AGG_SSID_OFFSET = {4: 24, 5: 36, 8: 36}   # Mgmt subtype -> first IE: ProbeReq, ProbeResp, Beacon
+AGG_BSS_FIELDS = ("bssid", "ssid", "channel", "beacons", "frames", "data", "retries",
+                  "rssi", "stations", "first_seen", "last_seen")
+AGG_STA_FIELDS = ("mac", "bssid", "frames", "data", "retries", "probes", "ssids",
+                  "rssi", "seq", "first_seen", "last_seen")
+AGG_SNAPSHOT_S = 60                       # Default --snapshot-s
+
+# PRESENCE summaries (protocol.h presence_header_t)
+PRESENCE_HEADER = struct.Struct("<BBBBBBBBIIII")
+PRESENCE_FLAG_EXACT_FULL = 0x01
+PRESENCE_GRACE_US = 2_000_000             # Extra wait for the devices' records of a window
+
 
 def format_mac(raw):
     """Format 6 bytes as a MAC address string."""
@@ -87,75 +183,1129 @@ def classify_frame(payload):
     return name, da, sa
 
 
-class SLIPDecoder:
-    """Stateful SLIP byte-stream decoder."""
+def dissect_frame(payload):
+    """MAC header fields for the aggregate tables, or None for frames
+    with no BSS to file them under (control, WDS, shorter than a header).
+
+    Returns (frame_type, subtype, retry, seq, bssid, transmitter, station,
+    ssid). Addresses are raw 6-byte values; bssid and station are None
+    when they are group addresses. ssid is set for beacons, probe
+    responses and probe requests whose SSID element was captured.
+    """
+    if len(payload) < 24:
+        return None
+    fc0, fc1 = payload[0], payload[1]
+    frame_type = (fc0 >> 2) & 0x03
+    subtype = fc0 >> 4
+    retry = (fc1 >> 3) & 1
+    seq = (payload[22] | payload[23] << 8) >> 4
+    a1, a2, a3 = payload[4:10], payload[10:16], payload[16:22]
+
+    ssid = None
+    if frame_type == 0:
+        bssid, station = a3, (a2 if a2 != a3 else None)
+        ies = AGG_SSID_OFFSET.get(subtype)
+        if ies and len(payload) >= ies + 2 and payload[ies] == 0:
+            ssid = payload[ies + 2:ies + 2 + payload[ies + 1]].decode("utf-8", "replace")
+    elif frame_type == 2:
+        ds = fc1 & 0x03
+        if ds == 1:          # To DS: station -> AP
+            bssid, station = a1, a2
+        elif ds == 2:        # From DS: AP -> station
+            bssid, station = a2, a1
+        elif ds == 0:        # IBSS
+            bssid, station = a3, a2
+        else:
+            return None
+    else:
+        return None
+
+    if bssid[0] & 1:
+        bssid = None
+    if station is not None and station[0] & 1:
+        station = None
+    return frame_type, subtype, retry, seq, bssid, a2, station, ssid
+
+
+class BssAggregate:
+    __slots__ = ("ssid", "channel", "beacons", "frames", "data", "retries",
+                 "rssi", "stations", "first_us", "last_us")
+
+    def __init__(self, now_us):
+        self.ssid = None
+        self.channel = 0
+        self.beacons = self.frames = self.data = self.retries = 0
+        self.rssi = None          # EMA over frames the AP sent
+        self.stations = 0         # Stations seen associating with it
+        self.first_us = now_us
+        self.last_us = now_us
+
+
+class StationAggregate:
+    __slots__ = ("bssid", "frames", "data", "retries", "probes", "ssids",
+                 "rssi", "seq", "first_us", "last_us")
+
+    def __init__(self, now_us):
+        self.bssid = None
+        self.frames = self.data = self.retries = self.probes = 0
+        self.ssids = []           # Probed SSIDs, first AGG_MAX_PROBED
+        self.rssi = None          # EMA over frames the station sent
+        self.seq = None           # Last sequence number it sent
+        self.first_us = now_us
+        self.last_us = now_us
+
+
+def _ema(old, value):
+    return value if old is None else old + (value - old) * AGG_RSSI_ALPHA
+
+
+class Aggregates:
+    """Per-BSSID and per-station tables, updated once per packet.
+
+    Each table is an LRU bounded by max_bssids / max_stations: when full,
+    the entry heard from least recently is evicted. Frames are filed under
+    their BSS; transmitter-side figures (RSSI, retries, sequence number)
+    only count frames the AP or station sent itself. The lock lets another
+    thread take snapshots while the reader updates.
+    """
+
+    def __init__(self, max_bssids=AGG_MAX_BSSIDS, max_stations=AGG_MAX_STATIONS):
+        self._bss = OrderedDict()
+        self._sta = OrderedDict()
+        self._max_bss = max_bssids
+        self._max_sta = max_stations
+        self._lock = threading.Lock()
+        self.evicted = 0
+
+    def _entry(self, table, key, cls, limit, now_us):
+        entry = table.get(key)
+        if entry is None:
+            if len(table) >= limit:
+                table.popitem(last=False)
+                self.evicted += 1
+            entry = table[key] = cls(now_us)
+        else:
+            table.move_to_end(key)
+        entry.last_us = now_us
+        return entry
+
+    def add(self, payload, channel, rssi, unix_us):
+        fields = dissect_frame(payload)
+        if fields is None:
+            return
+        frame_type, subtype, retry, seq, bssid, tx, station, ssid = fields
+        is_data = frame_type == 2
+
+        with self._lock:
+            bss = None
+            if bssid is not None:
+                bss = self._entry(self._bss, bssid, BssAggregate, self._max_bss, unix_us)
+                bss.frames += 1
+                bss.data += is_data
+                bss.retries += retry
+                if tx == bssid:
+                    bss.channel = channel
+                    bss.rssi = _ema(bss.rssi, rssi)
+                    if frame_type == 0 and subtype in (5, 8):
+                        bss.beacons += subtype == 8
+                        if ssid is not None:
+                            bss.ssid = ssid
+
+            if station is None:
+                return
+            sta = self._entry(self._sta, station, StationAggregate, self._max_sta, unix_us)
+            # Data frames and (re)association requests tie it to the BSS
+            if bss is not None and sta.bssid != bssid and (is_data or subtype in (0, 2)):
+                old = self._bss.get(sta.bssid) if sta.bssid else None
+                if old is not None and old.stations:
+                    old.stations -= 1
+                sta.bssid = bssid
+                bss.stations += 1
+            if tx != station:
+                return
+            sta.frames += 1
+            sta.data += is_data
+            sta.retries += retry
+            sta.rssi = _ema(sta.rssi, rssi)
+            sta.seq = seq
+            if frame_type == 0 and subtype == 4:
+                sta.probes += 1
+                if ssid and ssid not in sta.ssids and len(sta.ssids) < AGG_MAX_PROBED:
+                    sta.ssids.append(ssid)
+
+    def snapshot(self, limit=None):
+        """(bssid rows, station rows) as dicts, most recently heard first."""
+        with self._lock:
+            bss = [(k, v.ssid, v.channel, v.beacons, v.frames, v.data, v.retries,
+                    v.rssi, v.stations, v.first_us, v.last_us)
+                   for k, v in itertools.islice(reversed(self._bss.items()), limit)]
+            sta = [(k, v.bssid, v.frames, v.data, v.retries, v.probes, list(v.ssids),
+                    v.rssi, v.seq, v.first_us, v.last_us)
+                   for k, v in itertools.islice(reversed(self._sta.items()), limit)]
+
+        bss_rows = [{
+            "bssid": format_mac(k), "ssid": ssid, "channel": ch, "beacons": beacons,
+            "frames": frames, "data": data, "retries": retries,
+            "rssi": round(rssi) if rssi is not None else None, "stations": stations,
+            "first_seen": first / 1e6, "last_seen": last / 1e6,
+        } for k, ssid, ch, beacons, frames, data, retries, rssi, stations, first, last in bss]
+        sta_rows = [{
+            "mac": format_mac(k), "bssid": format_mac(bssid) if bssid else None,
+            "frames": frames, "data": data, "retries": retries, "probes": probes,
+            "ssids": ssids, "rssi": round(rssi) if rssi is not None else None,
+            "seq": seq, "first_seen": first / 1e6, "last_seen": last / 1e6,
+        } for k, bssid, frames, data, retries, probes, ssids, rssi, seq, first, last in sta]
+        return bss_rows, sta_rows
+
+
+def write_snapshot(path, bss_rows, sta_rows):
+    """Write the tables to path: one JSON document, or for a .csv path
+    <root>-bssids.csv and <root>-stations.csv. Written to a temporary
+    file and renamed, so readers never see a partial snapshot."""
+    def replace(target, write):
+        tmp = target + ".tmp"
+        with open(tmp, "w", newline="") as f:
+            write(f)
+        os.replace(tmp, target)
+
+    root, ext = os.path.splitext(path)
+    if ext.lower() != ".csv":
+        replace(path, lambda f: json.dump(
+            {"time": time.time(), "bssids": bss_rows, "stations": sta_rows}, f))
+        return
+    for name, rows, fields in (("bssids", bss_rows, AGG_BSS_FIELDS),
+                               ("stations", sta_rows, AGG_STA_FIELDS)):
+        def write(f, rows=rows, fields=fields):
+            out = csv.DictWriter(f, fieldnames=fields)
+            out.writeheader()
+            for row in rows:
+                out.writerow(dict(row, ssids="|".join(row["ssids"])) if "ssids" in row else row)
+        replace(f"{root}-{name}.csv", write)
+
+
+def hll_estimate(registers):
+    """HyperLogLog cardinality of a register array, with linear counting
+    for the small range."""
+    m = len(registers)
+    estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum(2.0 ** -r for r in registers)
+    zeros = registers.count(0)
+    if estimate <= 2.5 * m and zeros:
+        estimate = m * math.log(m / zeros)
+    return estimate
+
+
+class PresenceTally:
+    """Stations of one channel, or of all channels, in one fleet window."""
+
+    __slots__ = ("registers", "stations", "exact", "probes")
 
     def __init__(self):
-        self._buf = bytearray()
-        self._escape = False
+        self.registers = None
+        self.stations = set()
+        self.exact = True         # stations is every station heard
+        self.probes = 0
+
+    def merge(self, rec):
+        regs = rec["registers"]
+        if self.registers is None:
+            self.registers = bytearray(regs)
+        elif len(regs) == len(self.registers):
+            self.registers = bytearray(map(max, self.registers, regs))
+        else:
+            self.exact = False    # Sketch sizes differ: keep ours
+        self.stations.update(rec["stations"])
+        self.exact = self.exact and rec["exact"]
+        self.probes += rec["probes"]
+
+    def count(self):
+        if self.exact or self.registers is None:
+            return len(self.stations)
+        return max(len(self.stations), round(hll_estimate(self.registers)))
+
+    def summary(self):
+        return {"stations": self.count(), "exact": self.exact, "probes": self.probes}
+
+
+class PresenceCounter:
+    """Merge MSG_TYPE_PRESENCE records of any number of devices into fleet
+    windows of window_ms aligned to Unix time.
+
+    A device window goes to the fleet window holding its midpoint, so each
+    device contributes about one window to each. The union over devices and
+    channels is exact while every list is complete, and otherwise the
+    HyperLogLog estimate of the merged registers. pop_ready() hands out a
+    window once every device's record for it must have arrived.
+    """
+
+    def __init__(self, window_ms):
+        self.window_us = window_ms * 1000
+        self._windows = {}        # window index -> (devices, {channel: tally}, total tally)
+        self._done = None         # Windows below this index were handed out
+        self.late = 0             # Records for a window already handed out
+
+    def add(self, device, rec, end_us):
+        """Take one parse_frame() presence record from device, whose window
+        ended at end_us (Unix)."""
+        index = (end_us - rec["window_ms"] * 500) // self.window_us
+        if self._done is not None and index < self._done:
+            self.late += 1
+            return
+        devices, channels, total = self._windows.setdefault(index, (set(), {}, PresenceTally()))
+        devices.add(device)
+        if rec["channel"]:
+            channels.setdefault(rec["channel"], PresenceTally()).merge(rec)
+            total.merge(rec)
+
+    def pop_ready(self, now_us=None):
+        """Finished windows, oldest first: dicts of start_us, window_ms,
+        devices, stations, exact, probes and per-channel summaries."""
+        if now_us is None:
+            now_us = int(time.time() * 1_000_000)
+        ready = []
+        for index in sorted(self._windows):
+            end = (index + 1) * self.window_us
+            if now_us < end + self.window_us // 2 + PRESENCE_GRACE_US:
+                break
+            devices, channels, total = self._windows.pop(index)
+            self._done = index + 1
+            ready.append(dict(total.summary(), start_us=index * self.window_us,
+                              window_ms=self.window_us // 1000,
+                              devices=sorted(devices),
+                              channels={ch: t.summary() for ch, t in sorted(channels.items())}))
+        return ready
+
+
+def format_presence(window):
+    """One line per fleet window; ~ marks HyperLogLog estimates."""
+    def count(s):
+        return f"{s['stations']}{'' if s['exact'] else '~'}"
+    start = time.strftime("%H:%M:%S", time.localtime(window["start_us"] / 1e6))
+    text = (f"{start} {window['window_ms'] / 1000:g}s {len(window['devices'])} dev: "
+            f"{count(window)} stations, {window['probes']} probes")
+    if window["channels"]:
+        text += " | " + " ".join(f"ch{ch} {count(s)}" for ch, s in window["channels"].items())
+    return text
+
+
+class FrameDecoder:
+    """Stateful stream decoder for both wire framings.
+
+    SLIP (default): frames delimited by 0xC0, escapes undone with
+    bytes.replace. LEN: sync word, <H> length, payload, <I> CRC-32 of
+    length + payload, sliced out of a memoryview.
+
+    The firmware answers FRAMING with "OK FRAMING <mode>" in the old framing
+    and switches right after it, so the decoder switches at that exact
+    point in the stream.
+    """
+
+    def __init__(self):
+        self.framing = "SLIP"
+        self.crc_errors = 0
+        self.seq_received = 0
+        self.seq_lost = 0
+        self.seq_resets = 0
+        self._seq = None
+        self._buf = b""
+
+    def note_seq(self, seq):
+        """Count a PKTHDR 2 sequence number. The native decoder does this
+        itself; with this one the caller passes the "seq" of every parsed
+        packet."""
+        if self._seq is not None:
+            gap = (seq - self._seq - 1) & 0xFFFFFFFF
+            if gap < SEQ_RESET_GAP:
+                self.seq_lost += gap
+            else:
+                self.seq_resets += 1
+        self._seq = seq
+        self.seq_received += 1
 
     def feed(self, data):
-        """Feed raw bytes, yield complete SLIP frames."""
+        """Feed raw bytes, return a list of complete frames."""
         frames = []
-        for b in data:
-            if b == SLIP_END:
-                if len(self._buf) > 0:
-                    frames.append(bytes(self._buf))
-                    self._buf = bytearray()
-                self._escape = False
-            elif b == SLIP_ESC:
-                self._escape = True
-            elif self._escape:
-                if b == SLIP_ESC_END:
-                    self._buf.append(SLIP_END)
-                elif b == SLIP_ESC_ESC:
-                    self._buf.append(SLIP_ESC)
-                else:
-                    self._buf.append(b)  # malformed, pass through
-                self._escape = False
+        data = self._buf + data
+        self._buf = b""
+        while data:
+            if self.framing == "LEN":
+                data = self._feed_len(data, frames)
             else:
-                self._buf.append(b)
+                data = self._feed_slip(data, frames)
+            if data is None:
+                break
         return frames
 
+    def _switch(self, frame):
+        """Return True if frame is a framing change acknowledgement."""
+        if frame[:1] != bytes([MSG_TYPE_RESPONSE]):
+            return False
+        text = frame[1:].decode("utf-8", errors="replace")
+        if text.startswith("OK FRAMING "):
+            self.framing = text.split()[-1]
+            return True
+        return False
+
+    def _feed_slip(self, data, frames):
+        start = 0
+        while True:
+            end = data.find(SLIP_END, start)
+            if end < 0:
+                self._buf = data[start:]
+                return None
+            if end > start:
+                frame = (data[start:end]
+                         .replace(bytes([SLIP_ESC, SLIP_ESC_END]), bytes([SLIP_END]))
+                         .replace(bytes([SLIP_ESC, SLIP_ESC_ESC]), bytes([SLIP_ESC])))
+                frames.append(frame)
+                if self._switch(frame):
+                    return data[end + 1:]
+            start = end + 1
+
+    def _feed_len(self, data, frames):
+        view = memoryview(data)
+        pos = 0
+        n = len(data)
+        while True:
+            if n - pos < 4:
+                break
+            if data[pos] != LEN_SYNC[0] or data[pos + 1] != LEN_SYNC[1]:
+                nxt = data.find(LEN_SYNC, pos + 1)
+                if nxt < 0:
+                    pos = n - 1
+                    break
+                pos = nxt
+                continue
+            length = data[pos + 2] | (data[pos + 3] << 8)
+            if length > LEN_MAX_FRAME:
+                pos += 1
+                continue
+            end = pos + 4 + length + 4
+            if end > n:
+                break
+            crc = int.from_bytes(view[end - 4:end], "little")
+            if zlib.crc32(view[pos + 2:end - 4]) != crc:
+                self.crc_errors += 1
+                pos += 1
+                continue
+            frame = bytes(view[pos + 4:end - 4])
+            frames.append(frame)
+            pos = end
+            if self._switch(frame):
+                return data[pos:]
+        self._buf = data[pos:]
+        return None
+
+
+class CreditTracker:
+    """Host side of FLOW/CREDIT flow control.
+
+    Counts the payload bytes of every decoded frame and hands them back to
+    the firmware as CREDIT in window/4 steps. Stays inactive until the
+    device acknowledges FLOW, so older firmware never sees CREDIT. Frames
+    that never arrive whole would leak credit, so FLOW is re-sent, which
+    resets the device's balance: on a CRC error or a PKTHDR 2 sequence gap
+    here, on a malformed frame (resync()), and after FLOW_IDLE_S without
+    data (poll(), called from the read loop), which is also how a balance
+    already used up recovers.
+    """
+
+    def __init__(self, window, send):
+        self.window = window
+        self.active = False
+        self._send = send
+        self._pending = 0
+        self._crc_errors = 0
+        self._seq_lost = 0
+        self._last_data = time.monotonic()
+
+    def note_response(self, text):
+        if text.startswith("OK FLOW "):
+            self.active = text.split()[-1] != "0"
+            self._pending = 0
+
+    def resync(self):
+        if self.active:
+            self._pending = 0
+            self._send(f"FLOW {self.window}")
+
+    def poll(self):
+        now = time.monotonic()
+        if self.active and now - self._last_data >= FLOW_IDLE_S:
+            self._last_data = now
+            self.resync()
+
+    def consumed(self, nbytes, decoder):
+        self._last_data = time.monotonic()
+        if not self.active:
+            return
+        if decoder.crc_errors != self._crc_errors or decoder.seq_lost != self._seq_lost:
+            self._crc_errors = decoder.crc_errors
+            self._seq_lost = decoder.seq_lost
+            self.resync()
+            return
+        self._pending += nbytes
+        if self._pending >= self.window // 4:
+            self._send(f"CREDIT {self._pending}")
+            self._pending = 0
+
+
+def make_decoder():
+    """The native _sniffdecode.Decoder if it is built, else FrameDecoder."""
+    return _sniffdecode.Decoder() if _sniffdecode else FrameDecoder()
+
+
+def feed_decoder(decoder, data):
+    """Feed a chunk to either decoder, return (frames, packets, nbytes).
+
+    frames go to parse_frame(). packets is the native decoder's PacketBatch
+    (struct-of-arrays MSG_TYPE_PACKET records, batches already expanded,
+    decoded after the frames of the same chunk); None for FrameDecoder,
+    whose packets stay in frames. nbytes is for CreditTracker.consumed.
+    """
+    if isinstance(decoder, FrameDecoder):
+        frames = decoder.feed(data)
+        return frames, None, sum(len(f) for f in frames)
+    batch = decoder.feed(data)
+    return batch.others, batch, batch.consumed
+
+
+def format_seq(decoder):
+    """Transport loss from PKTHDR 2 sequence numbers, or "" before any."""
+    if not decoder.seq_received:
+        return ""
+    total = decoder.seq_received + decoder.seq_lost
+    text = (f"seq rx={decoder.seq_received} lost={decoder.seq_lost} "
+            f"({decoder.seq_lost * 100 / total:.3f}%)")
+    if decoder.seq_resets:
+        text += f" resets={decoder.seq_resets}"
+    return text
+
+
+def batch_packets(batch):
+    """Yield (channel, rssi, timestamp, payload) for each packet of a
+    PacketBatch."""
+    buf = batch.buf
+    rssi = memoryview(batch.rssi).cast("b")
+    timestamp = memoryview(batch.timestamp).cast("Q")
+    offset = memoryview(batch.offset).cast("I")
+    length = memoryview(batch.length).cast("H")
+    for i, channel in enumerate(batch.channel):
+        yield channel, rssi[i], timestamp[i], buf[offset[i]:offset[i] + length[i]]
+
+
+class DeviceClock:
+    """Map the firmware's 32-bit microsecond rx timestamp onto Unix time.
+
+    The counter is extended to 64 bits across its wrap (~71.6 min). Once
+    TIMESYNC replies arrive, offset and drift come from a least-squares fit
+    over the lowest-RTT exchanges of the last TIMESYNC_SAMPLES; before that
+    the clock is anchored to the host clock at the first packet. Either way
+    it re-anchors when a mapped time strays more than CLOCK_MAX_SKEW_US from
+    the host clock, e.g. after a device reset.
+    """
+
+    def __init__(self):
+        self._ext = None          # Newest device time seen, extended to 64 bits
+        self._anchor = None       # host - device offset before the first fit
+        self._samples = deque(maxlen=TIMESYNC_SAMPLES)  # (device, host, rtt) us
+        self._fit = None          # (device ref, offset at ref, drift)
+        self._next_sync = 0.0
+        self._outstanding = False
+        self.supported = True     # False once the firmware rejects TIMESYNC
+        self.syncs = 0
+        self.rtt_us = None        # RTT of the best sample in the fit
+
+    @property
+    def offset_us(self):
+        return self._fit[1] if self._fit else None
+
+    @property
+    def drift_ppm(self):
+        """How much faster the device clock runs than the host's."""
+        return -self._fit[2] * 1e6 if self._fit else None
+
+    def extend(self, ts):
+        """64-bit device time for ts, which may be a little older than the
+        newest timestamp seen (e.g. a beacon summary). PKTHDR 2 timestamps
+        are extended on the device already and taken as they are."""
+        if ts > 0xFFFFFFFF:
+            self._ext = ts if self._ext is None else max(self._ext, ts)
+            return ts
+        if self._ext is None:
+            self._ext = ts
+            return ts
+        ext = self._ext + ((ts - self._ext + (1 << 31)) & 0xFFFFFFFF) - (1 << 31)
+        if ext > self._ext:
+            self._ext = ext
+        return ext
+
+    def _map(self, ext):
+        if self._fit:
+            ref, offset, drift = self._fit
+            return int(ext + offset + (ext - ref) * drift)
+        if self._anchor is not None:
+            return ext + self._anchor
+        return None
+
+    def _reset(self, ts, now):
+        self._ext = ts
+        self._anchor = now - ts
+        self._samples.clear()
+        self._fit = None
+
+    def to_unix_us(self, ts):
+        now = int(time.time() * 1_000_000)
+        t = self._map(self.extend(ts))
+        if t is not None and abs(t - now) < CLOCK_MAX_SKEW_US:
+            return t
+        self._reset(ts, now)
+        return now
+
+    def sync_request(self):
+        """TIMESYNC command to send now, or None if not yet due. The token
+        is the host send time, so replies need no bookkeeping."""
+        mono = time.monotonic()
+        if not self.supported or mono < self._next_sync:
+            return None
+        fast = self.syncs < TIMESYNC_FAST_COUNT
+        self._next_sync = mono + (TIMESYNC_FAST_S if fast else TIMESYNC_INTERVAL_S)
+        self._outstanding = True
+        return f"TIMESYNC {int(time.time() * 1_000_000)}"
+
+    def note_response(self, text, recv_us=None):
+        """Take an "OK TIMESYNC <token> <device us>" reply, received at
+        recv_us. Returns True if text was one."""
+        if not text.startswith("OK TIMESYNC "):
+            if self._outstanding and text == "ERR unknown command":
+                self.supported = False     # Older firmware
+            return False
+        self._outstanding = False
+        try:
+            sent_us, ts = (int(v) for v in text.split()[2:4])
+        except ValueError:
+            return True
+        if recv_us is None:
+            recv_us = int(time.time() * 1_000_000)
+        rtt = recv_us - sent_us
+        if rtt < 0 or rtt > CLOCK_MAX_SKEW_US:
+            return True
+        host = sent_us + rtt // 2
+        ext = self.extend(ts)
+        t = self._map(ext)
+        if t is not None and abs(t - host) >= CLOCK_MAX_SKEW_US:
+            self._reset(ts, host)
+            ext = ts
+        self._samples.append((ext, host, rtt))
+        self.syncs += 1
+        self._refit()
+        return True
+
+    def _refit(self):
+        # Queueing behind capture traffic only ever delays a reply, so the
+        # fastest exchanges are the most accurate ones
+        best = sorted(self._samples, key=lambda s: s[2])
+        best = best[:max(2, len(best) // 2)]
+        self.rtt_us = best[0][2]
+        ref = best[0][0]
+        xs = [dev - ref for dev, _, _ in best]
+        ys = [host - dev for dev, host, _ in best]
+        n = len(best)
+        mean_x = sum(xs) / n
+        mean_y = sum(ys) / n
+        var = sum((x - mean_x) ** 2 for x in xs)
+        drift = 0.0
+        if var > 0 and max(xs) - min(xs) >= TIMESYNC_MIN_SPAN_US:
+            cov = sum((x - mean_x) * (y - mean_y) for x, y in zip(xs, ys))
+            drift = max(-CLOCK_MAX_DRIFT, min(CLOCK_MAX_DRIFT, cov / var))
+        if drift:
+            offset = mean_y - drift * mean_x
+        else:
+            offset = ys[0]
+        self._fit = (ref, offset, drift)
+
+
+class StreamMerger:
+    """k-way merge of per-device packet streams by corrected timestamp.
+
+    Each device's records arrive in timestamp order, so only the queue
+    heads need comparing. The oldest head is released once no device can
+    still send anything older (every device's newest timestamp is past it)
+    or once it is MERGE_LATENCY_S old, so a quiet device holds the stream
+    back by at most that much. `late` counts records released after a
+    newer one had already gone out.
+    """
+
+    def __init__(self, latency_s=MERGE_LATENCY_S):
+        self._latency = latency_s
+        self._queues = {}   # source -> deque of (timestamp, record)
+        self._marks = {}    # source -> newest timestamp pushed
+        self._heap = []     # (head timestamp, tiebreak, source), one per non-empty queue
+        self._tiebreak = 0
+        self._released = 0.0
+        self.late = 0
+
+    def add(self, source):
+        """Wait for source from now on, even before its first record."""
+        self._marks.setdefault(source, 0.0)
+
+    def push(self, source, timestamp, record):
+        q = self._queues.get(source)
+        if q is None:
+            q = self._queues[source] = deque()
+        if not q:
+            self._push_head(source, timestamp)
+        q.append((timestamp, record))
+        if timestamp > self._marks.get(source, 0.0):
+            self._marks[source] = timestamp
+
+    def _push_head(self, source, timestamp):
+        self._tiebreak += 1
+        heapq.heappush(self._heap, (timestamp, self._tiebreak, source))
+
+    def drop(self, source):
+        """Stop waiting for source; what it already queued still goes out."""
+        self._marks.pop(source, None)
+
+    def clear(self):
+        self._queues.clear()
+        self._heap.clear()
+        self._released = 0.0
+
+    def pop_ready(self, now=None):
+        """Records that can go out, oldest first."""
+        deadline = (time.time() if now is None else now) - self._latency
+        horizon = min(self._marks.values(), default=deadline)
+        out = []
+        while self._heap:
+            timestamp, _, source = self._heap[0]
+            if timestamp > horizon and timestamp > deadline:
+                break
+            heapq.heappop(self._heap)
+            q = self._queues[source]
+            _, record = q.popleft()
+            if timestamp < self._released:
+                self.late += 1
+            else:
+                self._released = timestamp
+            out.append(record)
+            if q:
+                self._push_head(source, q[0][0])
+            elif source not in self._marks:
+                del self._queues[source]
+        return out
+
+
+class FrameDedup:
+    """Fold copies of one frame captured by several devices into one.
+
+    Copies match on (CRC-32, length) of the payload within window_us of
+    corrected device time. Entries sit in one hash table per window_us
+    time bucket, and a frame looks in its own bucket and both neighbours.
+    A second copy from a source that already gave one is a new transmission
+    (two ACKs to the same station, say), not a duplicate. An entry keeps
+    its best-RSSI copy and every (source, rssi) that saw it, and goes out
+    once pop_ready() is given a horizon past its neighbour bucket.
+    """
+
+    def __init__(self, window_us):
+        self._window = window_us
+        self._buckets = {}   # bucket -> {digest: [entry, ...]}
+        self.suppressed = 0
+
+    def offer(self, digest, ts_us, source, rssi, item):
+        bucket = ts_us // self._window
+        for b in (bucket, bucket - 1, bucket + 1):
+            for entry in self._buckets.get(b, {}).get(digest, ()):
+                # entry: [ts_us, best rssi, best item, [(source, rssi), ...]]
+                if abs(entry[0] - ts_us) > self._window:
+                    continue
+                if any(s == source for s, _ in entry[3]):
+                    continue
+                entry[3].append((source, rssi))
+                if rssi > entry[1]:
+                    entry[1], entry[2] = rssi, item
+                self.suppressed += 1
+                return
+        self._buckets.setdefault(bucket, {}).setdefault(digest, []).append(
+            [ts_us, rssi, item, [(source, rssi)]])
+
+    def pop_ready(self, horizon_us=None):
+        """(best item, seen) for entries settled before horizon_us, oldest
+        bucket first; everything when horizon_us is None."""
+        out = []
+        for bucket in sorted(self._buckets):
+            if horizon_us is not None and (bucket + 2) * self._window > horizon_us:
+                break
+            entries = [e for es in self._buckets.pop(bucket).values() for e in es]
+            entries.sort(key=lambda e: e[0])
+            out.extend((e[2], e[3]) for e in entries)
+        return out
+
+
+def radiotap_header(channel, rssi):
+    """Radiotap header: Flags, Channel (freq + band flags), dBm signal."""
+    if channel >= 36:
+        freq, band = 5000 + 5 * channel, RADIOTAP_CHAN_5GHZ
+    elif channel == 14:
+        freq, band = 2484, RADIOTAP_CHAN_2GHZ
+    else:
+        freq, band = 2407 + 5 * channel, RADIOTAP_CHAN_2GHZ
+    return RADIOTAP_HDR.pack(0, 0, RADIOTAP_HDR.size, RADIOTAP_PRESENT,
+                             0, freq, band, rssi)
+
+
+def pcapng_block(block_type, body):
+    pad = -len(body) % 4
+    total = 12 + len(body) + pad
+    return (struct.pack("<II", block_type, total) + body + bytes(pad) +
+            struct.pack("<I", total))
+
+
+def pcapng_option(code, value):
+    return struct.pack("<HH", code, len(value)) + value + bytes(-len(value) % 4)
+
 
-class PCAPWriter:
-    """Write PCAP files with LINKTYPE_IEEE802_11."""
-
-    def __init__(self, path):
-        self._f = open(path, "wb")
-        # Global header
-        header = struct.pack("<IHHiIII",
-                             PCAP_MAGIC,
-                             PCAP_VERSION[0], PCAP_VERSION[1],
-                             0,              # thiszone
-                             0,              # sigfigs
-                             PCAP_SNAPLEN,
-                             PCAP_LINKTYPE)
-        self._f.write(header)
-        self._f.flush()
-
-    def write_packet(self, payload):
-        """Write a single packet record with current wall-clock timestamp."""
-        now = time.time()
-        ts_sec = int(now)
-        ts_usec = int((now - ts_sec) * 1_000_000)
-        pkt_len = len(payload)
-        record = struct.pack("<IIII", ts_sec, ts_usec, pkt_len, pkt_len)
-        self._f.write(record)
-        self._f.write(payload)
-        self._f.flush()
+class PCAPNGWriter:
+    """PCAPNG writer with one interface per device and radiotap headers.
+
+    write_packet() only queues the record; a writer thread turns each batch
+    into large O_APPEND writes, flushes every PCAPNG_FLUSH_S (or sooner once
+    PCAPNG_FLUSH_BYTES are pending) and fsyncs every PCAPNG_FSYNC_S. If the
+    disk cannot keep up, records beyond PCAPNG_MAX_PENDING are dropped and
+    counted rather than stalling the reader. A write error (a full disk,
+    say) stops the writer: `error` holds the OSError from then on, for the
+    caller to report, and later packets only count as dropped.
+
+    With rotate_bytes and/or rotate_secs the capture is split into
+    <root>-00001<ext>, <root>-00002<ext>, ... Each segment is a complete
+    PCAPNG file (SHB and every interface repeated) with a JSON
+    <segment>.idx next to it: time range, channel set and packet count.
+    keep > 0 deletes all but the newest `keep` segments. Rotation happens
+    on the writer thread, so it never blocks the reader.
+
+    With dedup_us, copies of one frame from different interfaces within
+    dedup_us are written once (FrameDedup), as the best-RSSI copy with a
+    comment listing every interface and RSSI that saw it. Records then
+    wait up to PCAPNG_DEDUP_HOLD_US longer before they are written.
+    """
+
+    def __init__(self, path, rotate_bytes=0, rotate_secs=0, keep=0, dedup_us=0):
+        self._path = path
+        self._rotate_bytes = rotate_bytes
+        self._rotate_secs = rotate_secs
+        self._keep = keep
+        self._segments = []       # Paths of the segments still on disk
+        self._idbs = []           # Interface blocks, repeated in every segment
+        self._fd = None
+        self._seg_no = 0
+
+        self._lock = threading.Lock()
+        self._wake = threading.Event()
+        self._pending = []
+        self._pending_bytes = 0
+        self._interfaces = {}     # name -> interface id
+        self._names = []          # interface id -> name
+        self._dedup = FrameDedup(dedup_us) if dedup_us else None
+        self._closing = False
+        self.packets = 0
+        self.dropped = 0
+        self.error = None         # OSError that stopped the writer thread
+        self._unwritten = 0       # Records formatted but not written yet
+
+        self._open_segment()      # Fail here, not on the writer thread
+        self._thread = threading.Thread(target=self._writer_loop, daemon=True)
+        self._thread.start()
+
+    @property
+    def duplicates(self):
+        """Copies folded into another device's record."""
+        return self._dedup.suppressed if self._dedup else 0
+
+    @property
+    def rotating(self):
+        return bool(self._rotate_bytes or self._rotate_secs)
+
+    def _interface(self, name):
+        """Interface id for name; caller holds the lock."""
+        iface = self._interfaces.get(name)
+        if iface is None:
+            idb = struct.pack("<HHI", LINKTYPE_IEEE802_11_RADIOTAP, 0, PCAP_SNAPLEN)
+            idb += pcapng_option(PCAPNG_OPT_IF_NAME, name.encode())
+            idb += pcapng_option(PCAPNG_OPT_IF_TSRESOL, b"\x06")
+            idb += pcapng_option(PCAPNG_OPT_END, b"")
+            self._pending.append(pcapng_block(PCAPNG_IDB, idb))
+            iface = self._interfaces[name] = len(self._interfaces)
+            self._names.append(name)
+        return iface
+
+    def write_packet(self, interface, unix_us, channel, rssi, payload):
+        """Queue one packet from device `interface` (its port name), stamped
+        with its DeviceClock time in Unix microseconds."""
+        with self._lock:
+            if self.error or len(self._pending) >= PCAPNG_MAX_PENDING:
+                self.dropped += 1
+                return
+            self._pending.append((self._interface(interface), unix_us,
+                                  channel, rssi, payload))
+            self._pending_bytes += len(payload)
+            if self._pending_bytes >= PCAPNG_FLUSH_BYTES:
+                self._wake.set()
+
+    # --- Writer thread ---
+
+    def _open_segment(self):
+        self._seg_no += 1
+        if self.rotating:
+            root, ext = os.path.splitext(self._path)
+            path = f"{root}-{self._seg_no:05d}{ext or '.pcapng'}"
+        else:
+            path = self._path
+        self._seg_path = path
+        self._fd = os.open(path, os.O_WRONLY | os.O_CREAT | os.O_TRUNC | os.O_APPEND, 0o644)
+        self._seg_opened = time.monotonic()
+        self._seg_packets = 0
+        self._seg_first = self._seg_last = None
+        self._seg_channels = set()
+
+        shb = struct.pack("<IHHq", 0x1A2B3C4D, 1, 0, -1)
+        shb += pcapng_option(PCAPNG_OPT_SHB_USERAPPL, b"5dra sniffer")
+        shb += pcapng_option(PCAPNG_OPT_END, b"")
+        self._segments.append(path)
+        self._seg_bytes = 0
+        self._write(pcapng_block(PCAPNG_SHB, shb) + b"".join(self._idbs))
+
+        # The live segment counts towards keep
+        while self._keep and len(self._segments) > self._keep:
+            old = self._segments.pop(0)
+            for p in (old, old + ".idx"):
+                try:
+                    os.remove(p)
+                except OSError:
+                    pass
+
+    def _close_segment(self):
+        os.fsync(self._fd)
+        os.close(self._fd)
+        self._fd = None
+        if not self.rotating:
+            return
+        with self._lock:
+            names = sorted(self._interfaces, key=self._interfaces.get)
+        index = {
+            "file":         os.path.basename(self._seg_path),
+            "packets":      self._seg_packets,
+            "first_ts_us":  self._seg_first,
+            "last_ts_us":   self._seg_last,
+            "channels":     sorted(self._seg_channels),
+            "interfaces":   names,
+        }
+        with open(self._seg_path + ".idx", "w") as f:
+            json.dump(index, f)
+            f.write("\n")
+
+    def _due(self, pending_bytes):
+        return ((self._rotate_bytes and self._seg_bytes + pending_bytes >= self._rotate_bytes) or
+                (self._rotate_secs and time.monotonic() - self._seg_opened >= self._rotate_secs))
+
+    def _write(self, out):
+        view = memoryview(out)
+        while view:
+            view = view[os.write(self._fd, view):]   # A short write leaves the rest
+        self._seg_bytes += len(out)
+
+    def _writer_loop(self):
+        try:
+            self._write_batches()
+        except OSError as e:
+            with self._lock:
+                self.error = e
+                self.dropped += self._unwritten + sum(1 for rec in self._pending
+                                                      if not isinstance(rec, bytes))
+                self._pending = []
+            if self._fd is not None:
+                try:
+                    os.close(self._fd)
+                except OSError:
+                    pass
+                self._fd = None
+
+    def _write_batches(self):
+        last_sync = time.monotonic()
+        while True:
+            self._wake.wait(PCAPNG_FLUSH_S)
+            with self._lock:
+                self._wake.clear()
+                batch, self._pending = self._pending, []
+                self._pending_bytes = 0
+                closing = self._closing
+
+            out = bytearray()
+            records = []
+            for rec in batch:
+                if isinstance(rec, bytes):
+                    self._idbs.append(rec)
+                    out += rec
+                else:
+                    records.append((rec, None))
+            if self._dedup:
+                for rec, _ in records:
+                    payload = rec[4]
+                    self._dedup.offer((zlib.crc32(payload), len(payload)),
+                                      rec[1], rec[0], rec[3], rec)
+                records = self._dedup.pop_ready(
+                    None if closing else int(time.time() * 1_000_000) - PCAPNG_DEDUP_HOLD_US)
+
+            for rec, seen in records:
+                iface_id, ts_us, channel, rssi, payload = rec
+                data = radiotap_header(channel, rssi) + payload
+                body = struct.pack("<IIIII", iface_id, ts_us >> 32, ts_us & 0xFFFFFFFF,
+                                   len(data), len(data)) + data + bytes(-len(data) % 4)
+                if seen and len(seen) > 1:
+                    note = ", ".join(f"{self._names[i]} {r} dBm" for i, r in seen)
+                    body += pcapng_option(PCAPNG_OPT_COMMENT, f"seen by {note}".encode())
+                    body += pcapng_option(PCAPNG_OPT_END, b"")
+                block = pcapng_block(PCAPNG_EPB, body)
+                if self.rotating and self._seg_packets and self._due(len(out) + len(block)):
+                    self._write(out)
+                    self.packets += self._unwritten
+                    self._unwritten = 0
+                    out = bytearray()
+                    self._close_segment()
+                    self._open_segment()
+                out += block
+                self._seg_packets += 1
+                if self._seg_first is None:
+                    self._seg_first = ts_us
+                self._seg_last = ts_us
+                self._seg_channels.add(channel)
+                self._unwritten += 1
+            self._write(out)
+            self.packets += self._unwritten
+            self._unwritten = 0
+
+            if closing:
+                self._close_segment()
+                return
+            if self.rotating and self._seg_packets and self._due(0):
+                self._close_segment()
+                self._open_segment()
+            elif time.monotonic() - last_sync >= PCAPNG_FSYNC_S:
+                os.fsync(self._fd)
+                last_sync = time.monotonic()
 
     def close(self):
-        self._f.close()
+        with self._lock:
+            self._closing = True
+        self._wake.set()
+        self._thread.join()
+
+
+def lz4_block_decompress(src, raw_len):
+    """Decode one raw LZ4 block (as produced by the firmware's compress.c).
+
+    Uses the lz4 package when installed; the pure-Python path works per
+    sequence (slices, not bytes) and is fast enough for the serial link.
+    """
+    if lz4_block is not None:
+        out = lz4_block.decompress(bytes(src), uncompressed_size=raw_len)
+        if len(out) != raw_len:
+            raise ValueError("LZ4 block shorter than its raw length")
+        return out
+
+    out = bytearray()
+    pos = 0
+    end = len(src)
+    while pos < end:
+        token = src[pos]
+        pos += 1
+
+        lit_len = token >> 4
+        if lit_len == 15:
+            while True:
+                b = src[pos]
+                pos += 1
+                lit_len += b
+                if b != 255:
+                    break
+        out += src[pos:pos + lit_len]
+        pos += lit_len
+        if pos >= end:
+            break
+
+        offset = src[pos] | (src[pos + 1] << 8)
+        pos += 2
+        match_len = token & 0x0F
+        if match_len == 15:
+            while True:
+                b = src[pos]
+                pos += 1
+                match_len += b
+                if b != 255:
+                    break
+        match_len += 4
+
+        if offset == 0 or offset > len(out):
+            raise ValueError("LZ4 match offset out of range")
+        start = len(out) - offset
+        if offset >= match_len:
+            out += out[start:start + match_len]
+        else:
+            # Overlapping match: repeat the last `offset` bytes
+            pattern = out[start:]
+            out += (pattern * (match_len // offset + 1))[:match_len]
+    if len(out) != raw_len:
+        raise ValueError("LZ4 block does not decode to its raw length")
+    return bytes(out)
+
+
+def parse_batch(frame):
+    """Split a MSG_TYPE_BATCH frame into a list of parse_frame() results.
+
+    Layout: <BBH> msg_type, flags, count, then `count` records of
+    <H> length followed by that many bytes of one message. With
+    PKT_FLAG_COMPRESSED set, the records are sent as <H> raw length and
+    an LZ4 block.
+    """
+    if len(frame) < 4:
+        return []
+    flags, count = struct.unpack_from("<BH", frame, 1)
+    if flags & PKT_FLAG_COMPRESSED:
+        if len(frame) < 6:
+            return []
+        raw_len = struct.unpack_from("<H", frame, 4)[0]
+        try:
+            frame = frame[:4] + lz4_block_decompress(frame[6:], raw_len)
+        except Exception:   # Corrupt block; lz4.block raises its own LZ4BlockError
+            return []
+    records = []
+    offset = 4
+    for _ in range(count):
+        if offset + 2 > len(frame):
+            break
+        rec_len = struct.unpack_from("<H", frame, offset)[0]
+        offset += 2
+        parsed = parse_frame(frame[offset:offset + rec_len])
+        offset += rec_len
+        if parsed is not None:
+            records.append(parsed)
+    return records
 
 
 def parse_frame(frame):
-    """Unpack a SLIP frame into (msg_type, header_dict, payload) or None."""
+    """Unpack a decoded frame into (msg_type, header_dict, payload) or None.
+
+    A MSG_TYPE_BATCH frame yields (MSG_TYPE_BATCH, [parsed, ...], None).
+    A MSG_TYPE_PACKET_V2 record yields MSG_TYPE_PACKET, with "seq" in the
+    header dict.
+    """
     if len(frame) < 1:
         return None
 
     msg_type = frame[0]
 
+    if msg_type == MSG_TYPE_BATCH:
+        return msg_type, parse_batch(frame), None
+
     if msg_type == MSG_TYPE_PACKET:
         if len(frame) < 10:
             return None
@@ -170,6 +1320,67 @@ def parse_frame(frame):
             "timestamp": hdr[5],
         }, payload
 
+    if msg_type == MSG_TYPE_PACKET_V2:
+        if len(frame) < 18:
+            return None
+        hdr = struct.unpack_from("<BBbBHIQ", frame, 0)
+        payload = frame[18:]
+
+        return MSG_TYPE_PACKET, {
+            "channel":   hdr[1],
+            "rssi":      hdr[2],
+            "flags":     hdr[3],
+            "sig_len":   hdr[4],
+            "seq":       hdr[5],
+            "timestamp": hdr[6],
+        }, payload
+
+    if msg_type == MSG_TYPE_BEACON_SUMMARY:
+        if len(frame) < 26:
+            return None
+        hdr = struct.unpack_from("<BB6sHbbbBIQ", frame, 0)
+        return msg_type, {
+            "channel":   hdr[1],
+            "bssid":     format_mac(hdr[2]),
+            "count":     hdr[3],
+            "rssi_min":  hdr[4],
+            "rssi_max":  hdr[5],
+            "rssi_avg":  hdr[6],
+            "timestamp": hdr[8],
+            "last_tsf":  hdr[9],
+        }, None
+
+    if msg_type == MSG_TYPE_PRESENCE:
+        if len(frame) < PRESENCE_HEADER.size:
+            return None
+        (_, channel, bits, exact_count, flags, part, parts, _, window, start,
+         window_ms, probes) = PRESENCE_HEADER.unpack_from(frame, 0)
+        regs_end = PRESENCE_HEADER.size + (1 << bits)
+        end = regs_end + 6 * exact_count
+        if len(frame) < end:
+            return None
+        # "timestamp" is the end of the window, when the record was sent,
+        # so it maps through DeviceClock like any other record
+        return msg_type, {
+            "channel":      channel,
+            "part":         part,
+            "parts":        parts,
+            "window":       window,
+            "window_start": start,
+            "window_ms":    window_ms,
+            "timestamp":    (start + window_ms * 1000) & 0xFFFFFFFF,
+            "probes":       probes,
+            "exact":        not flags & PRESENCE_FLAG_EXACT_FULL,
+            "registers":    frame[PRESENCE_HEADER.size:regs_end],
+            "stations":     [frame[i:i + 6] for i in range(regs_end, end, 6)],
+        }, None
+
+    if msg_type == MSG_TYPE_STATS:
+        if len(frame) < STATS_STRUCT.size:
+            return None
+        values = STATS_STRUCT.unpack_from(frame, 0)
+        return msg_type, dict(zip(STATS_FIELDS, values[1:])), None
+
     if msg_type == MSG_TYPE_RESPONSE:
         text = frame[1:].decode("utf-8", errors="replace")
         return msg_type, text, None
@@ -181,48 +1392,141 @@ def parse_frame(frame):
     return None
 
 
-def reader_thread(ser, decoder, pcap_writer, stop_event):
-    """Read from serial, decode SLIP, display and write packets."""
+def format_stats(st):
+    """One-line summary of a MSG_TYPE_STATS record."""
+    ring_pct = st["ring_hwm"] * 100 // st["ring_size"] if st["ring_size"] else 0
+    raw_pct = st["raw_hwm"] * 100 // st["raw_size"] if st["raw_size"] else 0
+    return (f"cap={st['captured']} "
+            f"drop raw={st['drop_raw_full']} ring={st['drop_ring_full']} usb={st['drop_usb']} "
+            f"filtered={st['filtered']} "
+            f"usb={st['usb_bytes_per_s'] / 1024:.1f}KB/s "
+            f"ring peak={ring_pct}% raw peak={raw_pct}% "
+            f"cb={st['cb_count']} cyc {st['cb_cycles_min']}/"
+            f"{st['cb_cycles_avg']}/{st['cb_cycles_max']} "
+            f"switch={st['switch_count']} {st['switch_us'] / 1000:.1f}ms "
+            f"shed hdr={st['shed_truncated']} drop={st['shed_dropped']} "
+            f"credit={st['flow_credit']} "
+            f"heap={st['free_heap']}")
+
+
+def print_packet(pkt_count, channel, rssi, unix_us, payload, pcap_writer, port,
+                 aggregates=None):
+    name, da, sa = classify_frame(payload)
+    line = (f"#{pkt_count:<6d} "
+            f"ch={channel:<3d} "
+            f"rssi={rssi:<4d} "
+            f"len={len(payload):<5d} "
+            f"{name:<14s} "
+            f"DA={da or '?':<17s} "
+            f"SA={sa or '?'}")
+    print(line)
+
+    if pcap_writer:
+        pcap_writer.write_packet(port, unix_us, channel, rssi, payload)
+    if aggregates:
+        aggregates.add(payload, channel, rssi, unix_us)
+
+
+def reader_thread(ser, decoder, pcap_writer, stop_event, show_stats=False,
+                  credit=None, send=None, aggregates=None, snapshot=None,
+                  presence=None):
+    """Read from serial, decode frames, display and write packets.
+
+    With send, also keeps the device clock in sync with TIMESYNC. With
+    snapshot = (path, seconds), writes the aggregates there that often.
+    With presence, a PresenceCounter, prints each finished window."""
     pkt_count = 0
+    clock = DeviceClock()
+    next_snapshot = time.monotonic() + snapshot[1] if snapshot else None
+    pcap_failed = False
     while not stop_event.is_set():
+        request = clock.sync_request() if send else None
+        if request:
+            send(request)
+        if credit:
+            credit.poll()
+        if next_snapshot and time.monotonic() >= next_snapshot:
+            next_snapshot += snapshot[1]
+            try:
+                write_snapshot(snapshot[0], *aggregates.snapshot())
+            except OSError as e:
+                print(f"\n[SNAPSHOT] {e}")
+        if pcap_writer and pcap_writer.error and not pcap_failed:
+            pcap_failed = True
+            print(f"\n[PCAPNG] {pcap_writer.error}; recording stopped")
+        if presence:
+            for window in presence.pop_ready():
+                print(f"[PRESENCE] {format_presence(window)}")
         try:
             data = ser.read(4096)
         except serial.SerialException:
             break
         if not data:
             continue
+        recv_us = int(time.time() * 1_000_000)
 
-        for frame in decoder.feed(data):
+        frames, packets, nbytes = feed_decoder(decoder, data)
+        if credit:
+            credit.consumed(nbytes, decoder)
+
+        for frame in frames:
             parsed = parse_frame(frame)
             if parsed is None:
+                if credit:
+                    credit.resync()
                 continue
 
-            msg_type = parsed[0]
+            batch = parsed[1] if parsed[0] == MSG_TYPE_BATCH else (parsed,)
+            for parsed in batch:
+                msg_type = parsed[0]
 
-            if msg_type == MSG_TYPE_RESPONSE:
-                print(f"\n<< {parsed[1]}")
-                continue
+                if msg_type == MSG_TYPE_RESPONSE:
+                    if credit:
+                        credit.note_response(parsed[1])
+                    if not clock.note_response(parsed[1], recv_us):
+                        print(f"\n<< {parsed[1]}")
+                    continue
 
-            if msg_type == MSG_TYPE_LOG:
-                print(f"\n[LOG] {parsed[1]}")
-                continue
+                if msg_type == MSG_TYPE_LOG:
+                    print(f"\n[LOG] {parsed[1]}")
+                    continue
 
-            if msg_type == MSG_TYPE_PACKET:
-                hdr, payload = parsed[1], parsed[2]
-                pkt_count += 1
+                if msg_type == MSG_TYPE_STATS:
+                    if show_stats:
+                        seq = format_seq(decoder)
+                        print(f"[STATS] {format_stats(parsed[1])}" + (f" {seq}" if seq else ""))
+                    continue
+
+                if msg_type == MSG_TYPE_PRESENCE:
+                    if presence:
+                        hdr = parsed[1]
+                        presence.add(ser.port, hdr, clock.to_unix_us(hdr["timestamp"]))
+                    continue
 
-                name, da, sa = classify_frame(payload)
-                line = (f"#{pkt_count:<6d} "
-                        f"ch={hdr['channel']:<3d} "
-                        f"rssi={hdr['rssi']:<4d} "
-                        f"len={len(payload):<5d} "
-                        f"{name:<14s} "
-                        f"DA={da or '?':<17s} "
-                        f"SA={sa or '?'}")
-                print(line)
+                if msg_type == MSG_TYPE_BEACON_SUMMARY:
+                    hdr = parsed[1]
+                    print(f"{'':8s}ch={hdr['channel']:<3d} "
+                          f"rssi={hdr['rssi_avg']:<4d} "
+                          f"{'Beacon x' + str(hdr['count']):<20s} "
+                          f"BSSID={hdr['bssid']} "
+                          f"rssi {hdr['rssi_min']}..{hdr['rssi_max']} "
+                          f"tsf={hdr['last_tsf']}")
+                    continue
 
-                if pcap_writer:
-                    pcap_writer.write_packet(payload)
+                if msg_type == MSG_TYPE_PACKET:
+                    hdr = parsed[1]
+                    if "seq" in hdr:
+                        decoder.note_seq(hdr["seq"])
+                    pkt_count += 1
+                    print_packet(pkt_count, hdr["channel"], hdr["rssi"],
+                                 clock.to_unix_us(hdr["timestamp"]),
+                                 parsed[2], pcap_writer, ser.port, aggregates)
+
+        if packets is not None:
+            for channel, rssi, timestamp, payload in batch_packets(packets):
+                pkt_count += 1
+                print_packet(pkt_count, channel, rssi, clock.to_unix_us(timestamp),
+                             payload, pcap_writer, ser.port, aggregates)
 
 
 def main():
@@ -234,12 +1538,44 @@ def main():
     parser.add_argument("-c", "--channel", type=int, default=None,
                         help="Initial WiFi channel")
     parser.add_argument("-w", "--write", metavar="FILE", default=None,
-                        help="Write PCAP file")
-    parser.add_argument("-s", "--snaplen", type=int, default=None,
-                        help="Truncate frames to N bytes (0=full)")
+                        help="Write PCAPNG file (radiotap channel/RSSI, device timestamps)")
+    parser.add_argument("--rotate-mb", type=int, metavar="MB", default=0,
+                        help="With -w, start a new FILE-NNNNN segment every MB megabytes")
+    parser.add_argument("--rotate-min", type=int, metavar="MIN", default=0,
+                        help="With -w, start a new segment every MIN minutes")
+    parser.add_argument("--keep", type=int, metavar="N", default=0,
+                        help="With rotation, keep only the newest N segments")
+    parser.add_argument("-s", "--snaplen", type=str, default=None,
+                        help="Truncate frames to N bytes (0=full, HDR=MAC "
+                             "header only), or per type, e.g. "
+                             "\"MGMT 0 DATA HDR CTRL HDR\"")
     parser.add_argument("-f", "--filter", type=str, default=None,
                         help="Frame filter: mgmt, data, ctrl, all "
                              "(combine with +, e.g. mgmt+data)")
+    parser.add_argument("--beacon-dedup", type=int, metavar="MS", default=None,
+                        help="Fold repeat beacons per BSSID into one summary "
+                             "per MS window (0=off)")
+    parser.add_argument("--presence", type=int, metavar="MS", default=None,
+                        help="Count probe-requesting stations per channel on the "
+                             "device and print one summary per MS window; other "
+                             "frames are not sent")
+    parser.add_argument("--stats", action="store_true",
+                        help="Print the device's periodic STATS telemetry")
+    parser.add_argument("--flow", type=int, metavar="BYTES", default=FLOW_WINDOW,
+                        help="Credit window for device flow control "
+                             f"(default: {FLOW_WINDOW}; 0=off)")
+    parser.add_argument("--framing", choices=["slip", "len"], default="len",
+                        help="Wire framing to negotiate (default: len; "
+                             "older firmware stays on slip)")
+    parser.add_argument("--pkthdr", type=int, choices=[1, 2], default=2,
+                        help="Packet header to request (default: 2, with sequence "
+                             "numbers for loss counting; older firmware stays on 1)")
+    parser.add_argument("--snapshot", metavar="FILE", default=None,
+                        help="Keep per-BSSID/per-station tables and write them to FILE "
+                             "(JSON, or FILE-bssids.csv/FILE-stations.csv for .csv)")
+    parser.add_argument("--snapshot-s", type=int, metavar="SEC", default=AGG_SNAPSHOT_S,
+                        help=f"With --snapshot, rewrite FILE every SEC seconds "
+                             f"(default: {AGG_SNAPSHOT_S})")
     args = parser.parse_args()
 
     ser = serial.Serial(args.port, args.baud, timeout=0.1)
@@ -247,10 +1583,25 @@ def main():
 
     pcap_writer = None
     if args.write:
-        pcap_writer = PCAPWriter(args.write)
+        pcap_writer = PCAPNGWriter(args.write, rotate_bytes=args.rotate_mb << 20,
+                                   rotate_secs=args.rotate_min * 60, keep=args.keep)
         print(f"Writing PCAP to {args.write}")
 
+    # Start from SLIP whatever a previous session left behind, and drop the
+    # reply along with any stale data
+    ser.write(b"FRAMING SLIP\n")
+    time.sleep(0.1)
+    ser.reset_input_buffer()
+
     # Send initial configuration commands
+    if args.framing == "len":
+        ser.write(b"FRAMING LEN\n")
+    if args.flow:
+        ser.write(f"FLOW {args.flow}\n".encode())
+    if args.pkthdr == 2:
+        ser.write(b"PKTHDR 2\n")
+    ser.write(b"BATCH ON\n")
+
     if args.filter:
         filt = args.filter.replace("+", " ").replace(",", " ")
         ser.write(f"FILTER {filt}\n".encode())
@@ -260,20 +1611,42 @@ def main():
         ser.write(f"SNAPLEN {args.snaplen}\n".encode())
         print(f"Requested snaplen: {args.snaplen}")
 
+    if args.beacon_dedup is not None:
+        ser.write(f"BEACONDEDUP {args.beacon_dedup}\n".encode())
+        print(f"Requested beacon dedup: {args.beacon_dedup} ms")
+
+    if args.presence is not None:
+        ser.write(f"PRESENCE {args.presence}\n".encode())
+        print(f"Requested presence counting: {args.presence} ms windows")
+
     if args.channel:
         ser.write(f"CH {args.channel}\n".encode())
         print(f"Requested channel {args.channel}")
 
-    decoder = SLIPDecoder()
+    # The reader thread sends CREDIT while the main thread sends commands
+    write_lock = threading.Lock()
+
+    def send_line(line):
+        with write_lock:
+            ser.write((line + "\n").encode())
+
+    decoder = make_decoder()
+    credit = CreditTracker(args.flow, send_line) if args.flow else None
+    aggregates = Aggregates() if args.snapshot else None
+    snapshot = (args.snapshot, args.snapshot_s) if args.snapshot else None
+    presence = PresenceCounter(args.presence) if args.presence else None
     stop_event = threading.Event()
 
     reader = threading.Thread(target=reader_thread,
-                              args=(ser, decoder, pcap_writer, stop_event),
+                              args=(ser, decoder, pcap_writer, stop_event,
+                                    args.stats, credit, send_line, aggregates,
+                                    snapshot, presence),
                               daemon=True)
     reader.start()
 
     # Command input loop
-    print("\nCommands: ch <N>, filter <types>, snaplen <N>, status, quit")
+    print("\nCommands: ch <N>, hop <ms> <ch[:w],...>, filter <types>, "
+          "snaplen <N>, status, quit")
     print("Listening for packets...\n")
     try:
         while True:
@@ -293,7 +1666,7 @@ def main():
             if line.lower().startswith("filter "):
                 line = line.replace("+", " ").replace(",", " ")
 
-            ser.write((line + "\n").encode())
+            send_line(line)
 
     except KeyboardInterrupt:
         pass
@@ -302,9 +1675,20 @@ def main():
         stop_event.set()
         reader.join(timeout=2)
         ser.close()
+        seq = format_seq(decoder)
+        if seq:
+            print(f"Transport: {seq}")
         if pcap_writer:
             pcap_writer.close()
-            print("PCAP file saved.")
+            if pcap_writer.error:
+                print(f"PCAPNG recording failed: {pcap_writer.error} "
+                      f"({pcap_writer.packets} packets written, {pcap_writer.dropped} dropped)")
+            else:
+                print(f"PCAPNG file saved ({pcap_writer.packets} packets, "
+                      f"{pcap_writer.dropped} dropped)")
+        if aggregates:
+            write_snapshot(args.snapshot, *aggregates.snapshot())
+            print(f"Aggregates saved to {args.snapshot}")
 
 
 if __name__ == "__main__":
@@ -0,0 +1,479 @@
+#!/usr/bin/env python3
+"""
+5dra WiFi Packet Sniffer — End-to-end Benchmark
+
+Runs the firmware's BENCH generator and follows its sequence-numbered
+frames through the same stages as a live capture: the device's raw ring,
+RX worker, capture ring and USB writes, the host decoder, a packet queue
+bounded like the GUI's packet ring, and the consumer that dequeues them. Reports throughput, latency
+from device timestamp to host dequeue, and how many frames each stage
+lost, so a regression can be pinned to the stage that caused it.
+
+Usage:
+    python sniffer_bench.py /dev/cu.usbmodem* --ms 10000
+    python sniffer_bench.py /dev/ttyACM0 --rate 3000 --len 512 --max-loss 0
+    python sniffer_bench.py /dev/ttyACM0 --save run.raw --json run.json
+    python sniffer_bench.py --replay run.raw
+
+BENCH with --rate 0 (default) measures the link ceiling: the generator
+waits whenever a ring is full, so nothing should be lost. With a rate
+it behaves like real traffic and a full ring drops frames. The RX worker
+treats the frames like captured ones, so MACFILTER, PRESENCE, SHED and
+SNAPLEN settings on the device apply to them too. --save keeps
+the raw byte stream, and --replay runs the host stages on it again as fast
+as they go (no latency figures, since the timestamps are old), e.g. to
+compare a decoder change against the same input. With --max-loss,
+--min-fps or --max-p99-ms the exit status is 1 when a figure is out of
+bounds, for use as a regression check.
+"""
+
+import argparse
+import json
+import queue
+import re
+import sys
+import threading
+import time
+
+import serial
+
+from sniffer import (
+    FLOW_WINDOW, MSG_TYPE_BATCH, MSG_TYPE_LOG, MSG_TYPE_PACKET,
+    MSG_TYPE_RESPONSE, MSG_TYPE_STATS, CreditTracker, DeviceClock,
+    FrameDecoder, batch_packets, feed_decoder, format_stats, make_decoder,
+    parse_frame,
+)
+
+# Synthetic frame layout (firmware bench.h)
+BENCH_BSSID = bytes.fromhex("025d7abe4c01")
+BENCH_STA = bytes.fromhex("025d7abe4c02")
+BENCH_SEQ_OFFSET = 24
+BENCH_MIN_LEN = 28
+
+BENCH_QUEUE_MAX = 8192     # Same bound as the GUI's PACKET_RING_ROWS
+BENCH_WARMUP_S = 3.0       # TIMESYNC exchanges before the run, for the latency figures
+BENCH_DRAIN_S = 1.0        # Quiet time after DONE before the run counts as over
+BENCH_STATS_MS = 1000
+REPLAY_CHUNK = 4096
+
+DONE_RE = re.compile(r"OK BENCH DONE FRAMES (\d+) DROPPED (\d+) STALLS (\d+) "
+                     r"MS (\d+) USB (\d+) RATE (\d+)")
+
+
+def is_bench_frame(payload):
+    return (len(payload) >= BENCH_MIN_LEN and payload[0] == 0x08 and
+            payload[4:10] == BENCH_BSSID and payload[10:16] == BENCH_STA)
+
+
+def percentile(ordered, p):
+    if not ordered:
+        return None
+    return ordered[min(len(ordered) - 1, int(len(ordered) * p / 100))]
+
+
+class BenchPipeline:
+    """Reader and consumer stages, each with its own counters.
+
+    The reader decodes the byte stream and puts every synthetic frame on a
+    bounded queue (put_nowait; a full queue drops, as the GUI's packet ring
+    loses rows a reader laps). The consumer dequeues them, stamps the
+    latency and marks the sequence number seen. Only the reader touches the decoder and the device clock.
+    """
+
+    def __init__(self, decoder, clock=None, credit=None):
+        self.decoder = decoder
+        self.clock = clock
+        self.credit = credit
+        self.queue = queue.Queue(maxsize=BENCH_QUEUE_MAX)
+
+        # Reader
+        self.malformed = 0          # Frames parse_frame rejected
+        self.other = 0              # Captured (non-bench) packets
+        self.offered = 0            # Bench frames decoded
+        self.queue_drops = 0
+        self.responses = []
+        self.stats = []             # (host monotonic, STATS record)
+        self.done = None            # Parsed OK BENCH DONE reply
+        self.done_at = None
+        self.last_bench_at = None
+        self.response_event = threading.Event()
+
+        # Consumer
+        self.received = 0
+        self.duplicates = 0
+        self.max_seq = -1
+        self.bytes = 0
+        self.latencies = []         # us
+        self.first_at = None
+        self.last_at = None
+        self._seen = bytearray()
+
+    # ---- reader ----
+
+    def feed(self, data, recv_us):
+        frames, packets, nbytes = feed_decoder(self.decoder, data)
+        if self.credit:
+            self.credit.consumed(nbytes, self.decoder)
+        for frame in frames:
+            parsed = parse_frame(frame)
+            if parsed is None:
+                self.malformed += 1
+                if self.credit:
+                    self.credit.resync()
+                continue
+            batch = parsed[1] if parsed[0] == MSG_TYPE_BATCH else (parsed,)
+            for msg_type, hdr, payload in batch:
+                if msg_type == MSG_TYPE_PACKET:
+                    if "seq" in hdr:
+                        self.decoder.note_seq(hdr["seq"])
+                    self._packet(hdr["timestamp"], payload)
+                elif msg_type == MSG_TYPE_RESPONSE:
+                    self._response(hdr, recv_us)
+                elif msg_type == MSG_TYPE_STATS:
+                    self.stats.append((time.monotonic(), hdr))
+                elif msg_type == MSG_TYPE_LOG:
+                    print(f"[LOG] {hdr}")
+        if packets is not None:
+            for _, _, timestamp, payload in batch_packets(packets):
+                self._packet(timestamp, payload)
+
+    def _packet(self, timestamp, payload):
+        if not is_bench_frame(payload):
+            self.other += 1
+            return
+        self.offered += 1
+        self.last_bench_at = time.monotonic()
+        seq = int.from_bytes(payload[BENCH_SEQ_OFFSET:BENCH_SEQ_OFFSET + 4], "little")
+        unix_us = self.clock.to_unix_us(timestamp) if self.clock else None
+        try:
+            self.queue.put_nowait((seq, unix_us, len(payload)))
+        except queue.Full:
+            self.queue_drops += 1
+
+    def _response(self, text, recv_us):
+        if self.credit:
+            self.credit.note_response(text)
+        if self.clock and self.clock.note_response(text, recv_us):
+            return
+        match = DONE_RE.match(text)
+        if match:
+            self.done = dict(zip(("frames", "dropped", "stalls", "ms", "usb_bytes",
+                                  "usb_rate"), (int(v) for v in match.groups())))
+            self.done_at = time.monotonic()
+        self.responses.append(text)
+        self.response_event.set()
+
+    # ---- consumer ----
+
+    def consume(self):
+        """Run until a None item is queued."""
+        while True:
+            item = self.queue.get()
+            if item is None:
+                return
+            now_us = int(time.time() * 1_000_000)
+            seq, unix_us, length = item
+            if seq >= len(self._seen):
+                self._seen.extend(bytes(max(seq + 1 - len(self._seen), 65536)))
+            if self._seen[seq]:
+                self.duplicates += 1
+                continue
+            self._seen[seq] = 1
+            self.received += 1
+            self.bytes += length
+            self.max_seq = max(self.max_seq, seq)
+            if unix_us is not None:
+                self.latencies.append(now_us - unix_us)
+            if self.first_at is None:
+                self.first_at = time.monotonic()
+            self.last_at = time.monotonic()
+
+    def wait_response(self, prefixes, timeout, seen=0):
+        """First reply after the first seen ones starting with one of
+        prefixes, or None."""
+        deadline = time.monotonic() + timeout
+        while True:
+            for text in self.responses[seen:]:
+                if text.startswith(prefixes):
+                    return text
+            seen = len(self.responses)
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            self.response_event.clear()
+            self.response_event.wait(min(left, 0.1))
+
+
+def stats_delta(before, after, field):
+    if before is None or after is None:
+        return None
+    return (after[field] - before[field]) & 0xFFFFFFFF
+
+
+def report(pipe, stats_before, stats_after):
+    """Result dict: throughput, latency and loss per stage."""
+    done = pipe.done or {}
+    generated = done.get("frames", pipe.max_seq + 1)
+    ring = done.get("dropped", 0)
+    worker = None
+    if stats_before is not None and stats_after is not None:
+        worker = sum(stats_delta(stats_before, stats_after, field)
+                     for field in ("drop_ring_full", "filtered", "shed_dropped"))
+    usb = stats_delta(stats_before, stats_after, "drop_usb")
+    elapsed = (pipe.last_at - pipe.first_at) if pipe.received > 1 else 0
+    lost = generated - pipe.received
+
+    latencies = sorted(pipe.latencies)
+    result = {
+        "generated": generated,
+        "received": pipe.received,
+        "loss": {
+            "device_ring": ring,
+            "device_worker": worker,
+            "device_usb": usb,
+            "host_decoder": generated - ring - (worker or 0) - (usb or 0) - pipe.offered,
+            "host_queue": pipe.queue_drops,
+            "total": lost,
+            "total_pct": round(lost * 100 / generated, 3) if generated else 0.0,
+        },
+        "decoder_crc_errors": pipe.decoder.crc_errors,
+        "transport": {
+            "received": pipe.decoder.seq_received,
+            "lost": pipe.decoder.seq_lost,
+            "resets": pipe.decoder.seq_resets,
+        },
+        "decoder_malformed": pipe.malformed,
+        "duplicates": pipe.duplicates,
+        "other_packets": pipe.other,
+        "host_fps": round(pipe.received / elapsed, 1) if elapsed else None,
+        "host_bytes_per_s": round(pipe.bytes / elapsed) if elapsed else None,
+        "device_ms": done.get("ms"),
+        "device_usb_bytes_per_s": done.get("usb_rate"),
+        "device_stalls": done.get("stalls"),
+        "device_ring_hwm": stats_after["ring_hwm"] if stats_after else None,
+        "latency_ms": {
+            name: round(percentile(latencies, p) / 1000, 3) if latencies else None
+            for name, p in (("p50", 50), ("p90", 90), ("p99", 99), ("p999", 99.9),
+                            ("max", 100))
+        },
+    }
+    return result
+
+
+def print_report(r):
+    loss = r["loss"]
+    print(f"\nGenerated {r['generated']}  received {r['received']}  "
+          f"lost {loss['total']} ({loss['total_pct']}%)")
+    print("Loss by stage:")
+    for name, key in (("device raw ring (full)", "device_ring"),
+                      ("device RX worker", "device_worker"),
+                      ("device USB (write timeout)", "device_usb"),
+                      ("host decoder", "host_decoder"),
+                      ("host queue (full)", "host_queue")):
+        value = loss[key]
+        print(f"  {name:<28s} {'n/a' if value is None else value}")
+    print(f"Decoder: {r['decoder_crc_errors']} CRC errors, {r['decoder_malformed']} "
+          f"malformed frames; {r['duplicates']} duplicates, {r['other_packets']} "
+          f"captured packets ignored")
+    if r["transport"]["received"]:
+        t = r["transport"]
+        print(f"Transport (PKTHDR 2): {t['received']} records, {t['lost']} missing "
+              f"from the sequence, {t['resets']} resets")
+    if r["host_fps"] is not None:
+        print(f"Host: {r['host_fps']:.0f} frames/s, {r['host_bytes_per_s'] / 1024:.1f} KB/s")
+    if r["device_usb_bytes_per_s"] is not None:
+        print(f"Device: {r['device_usb_bytes_per_s'] / 1024:.1f} KB/s over USB in "
+              f"{r['device_ms']} ms, {r['device_stalls']} raw-ring-full stalls")
+    lat = r["latency_ms"]
+    if lat["p50"] is not None:
+        print(f"Latency ms: p50 {lat['p50']}  p90 {lat['p90']}  p99 {lat['p99']}  "
+              f"p99.9 {lat['p999']}  max {lat['max']}")
+
+
+def check(r, args):
+    """Names of the bounds the result violates."""
+    failed = []
+    if args.max_loss is not None and r["loss"]["total_pct"] > args.max_loss:
+        failed.append(f"loss {r['loss']['total_pct']}% > {args.max_loss}%")
+    if args.min_fps is not None and (r["host_fps"] or 0) < args.min_fps:
+        failed.append(f"host rate {r['host_fps']} frames/s < {args.min_fps}")
+    if args.max_p99_ms is not None:
+        p99 = r["latency_ms"]["p99"]
+        if p99 is None or p99 > args.max_p99_ms:
+            failed.append(f"p99 latency {p99} ms > {args.max_p99_ms} ms")
+    return failed
+
+
+def run_live(args):
+    ser = serial.Serial(args.port, args.baud, timeout=0.1)
+    print(f"Connected to {args.port} @ {args.baud} baud")
+    save = open(args.save, "wb") if args.save else None
+
+    # Start from SLIP and drop stale data; the saved stream begins here so
+    # a replay sees the same framing switch
+    ser.write(b"FRAMING SLIP\n")
+    time.sleep(0.1)
+    ser.reset_input_buffer()
+
+    write_lock = threading.Lock()
+
+    def send_line(line):
+        with write_lock:
+            ser.write((line + "\n").encode())
+
+    clock = DeviceClock()
+    decoder = make_decoder()
+    credit = CreditTracker(args.flow, send_line) if args.flow else None
+    pipe = BenchPipeline(decoder, clock, credit)
+    stop_event = threading.Event()
+
+    def reader():
+        while not stop_event.is_set():
+            request = clock.sync_request()
+            if request:
+                send_line(request)
+            if credit:
+                credit.poll()
+            try:
+                data = ser.read(4096)
+            except serial.SerialException:
+                break
+            if not data:
+                continue
+            if save:
+                save.write(data)
+            pipe.feed(data, int(time.time() * 1_000_000))
+
+    reader_thread = threading.Thread(target=reader, daemon=True)
+    consumer_thread = threading.Thread(target=pipe.consume, daemon=True)
+    reader_thread.start()
+    consumer_thread.start()
+
+    try:
+        if args.framing == "len":
+            send_line("FRAMING LEN")
+        if args.flow:
+            send_line(f"FLOW {args.flow}")
+        send_line("PKTHDR 2")
+        send_line("BATCH ON")
+        send_line(f"STATS {BENCH_STATS_MS}")
+        time.sleep(args.warmup)
+        stats_before = pipe.stats[-1][1] if pipe.stats else None
+
+        mark = len(pipe.responses)
+        send_line(f"BENCH {args.ms} {args.len} {args.rate}")
+        reply = pipe.wait_response(("OK BENCH ", "ERR"), 2.0, mark)
+        if reply is None or reply.startswith("ERR"):
+            print(f"BENCH refused: {reply or 'no reply (firmware without BENCH?)'}")
+            return 2
+        print(f"<< {reply}")
+        if pipe.wait_response(("OK BENCH DONE",), args.ms / 1000 + 5.0, mark) is None:
+            print("BENCH did not finish")
+            return 2
+
+        # Frames still in the ring follow DONE; wait for them, then for a
+        # STATS record that covers the whole run
+        deadline = time.monotonic() + 10.0
+        while time.monotonic() < deadline:
+            quiet = time.monotonic() - max(pipe.last_bench_at or 0, pipe.done_at)
+            fresh = pipe.stats and pipe.stats[-1][0] > pipe.done_at + BENCH_DRAIN_S
+            if quiet >= BENCH_DRAIN_S and (fresh or stats_before is None):
+                break
+            time.sleep(0.05)
+        stats_after = pipe.stats[-1][1] if pipe.stats else None
+    finally:
+        stop_event.set()
+        reader_thread.join(timeout=2)
+        pipe.queue.put(None)
+        consumer_thread.join(timeout=10)
+        ser.close()
+        if save:
+            save.close()
+
+    if args.verbose and stats_after:
+        print(f"[STATS] {format_stats(stats_after)}")
+    if clock.rtt_us is not None:
+        print(f"Clock sync: {clock.syncs} exchanges, best RTT {clock.rtt_us} us "
+              f"(latency figures are good to about half that)")
+    return report(pipe, stats_before, stats_after)
+
+
+def run_replay(args):
+    decoder = FrameDecoder() if args.pure else make_decoder()
+    pipe = BenchPipeline(decoder)
+    consumer_thread = threading.Thread(target=pipe.consume, daemon=True)
+    consumer_thread.start()
+    start = time.monotonic()
+    with open(args.replay, "rb") as f:
+        while True:
+            chunk = f.read(REPLAY_CHUNK)
+            if not chunk:
+                break
+            pipe.feed(chunk, None)
+    pipe.queue.put(None)
+    consumer_thread.join()
+    elapsed = time.monotonic() - start
+
+    stats = [st for _, st in pipe.stats]
+    result = report(pipe, stats[0] if stats else None, stats[-1] if stats else None)
+    result["replay_s"] = round(elapsed, 3)
+    print(f"Replayed {args.replay} in {elapsed:.3f} s "
+          f"({type(decoder).__module__}.{type(decoder).__name__})")
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="5dra WiFi Packet Sniffer — End-to-end Benchmark")
+    parser.add_argument("port", nargs="?", help="Serial port (e.g. /dev/cu.usbmodem*)")
+    parser.add_argument("-b", "--baud", type=int, default=921600,
+                        help="Baud rate (default: 921600)")
+    parser.add_argument("--ms", type=int, default=10000,
+                        help="Generator run time (100-60000, default: 10000)")
+    parser.add_argument("--len", type=int, default=1024,
+                        help="Synthetic frame length (28-2500, default: 1024)")
+    parser.add_argument("--rate", type=int, default=0,
+                        help="Frames/s (0 = as fast as the link goes, default)")
+    parser.add_argument("--flow", type=int, metavar="BYTES", default=FLOW_WINDOW,
+                        help="Credit window for device flow control "
+                             f"(default: {FLOW_WINDOW}; 0=off)")
+    parser.add_argument("--framing", choices=["slip", "len"], default="len",
+                        help="Wire framing to negotiate (default: len)")
+    parser.add_argument("--warmup", type=float, default=BENCH_WARMUP_S,
+                        help=f"Seconds of clock sync before the run (default: {BENCH_WARMUP_S})")
+    parser.add_argument("--save", metavar="FILE", default=None,
+                        help="Keep the raw byte stream for --replay")
+    parser.add_argument("--replay", metavar="FILE", default=None,
+                        help="Run the host stages on a stream saved with --save")
+    parser.add_argument("--pure", action="store_true",
+                        help="With --replay, use the pure-Python decoder")
+    parser.add_argument("--json", metavar="FILE", default=None,
+                        help="Write the result as JSON")
+    parser.add_argument("--max-loss", type=float, metavar="PCT", default=None,
+                        help="Fail if more than PCT %% of the frames are lost")
+    parser.add_argument("--min-fps", type=float, metavar="N", default=None,
+                        help="Fail below N frames/s at the host")
+    parser.add_argument("--max-p99-ms", type=float, metavar="MS", default=None,
+                        help="Fail if the 99th percentile latency exceeds MS")
+    parser.add_argument("-v", "--verbose", action="store_true",
+                        help="Also print the last STATS record")
+    args = parser.parse_args()
+    if not args.port and not args.replay:
+        parser.error("a serial port or --replay is required")
+
+    result = run_replay(args) if args.replay else run_live(args)
+    if isinstance(result, int):
+        sys.exit(result)
+    print_report(result)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(result, f, indent=2)
+
+    failed = check(result, args)
+    for reason in failed:
+        print(f"FAIL: {reason}")
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
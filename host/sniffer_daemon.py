@@ -0,0 +1,723 @@
+#!/usr/bin/env python3
+"""
+5dra WiFi Packet Sniffer — Headless Capture Daemon
+
+Attaches to every connected sniffer, decodes each one on its own reader
+thread, merges the packets into one stream ordered by synchronized device
+time and publishes it on local sockets:
+
+    --listen ADDR       compact 5dra stream (format below), for our own tools
+    --pcap-listen ADDR  pcap-over-IP: a classic radiotap pcap stream
+
+ADDR is HOST:PORT for TCP or a path for a Unix socket. Any number of
+subscribers can connect and leave while the capture runs; each packet is
+decoded and encoded once, whoever is listening.
+
+Usage:
+    python sniffer_daemon.py --listen /tmp/5dra.sock
+    python sniffer_daemon.py --pcap-listen 127.0.0.1:5551 -w capture.pcapng
+    python sniffer_daemon.py /dev/ttyACM0 /dev/ttyACM1 --init "HOP 100 1,6,11"
+    python sniffer_daemon.py --dump /tmp/5dra.sock
+    python sniffer_daemon.py --presence 60000 --presence-log footfall.jsonl
+
+    wireshark -k -i TCP@127.0.0.1:5551
+
+Stream format (--listen), little-endian: an 8-byte header "5DRS", version
+u16, reserved u16, then records of type u8, device u16, body length u16
+and the body:
+    STREAM_REC_DEVICE  device attached; body = its port name (UTF-8)
+    STREAM_REC_PACKET  unix_us i64, channel u8, rssi i8, then the 802.11 frame
+    STREAM_REC_GONE    device detached; its last packets may still follow
+A new subscriber gets a DEVICE record for every attached device first.
+Device ids are not reused while the daemon runs. Skip unknown record
+types by their length.
+"""
+
+import argparse
+import glob
+import json
+import os
+import selectors
+import signal
+import socket
+import stat
+import struct
+import sys
+import threading
+import time
+from collections import deque
+
+import serial
+
+from sniffer import (
+    FLOW_WINDOW, LINKTYPE_IEEE802_11_RADIOTAP, MERGE_LATENCY_S, MSG_TYPE_BATCH, MSG_TYPE_LOG,
+    MSG_TYPE_PACKET, MSG_TYPE_PRESENCE, MSG_TYPE_RESPONSE, MSG_TYPE_STATS, PCAP_SNAPLEN,
+    CreditTracker, DeviceClock, FrameDecoder, PCAPNGWriter, PresenceCounter, StreamMerger,
+    batch_packets, classify_frame, feed_decoder, format_presence, format_seq,
+    format_stats, make_decoder, parse_frame, radiotap_header,
+)
+
+DEVICE_GLOBS = ("/dev/cu.usbmodem*", "/dev/ttyACM*")   # macOS, Linux
+SCAN_INTERVAL_S = 2.0
+PUBLISH_TICK_S = 0.02
+DAEMON_MAX_QUEUED = 200_000  # Decoded packets waiting for the merge before new ones are dropped
+CLIENT_MAX_BUFFER = 8 << 20  # Bytes queued for one subscriber before it is disconnected
+STATUS_LOG_S = 10.0
+
+STREAM_MAGIC = b"5DRS"
+STREAM_VERSION = 1
+STREAM_HEADER = struct.Struct("<4sHH")
+STREAM_REC = struct.Struct("<BHH")          # type, device, body length
+STREAM_PKT = struct.Struct("<qBb")          # unix_us, channel, rssi
+STREAM_PKT_HDR = struct.Struct("<BHHqBb")   # STREAM_REC + STREAM_PKT in one pack
+STREAM_REC_DEVICE = 1
+STREAM_REC_PACKET = 2
+STREAM_REC_GONE = 3
+
+PCAP_GLOBAL_HDR = struct.pack("<IHHiIII", 0xA1B2C3D4, 2, 4, 0, 0,
+                              PCAP_SNAPLEN, LINKTYPE_IEEE802_11_RADIOTAP)
+PCAP_REC_HDR = struct.Struct("<IIII")
+
+
+def log(msg):
+    print(f"{time.strftime('%H:%M:%S')} {msg}", file=sys.stderr, flush=True)
+
+
+def short_name(port):
+    return port.split("usbmodem")[-1] if "usbmodem" in port else port.split("/")[-1]
+
+
+def probe_device(port, baud):
+    """Open port and confirm a 5dra sniffer answers on it; the open serial
+    port, or None. Leaves the device on SLIP framing."""
+    try:
+        ser = serial.Serial(port, baud, timeout=0.5)
+    except (serial.SerialException, OSError):
+        return None
+    try:
+        ser.write(b"FRAMING SLIP\n")
+        time.sleep(0.1)
+        ser.reset_input_buffer()
+        ser.write(b"STATUS\n")
+        time.sleep(0.3)
+
+        # The STATUS reply may sit behind a flood of packets; any valid
+        # frame confirms the device
+        decoder = FrameDecoder()
+        for attempt in range(3):
+            raw = ser.read(4096)
+            if not raw:
+                if attempt == 0:
+                    break
+                continue
+            for frame in decoder.feed(raw):
+                parsed = parse_frame(frame)
+                if parsed is None:
+                    continue
+                if ((parsed[0] == MSG_TYPE_RESPONSE and "CH" in parsed[1].upper()) or
+                        parsed[0] in (MSG_TYPE_PACKET, MSG_TYPE_BATCH, MSG_TYPE_STATS)):
+                    ser.timeout = 0.1
+                    return ser
+    except (serial.SerialException, OSError):
+        pass
+    try:
+        ser.close()
+    except Exception:
+        pass
+    return None
+
+
+class CaptureDevice:
+    """One attached sniffer and its reader thread.
+
+    The reader decodes, stamps packets with the device clock and hands them
+    to put() as (device id, unix_us, channel, rssi, payload). PRESENCE
+    records go to presence() as (device id, window end unix_us, record).
+    Responses, logs and STATS stay on this thread. done() is called once
+    when the port stops reading.
+    """
+
+    def __init__(self, dev_id, port, ser, put, done, flow=FLOW_WINDOW, show_stats=False,
+                 presence=None):
+        self.id = dev_id
+        self.port = port
+        self.name = short_name(port)
+        self.ser = ser
+        self.clock = DeviceClock()
+        self.decoder = make_decoder()
+        self.credit = CreditTracker(flow, self.send) if flow else None
+        self.packets = 0
+        self._flow = flow
+        self._put = put
+        self._done = done
+        self._presence = presence
+        self._show_stats = show_stats
+        self._write_lock = threading.Lock()
+        self._stop = threading.Event()
+        self._thread = threading.Thread(target=self._reader_loop,
+                                        name=f"reader-{self.name}", daemon=True)
+
+    def start(self, commands=()):
+        self._thread.start()
+        # Length-prefixed framing is cheaper to decode; older firmware
+        # answers ERR and stays on SLIP
+        self.send("FRAMING LEN")
+        if self._flow:
+            self.send(f"FLOW {self._flow}")
+        self.send("PKTHDR 2")
+        self.send("BATCH ON")
+        for line in commands:
+            self.send(line)
+
+    def send(self, line):
+        with self._write_lock:
+            try:
+                self.ser.write((line + "\n").encode())
+            except (serial.SerialException, OSError):
+                pass
+
+    def close(self):
+        self._stop.set()
+
+    def join(self, timeout=None):
+        self._thread.join(timeout)
+
+    def _reader_loop(self):
+        decoder = self.decoder
+        clock, credit, put, dev_id = self.clock, self.credit, self._put, self.id
+        try:
+            while not self._stop.is_set():
+                request = clock.sync_request()
+                if request:
+                    self.send(request)
+                if credit:
+                    credit.poll()
+                try:
+                    data = self.ser.read(4096)
+                except (serial.SerialException, OSError):
+                    break
+                if not data:
+                    continue
+                recv_us = int(time.time() * 1_000_000)
+
+                frames, packets, nbytes = feed_decoder(decoder, data)
+                if credit:
+                    credit.consumed(nbytes, decoder)
+
+                for frame in frames:
+                    parsed = parse_frame(frame)
+                    if parsed is None:
+                        if credit:
+                            credit.resync()
+                        continue
+                    batch = parsed[1] if parsed[0] == MSG_TYPE_BATCH else (parsed,)
+                    for parsed in batch:
+                        msg_type = parsed[0]
+                        if msg_type == MSG_TYPE_PACKET:
+                            hdr = parsed[1]
+                            if "seq" in hdr:
+                                decoder.note_seq(hdr["seq"])
+                            self.packets += 1
+                            put((dev_id, clock.to_unix_us(hdr["timestamp"]),
+                                 hdr["channel"], hdr["rssi"], parsed[2]))
+                        elif msg_type == MSG_TYPE_RESPONSE:
+                            if credit:
+                                credit.note_response(parsed[1])
+                            if not clock.note_response(parsed[1], recv_us):
+                                log(f"{self.name} << {parsed[1]}")
+                        elif msg_type == MSG_TYPE_LOG:
+                            log(f"{self.name} [LOG] {parsed[1]}")
+                        elif msg_type == MSG_TYPE_STATS and self._show_stats:
+                            log(f"{self.name} [STATS] {format_stats(parsed[1])}")
+                        elif msg_type == MSG_TYPE_PRESENCE and self._presence:
+                            hdr = parsed[1]
+                            self._presence((dev_id, clock.to_unix_us(hdr["timestamp"]), hdr))
+
+                if packets is not None:
+                    to_unix_us = clock.to_unix_us
+                    for channel, rssi, timestamp, payload in batch_packets(packets):
+                        put((dev_id, to_unix_us(timestamp), channel, rssi, payload))
+                    self.packets += packets.count
+        finally:
+            try:
+                self.ser.close()
+            except Exception:
+                pass
+            self._done(self)
+
+
+def open_listener(address):
+    """Listening socket for HOST:PORT (TCP) or a Unix socket path."""
+    host, sep, port = address.rpartition(":")
+    if sep and port.isdigit():
+        sock = socket.create_server((host or "127.0.0.1", int(port)))
+    else:
+        # A socket file left behind by an earlier run would fail the bind
+        try:
+            if stat.S_ISSOCK(os.stat(address).st_mode):
+                os.unlink(address)
+        except FileNotFoundError:
+            pass
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.bind(address)
+        sock.listen()
+    sock.setblocking(False)
+    return sock
+
+
+def connect(address):
+    host, sep, port = address.rpartition(":")
+    if sep and port.isdigit():
+        return socket.create_connection((host or "127.0.0.1", int(port)))
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(address)
+    return sock
+
+
+class Subscriber:
+    __slots__ = ("sock", "pcap", "out", "events", "peer")
+
+    def __init__(self, sock, pcap, peer):
+        self.sock = sock
+        self.pcap = pcap          # pcap-over-IP, else the 5dra stream
+        self.out = bytearray()
+        self.events = selectors.EVENT_READ
+        self.peer = peer
+
+
+class CaptureDaemon:
+    """Device discovery, the merge and the subscriber sockets.
+
+    Everything but probing and the per-device readers runs on the thread
+    calling run(): other threads only append to _queue (packets) and
+    _events (attach/detach), so the merge, encoding and socket I/O need no
+    locks.
+    """
+
+    def __init__(self, patterns, listen=(), pcap_listen=(), pcap_writer=None,
+                 commands=(), flow=FLOW_WINDOW, baud=921600,
+                 merge_latency_s=MERGE_LATENCY_S, show_stats=False,
+                 presence_ms=0, presence_log=None):
+        self._patterns = patterns
+        self._pcap_writer = pcap_writer
+        self._pcap_failed = False
+        self._commands = list(commands)
+        if presence_ms:
+            self._commands.append(f"PRESENCE {presence_ms}")
+        self._presence = PresenceCounter(presence_ms) if presence_ms else None
+        self._presence_log = presence_log   # File object: one JSON window per line
+        self._flow = flow
+        self._baud = baud
+        self._show_stats = show_stats
+
+        self.devices = {}           # id -> CaptureDevice
+        self._known = set()         # Ports present at the last scan
+        self._next_id = 1
+        self._queue = deque()       # Packets from the readers
+        self._events = deque()      # ("probed", port, ser) / ("gone", device)
+        self._merger = StreamMerger(merge_latency_s)
+        self._subscribers = []
+        self._unix_paths = []
+        self.published = 0
+        self.dropped = 0
+
+        self._sel = selectors.DefaultSelector()
+        for address, pcap in [(a, False) for a in listen] + [(a, True) for a in pcap_listen]:
+            sock = open_listener(address)
+            if sock.family == socket.AF_UNIX:
+                self._unix_paths.append(address)
+            self._sel.register(sock, selectors.EVENT_READ, pcap)
+            log(f"{'pcap-over-IP' if pcap else 'stream'} on {address}")
+
+    # --- Called from other threads ---
+
+    def _put(self, rec):
+        if len(self._queue) >= DAEMON_MAX_QUEUED:
+            self.dropped += 1
+            return
+        self._queue.append(rec)
+
+    def _probe(self, port):
+        ser = probe_device(port, self._baud)
+        if ser is None:
+            log(f"{port}: no sniffer answered")
+            return
+        self._events.append(("probed", port, ser))
+
+    def _gone(self, dev):
+        self._events.append(("gone", dev))
+
+    def _presence_record(self, rec):
+        self._events.append(("presence", rec))
+
+    # --- Main thread ---
+
+    def _scan(self):
+        current = set()
+        for pattern in self._patterns:
+            current.update(glob.glob(pattern))
+        for port in sorted(current - self._known):
+            threading.Thread(target=self._probe, args=(port,), daemon=True).start()
+        for port in self._known - current:
+            for dev in self.devices.values():
+                if dev.port == port:
+                    dev.close()
+        self._known = current
+
+    def _handle_events(self):
+        while self._events:
+            event = self._events.popleft()
+            if event[0] == "probed":
+                _, port, ser = event
+                dev = CaptureDevice(self._next_id, port, ser, self._put, self._gone,
+                                    self._flow, self._show_stats,
+                                    self._presence_record if self._presence else None)
+                self._next_id += 1
+                self.devices[dev.id] = dev
+                self._merger.add(dev.id)
+                self._broadcast(self._device_record(dev), pcap=False)
+                dev.start(self._commands)
+                log(f"{dev.name}: attached as device {dev.id}")
+            elif event[0] == "presence":
+                dev_id, end_us, rec = event[1]
+                dev = self.devices.get(dev_id)
+                self._presence.add(dev.name if dev else str(dev_id), rec, end_us)
+            else:
+                dev = event[1]
+                if self.devices.pop(dev.id, None) is None:
+                    continue
+                self._merger.drop(dev.id)
+                self._broadcast(STREAM_REC.pack(STREAM_REC_GONE, dev.id, 0), pcap=False)
+                # Let the next scan re-probe the port if it stays (or comes back)
+                self._known.discard(dev.port)
+                log(f"{dev.name}: detached after {dev.packets} packets")
+
+    @staticmethod
+    def _device_record(dev):
+        name = dev.port.encode()
+        return STREAM_REC.pack(STREAM_REC_DEVICE, dev.id, len(name)) + name
+
+    def _accept(self, listener, pcap):
+        try:
+            sock, peer = listener.accept()
+        except OSError:
+            return
+        sock.setblocking(False)
+        sub = Subscriber(sock, pcap, f"{peer[0]}:{peer[1]}" if isinstance(peer, tuple) else "unix")
+        if pcap:
+            sub.out += PCAP_GLOBAL_HDR
+        else:
+            sub.out += STREAM_HEADER.pack(STREAM_MAGIC, STREAM_VERSION, 0)
+            for dev in self.devices.values():
+                sub.out += self._device_record(dev)
+        self._subscribers.append(sub)
+        self._sel.register(sock, sub.events, sub)
+        log(f"subscriber {sub.peer} connected ({'pcap' if pcap else 'stream'})")
+        self._flush(sub)
+
+    def _disconnect(self, sub, why):
+        if sub not in self._subscribers:
+            return
+        self._subscribers.remove(sub)
+        self._sel.unregister(sub.sock)
+        sub.sock.close()
+        log(f"subscriber {sub.peer} {why}")
+
+    def _broadcast(self, data, pcap):
+        for sub in tuple(self._subscribers):
+            if sub.pcap == pcap:
+                sub.out += data
+                if len(sub.out) > CLIENT_MAX_BUFFER:
+                    self._disconnect(sub, "dropped: not keeping up")
+
+    def _flush(self, sub):
+        if sub.out:
+            try:
+                del sub.out[:sub.sock.send(sub.out)]
+            except (BlockingIOError, InterruptedError):
+                pass
+            except OSError:
+                self._disconnect(sub, "disconnected")
+                return
+        # Only wait for writability while there is a backlog
+        events = selectors.EVENT_READ | (selectors.EVENT_WRITE if sub.out else 0)
+        if events != sub.events:
+            sub.events = events
+            self._sel.modify(sub.sock, events, sub)
+
+    def _service(self, sub, mask):
+        if mask & selectors.EVENT_READ:
+            # Subscribers have nothing to say; reading only notices them leaving
+            try:
+                if not sub.sock.recv(4096):
+                    self._disconnect(sub, "disconnected")
+                    return
+            except (BlockingIOError, InterruptedError):
+                pass
+            except OSError:
+                self._disconnect(sub, "disconnected")
+                return
+        if mask & selectors.EVENT_WRITE:
+            self._flush(sub)
+
+    def _publish(self, now=None):
+        q, merger = self._queue, self._merger
+        while q:
+            rec = q.popleft()
+            merger.push(rec[0], rec[1] / 1e6, rec)
+        ready = merger.pop_ready(now)
+        if not ready:
+            return
+        self.published += len(ready)
+
+        if self._pcap_writer:
+            write, devices = self._pcap_writer.write_packet, self.devices
+            names = {}
+            for dev_id, unix_us, channel, rssi, payload in ready:
+                name = names.get(dev_id)
+                if name is None:
+                    dev = devices.get(dev_id)
+                    name = names[dev_id] = dev.port if dev else str(dev_id)
+                write(name, unix_us, channel, rssi, payload)
+
+        # Encode each record once per format, only for formats someone reads
+        if any(not s.pcap for s in self._subscribers):
+            pack = STREAM_PKT_HDR.pack
+            data = bytearray()
+            for dev_id, unix_us, channel, rssi, payload in ready:
+                data += pack(STREAM_REC_PACKET, dev_id, STREAM_PKT.size + len(payload),
+                             unix_us, channel, rssi)
+                data += payload
+            self._broadcast(data, pcap=False)
+        if any(s.pcap for s in self._subscribers):
+            pack = PCAP_REC_HDR.pack
+            data = bytearray()
+            for dev_id, unix_us, channel, rssi, payload in ready:
+                rt = radiotap_header(channel, rssi)
+                n = len(rt) + len(payload)
+                data += pack(unix_us // 1_000_000, unix_us % 1_000_000, n, n)
+                data += rt
+                data += payload
+            self._broadcast(data, pcap=True)
+
+    def _emit_presence(self, now_us=None):
+        for window in self._presence.pop_ready(now_us):
+            log(f"[PRESENCE] {format_presence(window)}")
+            if self._presence_log:
+                self._presence_log.write(json.dumps(window) + "\n")
+                self._presence_log.flush()
+
+    def _log_status(self):
+        log(f"{len(self.devices)} devices, {self.published} packets published, "
+            f"{len(self._subscribers)} subscribers, {self.dropped} dropped, "
+            f"{self._merger.late} late")
+        for dev in self.devices.values():
+            seq = format_seq(dev.decoder)
+            if seq:
+                log(f"{dev.name} {seq}")
+
+    def run(self, stop_event):
+        next_scan = next_log = 0.0
+        while not stop_event.is_set():
+            now = time.monotonic()
+            if now >= next_scan:
+                self._scan()
+                next_scan = now + SCAN_INTERVAL_S
+            for key, mask in self._sel.select(PUBLISH_TICK_S):
+                if isinstance(key.data, Subscriber):
+                    self._service(key.data, mask)
+                else:
+                    self._accept(key.fileobj, key.data)
+            self._handle_events()
+            self._publish()
+            if self._presence:
+                self._emit_presence()
+            for sub in tuple(self._subscribers):
+                if sub.out:
+                    self._flush(sub)
+            if self._pcap_writer and self._pcap_writer.error and not self._pcap_failed:
+                self._pcap_failed = True
+                log(f"PCAPNG {self._pcap_writer.error}; recording stopped")
+            if now >= next_log:
+                if next_log:
+                    self._log_status()
+                next_log = now + STATUS_LOG_S
+        self.close()
+
+    def close(self):
+        for dev in tuple(self.devices.values()):
+            dev.close()
+        for dev in tuple(self.devices.values()):
+            dev.join(timeout=2)
+        self._handle_events()
+        # Everything still queued goes out: nobody is left to wait for
+        self._publish(now=float("inf"))
+        if self._presence:
+            self._emit_presence(now_us=1 << 62)
+        for sub in tuple(self._subscribers):
+            sub.sock.setblocking(True)
+            sub.sock.settimeout(1.0)
+            try:
+                sub.sock.sendall(sub.out)
+            except OSError:
+                pass
+            self._disconnect(sub, "closed at shutdown")
+        for key in tuple(self._sel.get_map().values()):
+            self._sel.unregister(key.fileobj)
+            key.fileobj.close()
+        for path in self._unix_paths:
+            try:
+                os.unlink(path)
+            except OSError:
+                pass
+        self._log_status()
+
+
+def read_stream(f):
+    """Yield (type, device, value) for each record of a --listen stream
+    read from binary file f: the port name for STREAM_REC_DEVICE, None for
+    STREAM_REC_GONE, (unix_us, channel, rssi, payload) for STREAM_REC_PACKET.
+    Stops at end of stream."""
+    head = f.read(STREAM_HEADER.size)
+    if len(head) < STREAM_HEADER.size:
+        return
+    magic, version, _ = STREAM_HEADER.unpack(head)
+    if magic != STREAM_MAGIC or version != STREAM_VERSION:
+        raise ValueError(f"not a 5dra stream (magic {magic!r}, version {version})")
+    while True:
+        hdr = f.read(STREAM_REC.size)
+        if len(hdr) < STREAM_REC.size:
+            return
+        rec_type, device, length = STREAM_REC.unpack(hdr)
+        body = f.read(length)
+        if len(body) < length:
+            return
+        if rec_type == STREAM_REC_PACKET:
+            unix_us, channel, rssi = STREAM_PKT.unpack_from(body)
+            yield rec_type, device, (unix_us, channel, rssi, body[STREAM_PKT.size:])
+        elif rec_type == STREAM_REC_DEVICE:
+            yield rec_type, device, body.decode("utf-8", "replace")
+        elif rec_type == STREAM_REC_GONE:
+            yield rec_type, device, None
+
+
+def dump(address):
+    """Print a daemon's --listen stream, one line per packet."""
+    names = {}
+    count = 0
+    with connect(address) as sock, sock.makefile("rb") as f:
+        for rec_type, device, value in read_stream(f):
+            if rec_type == STREAM_REC_DEVICE:
+                names[device] = short_name(value)
+                print(f"+ device {device} {value}")
+            elif rec_type == STREAM_REC_GONE:
+                print(f"- device {device} {names.get(device, '?')}")
+            else:
+                unix_us, channel, rssi, payload = value
+                name, da, sa = classify_frame(payload)
+                count += 1
+                print(f"#{count:<6d} "
+                      f"{names.get(device, str(device)):<10s} "
+                      f"{time.strftime('%H:%M:%S', time.localtime(unix_us / 1e6))}"
+                      f".{unix_us % 1_000_000:06d} "
+                      f"ch={channel:<3d} "
+                      f"rssi={rssi:<4d} "
+                      f"len={len(payload):<5d} "
+                      f"{name:<14s} "
+                      f"DA={da or '?':<17s} "
+                      f"SA={sa or '?'}")
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="5dra WiFi Packet Sniffer — Headless Capture Daemon")
+    parser.add_argument("ports", nargs="*",
+                        help="Serial ports or glob patterns to attach "
+                             f"(default: {' '.join(DEVICE_GLOBS)})")
+    parser.add_argument("-b", "--baud", type=int, default=921600,
+                        help="Baud rate (default: 921600)")
+    parser.add_argument("--listen", metavar="ADDR", action="append", default=[],
+                        help="Publish the 5dra stream on HOST:PORT or a Unix socket path "
+                             "(repeatable)")
+    parser.add_argument("--pcap-listen", metavar="ADDR", action="append", default=[],
+                        help="Publish a radiotap pcap stream (pcap-over-IP) on HOST:PORT "
+                             "or a Unix socket path (repeatable)")
+    parser.add_argument("-w", "--write", metavar="FILE", default=None,
+                        help="Also record the merged stream to a PCAPNG file "
+                             "(one interface per device)")
+    parser.add_argument("--rotate-mb", type=int, metavar="MB", default=0,
+                        help="With -w, start a new FILE-NNNNN segment every MB megabytes")
+    parser.add_argument("--rotate-min", type=int, metavar="MIN", default=0,
+                        help="With -w, start a new segment every MIN minutes")
+    parser.add_argument("--keep", type=int, metavar="N", default=0,
+                        help="With rotation, keep only the newest N segments")
+    parser.add_argument("--init", metavar="CMD", action="append", default=[],
+                        help="Command sent to every device when it attaches, e.g. "
+                             "\"CH 6\" or \"HOP 100 1,6,11\" (repeatable)")
+    parser.add_argument("--flow", type=int, metavar="BYTES", default=FLOW_WINDOW,
+                        help="Credit window for device flow control "
+                             f"(default: {FLOW_WINDOW}; 0=off)")
+    parser.add_argument("--merge-ms", type=int, metavar="MS",
+                        default=int(MERGE_LATENCY_S * 1000),
+                        help="Longest a packet waits for the other devices "
+                             f"(default: {int(MERGE_LATENCY_S * 1000)})")
+    parser.add_argument("--stats", action="store_true",
+                        help="Log each device's periodic STATS telemetry")
+    parser.add_argument("--presence", type=int, metavar="MS", default=0,
+                        help="Count probe-requesting stations per channel on every "
+                             "device and log the fleet-wide count per MS window; "
+                             "other frames are not sent")
+    parser.add_argument("--presence-log", metavar="FILE", default=None,
+                        help="With --presence, append each window to FILE as a JSON line")
+    parser.add_argument("--dump", metavar="ADDR", default=None,
+                        help="Instead of capturing, connect to a daemon's --listen "
+                             "ADDR and print its packets")
+    args = parser.parse_args()
+
+    if args.dump:
+        try:
+            dump(args.dump)
+        except (KeyboardInterrupt, BrokenPipeError):
+            pass
+        return
+
+    if not (args.listen or args.pcap_listen or args.write or args.presence):
+        parser.error("nothing to publish: give --listen, --pcap-listen, -w and/or --presence")
+    if args.presence_log and not args.presence:
+        parser.error("--presence-log needs --presence")
+
+    # Filter shorthand as in the CLI: "FILTER mgmt+data"
+    commands = [c.replace("+", " ").replace(",", " ") if c.upper().startswith("FILTER ") else c
+                for c in args.init]
+
+    pcap_writer = None
+    if args.write:
+        pcap_writer = PCAPNGWriter(args.write, rotate_bytes=args.rotate_mb << 20,
+                                   rotate_secs=args.rotate_min * 60, keep=args.keep)
+        log(f"recording to {args.write}")
+
+    presence_log = open(args.presence_log, "a") if args.presence_log else None
+    daemon = CaptureDaemon(args.ports or DEVICE_GLOBS, args.listen, args.pcap_listen,
+                           pcap_writer, commands, args.flow, args.baud,
+                           args.merge_ms / 1000, args.stats, args.presence, presence_log)
+
+    stop_event = threading.Event()
+    signal.signal(signal.SIGTERM, lambda *_: stop_event.set())
+    try:
+        daemon.run(stop_event)
+    except KeyboardInterrupt:
+        daemon.close()
+    finally:
+        if pcap_writer:
+            pcap_writer.close()
+            if pcap_writer.error:
+                log(f"PCAPNG recording failed: {pcap_writer.error} ({pcap_writer.packets} "
+                    f"packets written, {pcap_writer.dropped} dropped)")
+            else:
+                log(f"PCAPNG saved ({pcap_writer.packets} packets, {pcap_writer.dropped} dropped)")
+        if presence_log:
+            presence_log.close()
+
+
+if __name__ == "__main__":
+    main()
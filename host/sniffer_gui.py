@@ -6,140 +6,38 @@ Manages multiple ESP32-C5 sniffers simultaneously with a futuristic dark-themed
 interface, live packet display, device controls, and real-time visualizations.
 
 Usage:
-    python sniffer_gui.py
+    python sniffer_gui.py [--workers] [--open capture.pcapng]
 """
 
+import argparse
+import array
+import bisect
 import glob
-import math
+import json
+import mmap
+import multiprocessing
+import os
 import queue
 import struct
 import threading
 import time
+import zlib
 import tkinter as tk
-from tkinter import ttk, filedialog
-from collections import namedtuple
+from tkinter import ttk, filedialog, messagebox
+from collections import Counter, namedtuple
+from multiprocessing import shared_memory
 
 import serial
 
-# =============================================================================
-# Protocol layer (from sniffer.py)
-# =============================================================================
-
-SLIP_END = 0xC0
-SLIP_ESC = 0xDB
-SLIP_ESC_END = 0xDC
-SLIP_ESC_ESC = 0xDD
-
-MSG_TYPE_PACKET = 0x01
-MSG_TYPE_RESPONSE = 0x02
-MSG_TYPE_LOG = 0x03
-
-PCAP_MAGIC = 0xA1B2C3D4
-PCAP_VERSION = (2, 4)
-PCAP_SNAPLEN = 65535
-PCAP_LINKTYPE = 105
-
-FRAME_TYPES = {
-    (0, 0): "AssocReq", (0, 1): "AssocResp", (0, 2): "ReassocReq",
-    (0, 3): "ReassocResp", (0, 4): "ProbeReq", (0, 5): "ProbeResp",
-    (0, 8): "Beacon", (0, 9): "ATIM", (0, 10): "Disassoc",
-    (0, 11): "Auth", (0, 12): "Deauth", (0, 13): "Action",
-    (1, 8): "BlockAckReq", (1, 9): "BlockAck", (1, 10): "PS-Poll",
-    (1, 11): "RTS", (1, 12): "CTS", (1, 13): "ACK",
-    (2, 0): "Data", (2, 4): "Null", (2, 8): "QoS Data", (2, 12): "QoS Null",
-}
-
-
-def format_mac(raw):
-    return ":".join(f"{b:02x}" for b in raw)
-
-
-def classify_frame(payload):
-    if len(payload) < 2:
-        return "TooShort", None, None, -1
-    fc = payload[0]
-    frame_type = (fc >> 2) & 0x03
-    frame_subtype = (fc >> 4) & 0x0F
-    name = FRAME_TYPES.get((frame_type, frame_subtype),
-                           f"Type{frame_type}/Sub{frame_subtype}")
-    da = format_mac(payload[4:10]) if len(payload) >= 10 else None
-    sa = format_mac(payload[10:16]) if len(payload) >= 16 else None
-    return name, da, sa, frame_type
-
-
-class SLIPDecoder:
-    def __init__(self):
-        self._buf = bytearray()
-        self._escape = False
-
-    def feed(self, data):
-        frames = []
-        for b in data:
-            if b == SLIP_END:
-                if len(self._buf) > 0:
-                    frames.append(bytes(self._buf))
-                    self._buf = bytearray()
-                self._escape = False
-            elif b == SLIP_ESC:
-                self._escape = True
-            elif self._escape:
-                if b == SLIP_ESC_END:
-                    self._buf.append(SLIP_END)
-                elif b == SLIP_ESC_ESC:
-                    self._buf.append(SLIP_ESC)
-                else:
-                    self._buf.append(b)
-                self._escape = False
-            else:
-                self._buf.append(b)
-        return frames
-
-
-class PCAPWriter:
-    def __init__(self, path):
-        self._f = open(path, "wb")
-        header = struct.pack("<IHHiIII",
-                             PCAP_MAGIC, PCAP_VERSION[0], PCAP_VERSION[1],
-                             0, 0, PCAP_SNAPLEN, PCAP_LINKTYPE)
-        self._f.write(header)
-        self._f.flush()
-        self._lock = threading.Lock()
-
-    def write_packet(self, payload):
-        now = time.time()
-        ts_sec = int(now)
-        ts_usec = int((now - ts_sec) * 1_000_000)
-        pkt_len = len(payload)
-        record = struct.pack("<IIII", ts_sec, ts_usec, pkt_len, pkt_len)
-        with self._lock:
-            self._f.write(record)
-            self._f.write(payload)
-            self._f.flush()
-
-    def close(self):
-        self._f.close()
-
-
-def parse_frame(frame):
-    if len(frame) < 1:
-        return None
-    msg_type = frame[0]
-    if msg_type == MSG_TYPE_PACKET:
-        if len(frame) < 10:
-            return None
-        hdr = struct.unpack_from("<BBbBHI", frame, 0)
-        payload = frame[10:]
-        return msg_type, {
-            "channel": hdr[1], "rssi": hdr[2], "flags": hdr[3],
-            "sig_len": hdr[4], "timestamp": hdr[5],
-        }, payload
-    if msg_type == MSG_TYPE_RESPONSE:
-        text = frame[1:].decode("utf-8", errors="replace")
-        return msg_type, text, None
-    if msg_type == MSG_TYPE_LOG:
-        text = frame[1:].decode("utf-8", errors="replace")
-        return msg_type, text, None
-    return None
+from sniffer import (
+    AGG_MAX_PROBED, AGG_SNAPSHOT_S, DEDUP_WINDOW_MS, FLOW_WINDOW, FRAME_TYPES,
+    LINKTYPE_IEEE802_11_RADIOTAP, MERGE_LATENCY_S, MSG_TYPE_BATCH, MSG_TYPE_BEACON_SUMMARY,
+    MSG_TYPE_LOG, MSG_TYPE_PACKET, MSG_TYPE_RESPONSE, MSG_TYPE_STATS, PCAPNG_EPB, PCAPNG_IDB,
+    PCAPNG_OPT_END, PCAPNG_OPT_IF_NAME, PCAPNG_OPT_IF_TSRESOL, PCAPNG_SHB, RADIOTAP_HDR,
+    RADIOTAP_PRESENT, Aggregates, CreditTracker, DeviceClock, FrameDecoder, FrameDedup,
+    PCAPNGWriter, StreamMerger, batch_packets, dissect_frame, feed_decoder, format_mac,
+    make_decoder, parse_frame, write_snapshot,
+)
 
 
 # =============================================================================
@@ -181,12 +79,33 @@ FONT_HEADING = ("Menlo", 11, "bold")
 
 SIDEBAR_WIDTH = 290
 CHART_HEIGHT = 200
-MAX_TABLE_ROWS = 2000
-PRUNE_AMOUNT = 500
+TABLE_CAPACITY = 100_000    # Recent packets kept browsable in the table
+TABLE_DRAIN_MAX = 2000      # Packets taken per device per table update
+PACKET_RING_ROWS = 8192     # Packets a reader thread can be ahead of the table
+CHART_BUDGET_MS = 25        # Chart drawing per main-loop slice
+CHART_SLICE_GAP_MS = 10     # Pause between slices so table updates get in
+AGG_PUSH_US = 2_000_000     # Worker aggregate snapshots sent to the GUI this often
+AGG_PUSH_ROWS = 1000        # ...holding the most recently heard entries of each table
+AGG_VIEW_MS = 2000          # AnalyticsWindow refresh
+AGG_VIEW_ROWS = 500         # Busiest entries shown per table
+HOP_MAX_REVISIT_S = 15      # Longest a channel goes unvisited while hopping, --hop-revisit-s
+HOP_REPLAN_MS = 10_000      # Hop plan recomputed from recent activity this often
+HOP_IDLE_SHARE = 0.3        # Part of each cycle spread evenly over a device's channels
+HOP_BSSID_SCORE = 20        # A BSSID heard on a channel scores like this many packets/s
+HOP_BSSID_WINDOW_S = 60     # ...if heard this recently
+HOP_RATE_ALPHA = 0.5        # Weight of the latest window in a channel's rate
+HOP_HYSTERESIS = 0.25       # Relative change a replan ignores
+HOP_SLOT_WEIGHT = 4         # Busy channels are split into HOP entries of at most this weight
+HOP_MIN_DWELL_MS = 10       # Firmware limits (hop.h)
+HOP_MAX_DWELL_MS = 60000
+HOP_MAX_WEIGHT = 16
+HOP_MAX_SLOTS = 48
+HOP_LINE_MAX = 255          # Longest command line the firmware reads whole (cmd.c)
 
 PacketRecord = namedtuple("PacketRecord", [
     "seq", "device_idx", "port_short", "channel", "rssi",
-    "length", "frame_type", "type_code", "da", "sa", "timestamp", "payload"
+    "length", "frame_type", "type_code", "da", "sa", "timestamp",
+    "digest",   # (CRC-32, length) of the payload, for FrameDedup
 ])
 
 
@@ -213,6 +132,189 @@ class RingBuffer:
         return self._data[self._idx:] + self._data[:self._idx]
 
 
+def merge_aggregates(snapshots):
+    """Combine per-device Aggregates.snapshot() pairs into one pair.
+
+    Counts add up, so a frame heard by two devices counts twice. RSSI is
+    the best device's figure. Channel, SSID, association and sequence
+    number come from the device that heard the entry most recently.
+    """
+    merged = []
+    for table, key in ((0, "bssid"), (1, "mac")):
+        rows = {}
+        for snap in snapshots:
+            for row in snap[table]:
+                cur = rows.get(row[key])
+                if cur is None:
+                    rows[row[key]] = dict(row)
+                    continue
+                for field in ("beacons", "frames", "data", "retries", "probes"):
+                    if field in row:
+                        cur[field] += row[field]
+                if row["rssi"] is not None and (cur["rssi"] is None or row["rssi"] > cur["rssi"]):
+                    cur["rssi"] = row["rssi"]
+                if "stations" in row:
+                    cur["stations"] = max(cur["stations"], row["stations"])
+                if "ssids" in row:
+                    cur["ssids"] = (cur["ssids"] + [s for s in row["ssids"]
+                                                    if s not in cur["ssids"]])[:AGG_MAX_PROBED]
+                cur["first_seen"] = min(cur["first_seen"], row["first_seen"])
+                if row["last_seen"] > cur["last_seen"]:
+                    cur["last_seen"] = row["last_seen"]
+                    for field in ("ssid", "channel", "bssid", "seq"):
+                        if row.get(field) is not None and field != key:
+                            cur[field] = row[field]
+        merged.append(sorted(rows.values(), key=lambda r: -r["last_seen"]))
+    return merged[0], merged[1]
+
+
+def hop_command(dwell_ms, slots):
+    return f"HOP {dwell_ms} " + ",".join(f"{ch}:{w}" if w > 1 else str(ch) for ch, w in slots)
+
+
+class HopPlanner:
+    """Activity-weighted channel hopping plan for the whole device fleet.
+
+    The channels are split between the devices, so no two radios are ever
+    on the same channel. Each device gets one HOP list holding every
+    channel it owns. A channel's score is its packet rate while listened to
+    plus HOP_BSSID_SCORE per BSSID heard there; HOP_IDLE_SHARE of the cycle
+    is spread evenly and the rest follows the scores. Busy channels get
+    more dwell, split into entries spread over the cycle so they also come
+    round sooner; idle ones get one base-dwell entry per cycle. The base
+    dwell shrinks until a cycle fits max_revisit_ms, which bounds how long
+    any channel goes unvisited.
+    """
+
+    def __init__(self, channels, dwell_ms, max_revisit_ms):
+        self.channels = list(channels)
+        self.dwell_ms = dwell_ms
+        self.max_revisit_ms = max_revisit_ms
+        self.rates = {}      # channel -> packets/s while listened to, EMA over observe()
+        self.bssids = {}     # channel -> BSSIDs heard there recently
+        self.owner = {}      # channel -> device
+        self.plans = {}      # device -> (dwell_ms, [(channel, weight), ...])
+        self._weights = {}   # channel -> weight of the last plan, for hysteresis
+        self._counts = {}    # packets per channel since the last observe()
+
+    def count(self, channel_counts):
+        for ch, n in channel_counts.items():
+            self._counts[ch] = self._counts.get(ch, 0) + n
+
+    def listen_share(self, channel):
+        """Fraction of the time some radio is on channel under the current plan."""
+        plan = self.plans.get(self.owner.get(channel))
+        if plan is None:
+            return 0.0
+        slots = plan[1]
+        return sum(w for ch, w in slots if ch == channel) / sum(w for _, w in slots)
+
+    def observe(self, seconds, bssids=None):
+        """Turn the counts since the last call into per-channel rates."""
+        if seconds > 0:
+            for ch in self.channels:
+                share = self.listen_share(ch)
+                if share <= 0:
+                    continue
+                rate = self._counts.get(ch, 0) / (seconds * share)
+                old = self.rates.get(ch)
+                self.rates[ch] = rate if old is None else old + (rate - old) * HOP_RATE_ALPHA
+        self._counts = {}
+        if bssids is not None:
+            self.bssids = bssids
+
+    def plan(self, devices):
+        """Recompute the plan for devices, in attach order. Devices beyond
+        the number of channels get none. Returns {device: plan}."""
+        devices = list(devices)[:len(self.channels)]
+        if not devices:
+            self.owner, self.plans = {}, {}
+            return self.plans
+
+        # Weight units each channel asks for: 1, plus its part of the busy time
+        scores = {ch: self.rates.get(ch, 0.0) + HOP_BSSID_SCORE * self.bssids.get(ch, 0)
+                  for ch in self.channels}
+        total = sum(scores.values())
+        busy = len(self.channels) * (1 - HOP_IDLE_SHARE) / HOP_IDLE_SHARE
+        want = {ch: 1 + (busy * scores[ch] / total if total else 0) for ch in self.channels}
+
+        # Balance the units over the devices; a channel stays where it was
+        # unless that device is over its share, so replans move little
+        target = sum(want.values()) / len(devices) * (1 + HOP_HYSTERESIS)
+        loads = dict.fromkeys(devices, 0.0)
+        owner = {}
+        for ch in sorted(self.channels, key=lambda c: -want[c]):
+            dev = self.owner.get(ch)
+            if dev not in loads or loads[dev] + want[ch] > target:
+                dev = min(loads, key=loads.get)
+            owner[ch] = dev
+            loads[dev] += want[ch]
+        for dev in devices:
+            if dev not in owner.values():
+                # Every radio gets a channel: take the lightest of the busiest device
+                donor = max(loads, key=lambda d: sum(1 for o in owner.values() if o == d))
+                ch = min((c for c in owner if owner[c] == donor), key=want.get)
+                owner[ch] = dev
+        self.owner = owner
+
+        self.plans = {}
+        for dev in devices:
+            chans = [ch for ch in self.channels if owner[ch] == dev]
+            if len(chans) == 1:
+                # Parked: nothing to hop to
+                self.plans[dev] = (HOP_MAX_DWELL_MS, [(chans[0], 1)])
+                continue
+            weights = {}
+            for ch in chans:
+                w = max(1, round(want[ch]))
+                old = self._weights.get(ch)
+                if old is not None and abs(w - old) <= max(1, old * HOP_HYSTERESIS):
+                    w = old
+                weights[ch] = w
+            # Even at the shortest dwell the cycle must fit the revisit bound
+            while sum(weights.values()) * HOP_MIN_DWELL_MS > self.max_revisit_ms:
+                busiest = max(weights, key=weights.get)
+                if weights[busiest] == 1:
+                    break
+                weights[busiest] -= 1
+            self._weights.update(weights)
+            dwell = int(min(self.dwell_ms, self.max_revisit_ms / sum(weights.values())))
+            dwell = max(dwell, HOP_MIN_DWELL_MS)
+            split = {ch: -(-weights[ch] // HOP_SLOT_WEIGHT) for ch in chans}
+            while True:
+                slots = self._slots(chans, weights, split)
+                if len(slots) <= HOP_MAX_SLOTS and len(hop_command(dwell, slots)) <= HOP_LINE_MAX:
+                    break
+                ch = max(split, key=split.get)
+                if split[ch] == 1:
+                    break
+                split[ch] -= 1
+            self.plans[dev] = (dwell, slots)
+        return self.plans
+
+    @staticmethod
+    def _slots(chans, weights, split):
+        """HOP entries: each channel's weight split into split[ch] entries,
+        spread evenly through the list, each channel with its own phase so
+        the single entries do not bunch up."""
+        entries = []
+        for order, ch in enumerate(chans):
+            k = split[ch]
+            w = min(weights[ch], k * HOP_MAX_WEIGHT)
+            phase = (order + 0.5) / len(chans)
+            for i in range(k):
+                entries.append(((i + phase) / k, order, ch, w // k + (i < w % k)))
+        entries.sort()
+        slots = []
+        for _, _, ch, w in entries:
+            # Back-to-back entries of one channel would only cost a switch
+            if slots and slots[-1][0] == ch and slots[-1][1] + w <= HOP_MAX_WEIGHT:
+                slots[-1] = (ch, slots[-1][1] + w)
+            else:
+                slots.append((ch, w))
+        return slots
+
+
 class DeviceState:
     def __init__(self, port, device_idx, color):
         self.port = port
@@ -221,11 +323,15 @@ class DeviceState:
         self.color = color
         self.ser = None
         self.thread = None
+        self.worker = None      # CaptureWorker when the reader runs in a process
+        self.pcap_error = None  # Worker mode: why this device's PCAPNG writer stopped
         self.stop_event = threading.Event()
-        self.packet_queue = queue.Queue(maxsize=5000)
+        self.ring = PacketRing(capacity=PACKET_RING_ROWS)
         self.response_queue = queue.Queue(maxsize=100)
-        self.decoder = SLIPDecoder()
+        self.decoder = make_decoder()
         self.write_lock = threading.Lock()
+        self.credit = CreditTracker(FLOW_WINDOW, self.send_command)
+        self.clock = DeviceClock()
 
         # Settings
         self.channel = 1
@@ -235,16 +341,36 @@ class DeviceState:
         self.filter_ctrl = True
         self.snaplen = 0
         self.channel_pending = False  # True after user changes channel, until STATUS confirms
+        self.hop_mode = None  # While hopping: "pending", "firmware" (HOP) or "host" (CH ticks)
 
         # Stats
         self.pkt_count = 0
-        self.drop_count = 0
+        self.drop_count = 0     # Packets the table fell a whole ring behind on
+        self.seq_lost = 0       # Worker mode: the worker's decoder.seq_lost
+        self.beacon_dedup = 0   # Repeat beacons folded into summaries by the device
+        self.beacon_summaries = {}  # bssid -> latest summary dict
         self.pps_counter = 0
         self.pps_ring = RingBuffer(60)
         self.total_ring = RingBuffer(60)
         self.last_pps_time = time.time()
 
+        # Device telemetry (MSG_TYPE_STATS), one sample per record
+        self.stats = None
+        self.usb_kbps_ring = RingBuffer(60)
+        self.ring_pct_ring = RingBuffer(60)
+
+        # Per-BSSID/per-station tables: kept here by the reader thread, or
+        # the worker's latest snapshot
+        self.aggregates = Aggregates()
+        self.worker_aggregates = ([], [])
+
+    def aggregate_snapshot(self):
+        return self.worker_aggregates if self.worker else self.aggregates.snapshot()
+
     def send_command(self, cmd):
+        if self.worker:
+            self.worker.send(cmd)
+            return
         if self.ser and self.ser.is_open:
             with self.write_lock:
                 try:
@@ -252,75 +378,124 @@ class DeviceState:
                 except serial.SerialException:
                     pass
 
+    def stop(self):
+        self.stop_event.set()
+        if self.worker:
+            self.worker.close()
+            return
+        try:
+            self.ser.close()
+        except Exception:
+            pass
+
+    # device_reader_loop callbacks, one per message kind
+
+    def on_response(self, text):
+        try:
+            self.response_queue.put_nowait(text)
+        except queue.Full:
+            pass
+
+    def on_stats(self, st):
+        self.stats = st
+        self.usb_kbps_ring.append(st["usb_bytes_per_s"] // 1024)
+        if st["ring_size"]:
+            self.ring_pct_ring.append(st["ring_hwm"] * 100 // st["ring_size"])
+
+    def on_beacon_summary(self, summary):
+        self.beacon_dedup += summary["count"]
+        self.beacon_summaries[summary["bssid"]] = summary
+
+    def on_packet(self, channel, rssi, timestamp, payload, writer):
+        self.pkt_count += 1
+        self.pps_counter += 1
+        unix_us = self.clock.to_unix_us(timestamp)
+        self.ring.push(unix_us, zlib.crc32(payload), len(payload), channel, rssi,
+                       type_slot(payload), payload[4:10], payload[10:16])
+
+        if writer:
+            writer.write_packet(self.port, unix_us, channel, rssi, payload)
+        self.aggregates.add(payload, channel, rssi, unix_us)
+
 
 # =============================================================================
 # Thread workers
 # =============================================================================
 
 def device_reader_loop(device, pcap_writer_ref):
-    """Read serial data, decode SLIP, parse packets, enqueue for GUI."""
+    """Read serial data, decode frames, hand each message to the device.
+
+    device is a DeviceState (reader thread) or a WorkerDevice (capture
+    worker process); both provide ser, decoder, credit, clock, stop_event,
+    send_command and the on_* callbacks. TIMESYNC exchanges run from here
+    so the reply is timed by the thread that reads it.
+    """
     while not device.stop_event.is_set():
+        request = device.clock.sync_request()
+        if request:
+            device.send_command(request)
+        device.credit.poll()
         try:
             data = device.ser.read(4096)
         except (serial.SerialException, OSError):
             break
         if not data:
             continue
+        recv_us = int(time.time() * 1_000_000)
+
+        frames, packets, nbytes = feed_decoder(device.decoder, data)
+        device.credit.consumed(nbytes, device.decoder)
+        writer = pcap_writer_ref()
 
-        for frame in device.decoder.feed(data):
+        for frame in frames:
             parsed = parse_frame(frame)
             if parsed is None:
+                device.credit.resync()
                 continue
 
-            msg_type = parsed[0]
+            batch = parsed[1] if parsed[0] == MSG_TYPE_BATCH else (parsed,)
+            for parsed in batch:
+                msg_type = parsed[0]
 
-            if msg_type == MSG_TYPE_RESPONSE:
-                try:
-                    device.response_queue.put_nowait(parsed[1])
-                except queue.Full:
-                    pass
-                continue
+                if msg_type == MSG_TYPE_RESPONSE:
+                    device.credit.note_response(parsed[1])
+                    if not device.clock.note_response(parsed[1], recv_us):
+                        device.on_response(parsed[1])
+                    continue
 
-            if msg_type == MSG_TYPE_LOG:
-                continue
+                if msg_type == MSG_TYPE_LOG:
+                    continue
 
-            if msg_type == MSG_TYPE_PACKET:
-                hdr, payload = parsed[1], parsed[2]
-                device.pkt_count += 1
-                device.pps_counter += 1
-
-                name, da, sa, type_code = classify_frame(payload)
-
-                rec = PacketRecord(
-                    seq=device.pkt_count,
-                    device_idx=device.device_idx,
-                    port_short=device.port_short,
-                    channel=hdr["channel"],
-                    rssi=hdr["rssi"],
-                    length=len(payload),
-                    frame_type=name,
-                    type_code=type_code,
-                    da=da or "?",
-                    sa=sa or "?",
-                    timestamp=time.time(),
-                    payload=payload,
-                )
+                if msg_type == MSG_TYPE_STATS:
+                    device.on_stats(parsed[1])
+                    continue
 
-                try:
-                    device.packet_queue.put_nowait(rec)
-                except queue.Full:
-                    device.drop_count += 1
+                if msg_type == MSG_TYPE_BEACON_SUMMARY:
+                    device.on_beacon_summary(parsed[1])
+                    continue
+
+                if msg_type == MSG_TYPE_PACKET:
+                    hdr = parsed[1]
+                    if "seq" in hdr:
+                        device.decoder.note_seq(hdr["seq"])
+                    device.on_packet(hdr["channel"], hdr["rssi"], hdr["timestamp"],
+                                     parsed[2], writer)
+
+        if packets is not None:
+            for channel, rssi, timestamp, payload in batch_packets(packets):
+                device.on_packet(channel, rssi, timestamp, payload, writer)
 
-                writer = pcap_writer_ref()
-                if writer:
-                    writer.write_packet(payload)
+
+DEVICE_GLOBS = ("/dev/cu.usbmodem*", "/dev/ttyACM*")   # macOS, Linux
 
 
 def scanner_loop(scanner_queue, stop_event):
     """Poll for USB modem devices every 2s."""
     known = set()
     while not stop_event.is_set():
-        current = set(glob.glob("/dev/cu.usbmodem*"))
+        current = set()
+        for pattern in DEVICE_GLOBS:
+            current.update(glob.glob(pattern))
         for port in current - known:
             scanner_queue.put(("add", port))
         for port in known - current:
@@ -329,6 +504,757 @@ def scanner_loop(scanner_queue, stop_event):
         stop_event.wait(2.0)
 
 
+# =============================================================================
+# Capture worker processes (--workers)
+# =============================================================================
+#
+# With --workers each device reader runs in its own process, so decoding,
+# classification and PCAP writing no longer share the GIL with Tk. The
+# worker publishes running totals and a ring of recent packet rows in one
+# shared-memory block per device; the GUI polls that block instead of
+# receiving every frame. Responses and STATS records, a few per second,
+# come back over a multiprocessing queue.
+
+SHM_TYPE_SLOTS = 65          # (type << 4 | subtype) for 0..63, 64 = TooShort
+SHM_RSSI_BINS = 18
+SHM_ROWS = 4096              # Recent packet rows kept for the table
+SHM_ROW = struct.Struct("<QqIHBbB6s6s3x")  # seq, unix us, crc, length, channel, rssi, type slot, da, sa
+
+
+class DeviceShm:
+    """Shared-memory block written by one capture worker, read by the GUI.
+
+    Layout, all little-endian uint64 unless noted: header (packets,
+    beacon_dedup, row head, PKTHDR 2 sequence gaps, 4 reserved), per-channel packet counts [256],
+    per-frame-type counts [SHM_TYPE_SLOTS], RSSI histogram [SHM_RSSI_BINS],
+    then SHM_ROWS fixed-size SHM_ROW slots. Counters only ever grow; the
+    reader takes deltas. A row is published by writing the slot and then
+    bumping the row head, and the reader discards any slot the writer may
+    have lapped while it was being read.
+    """
+
+    HEADER_WORDS = 8
+    COUNT_WORDS = HEADER_WORDS + 256 + SHM_TYPE_SLOTS + SHM_RSSI_BINS
+    ROWS_OFFSET = COUNT_WORDS * 8
+    SIZE = ROWS_OFFSET + SHM_ROWS * SHM_ROW.size
+
+    H_PACKETS, H_BEACON_DEDUP, H_ROW_HEAD, H_SEQ_LOST = 0, 1, 2, 3
+
+    def __init__(self, name=None):
+        if name is None:
+            self._shm = shared_memory.SharedMemory(create=True, size=self.SIZE)
+            self._shm.buf[:self.SIZE] = bytes(self.SIZE)
+        else:
+            self._shm = shared_memory.SharedMemory(name=name)
+        self.name = self._shm.name
+        self.words = self._shm.buf[:self.ROWS_OFFSET].cast("Q")
+        self.rows = self._shm.buf[self.ROWS_OFFSET:self.SIZE]
+
+    def counts(self):
+        """Snapshot of (channel, type, rssi) counters as one list."""
+        return self.words[self.HEADER_WORDS:self.COUNT_WORDS].tolist()
+
+    def close(self, unlink=False):
+        self.words.release()
+        self.rows.release()
+        self._shm.close()
+        if unlink:
+            self._shm.unlink()
+
+
+def type_slot(payload):
+    if len(payload) < 2:
+        return SHM_TYPE_SLOTS - 1
+    fc = payload[0]
+    return ((fc >> 2) & 0x03) << 4 | (fc >> 4)
+
+
+def slot_name(slot):
+    """Frame type name of a type_slot(), as classify_frame() names it."""
+    if slot == SHM_TYPE_SLOTS - 1:
+        return "TooShort"
+    return FRAME_TYPES.get((slot >> 4, slot & 0x0F), f"Type{slot >> 4}/Sub{slot & 0x0F}")
+
+
+class PacketRing:
+    """Preallocated single-producer, single-consumer ring of SHM_ROW rows.
+
+    Each row holds what the table and FrameDedup need, not the payload.
+    push() packs a row into its slot and then bumps the head word, which
+    only the producer writes, so neither side takes a lock. take()
+    unpacks the rows since the last take in at most two slices and drops
+    any the producer may have lapped meanwhile. rows and words are a
+    DeviceShm's for a capture worker and private buffers for a reader
+    thread.
+    """
+
+    def __init__(self, rows=None, words=None, head_word=0, capacity=SHM_ROWS):
+        self.capacity = capacity
+        self.rows = bytearray(capacity * SHM_ROW.size) if rows is None else rows
+        self.words = array.array("Q", [0]) if words is None else words
+        self.head_word = head_word
+        self.tail = 0
+        self.lost = 0       # Rows overwritten before take() got to them
+
+    def push(self, unix_us, crc, length, channel, rssi, slot, da, sa):
+        head = self.words[self.head_word]
+        SHM_ROW.pack_into(self.rows, (head % self.capacity) * SHM_ROW.size,
+                          head, unix_us, crc, length, channel, rssi, slot, da, sa)
+        self.words[self.head_word] = head + 1
+
+    def take(self, max_rows, newest=False):
+        """Up to max_rows rows (seq, unix us, crc, length, channel, rssi,
+        type slot, da, sa) in order: the oldest not yet taken, the rest left
+        for the next call, or with newest the most recent, skipping the rest."""
+        size, cap = SHM_ROW.size, self.capacity
+        head = self.words[self.head_word]
+        first = max(self.tail, head - cap)
+        if newest:
+            first = max(first, head - max_rows)
+        else:
+            self.lost += first - self.tail
+            head = min(head, first + max_rows)
+        unpacked = []
+        pos = first
+        while pos < head:
+            end = min(head, pos - pos % cap + cap)
+            offset = pos % cap
+            unpacked += SHM_ROW.iter_unpack(self.rows[offset * size:(offset + end - pos) * size])
+            pos = end
+        # Anything the writer may have overwritten meanwhile is dropped
+        lapped = self.words[self.head_word] - cap
+        self.tail = head
+        rows = [row for i, row in enumerate(unpacked, first) if row[0] == i and i >= lapped]
+        if not newest:
+            self.lost += len(unpacked) - len(rows)
+        return rows
+
+
+def packet_records(dev, rows):
+    """PacketRecords of PacketRing rows taken from dev."""
+    records = []
+    for seq, unix_us, crc, length, channel, rssi, slot, da, sa in rows:
+        records.append(PacketRecord(
+            seq=seq + 1,
+            device_idx=dev.device_idx,
+            port_short=dev.port_short,
+            channel=channel,
+            rssi=rssi,
+            length=length,
+            frame_type=slot_name(slot),
+            type_code=-1 if slot == SHM_TYPE_SLOTS - 1 else slot >> 4,
+            da=format_mac(da) if length >= 10 else "?",
+            sa=format_mac(sa) if length >= 16 else "?",
+            timestamp=unix_us / 1e6,
+            digest=(crc, length),
+        ))
+    return records
+
+
+class WorkerDevice:
+    """device_reader_loop target inside a capture worker process."""
+
+    def __init__(self, port, shm_name, cmd_queue, event_queue, stop_event):
+        self.port = port
+        self.ser = serial.Serial(port, 921600, timeout=0.5)
+        self.decoder = make_decoder()
+        self.write_lock = threading.Lock()
+        self.credit = CreditTracker(FLOW_WINDOW, self.send_command)
+        self.clock = DeviceClock()
+        self.stop_event = stop_event
+        self.pcap_writer = None
+        self._pcap_reported = None   # Writer whose error went to the GUI
+
+        self.shm = DeviceShm(shm_name)
+        self._events = event_queue
+        self._commands = cmd_queue
+        self._words = self.shm.words
+        self.ring = PacketRing(self.shm.rows, self._words, DeviceShm.H_ROW_HEAD)
+        self._chan_base = DeviceShm.HEADER_WORDS
+        self._type_base = self._chan_base + 256
+        self._rssi_base = self._type_base + SHM_TYPE_SLOTS
+        self.aggregates = Aggregates()
+        self._agg_next = 0
+
+    def send_command(self, cmd):
+        with self.write_lock:
+            try:
+                self.ser.write((cmd + "\n").encode())
+            except serial.SerialException:
+                pass
+
+    def command_loop(self):
+        """Serial writes and PCAP switches requested by the GUI."""
+        while True:
+            item = self._commands.get()
+            if item is None:
+                return
+            kind, arg = item
+            if kind == "cmd":
+                self.send_command(arg)
+            elif kind == "pcap":
+                old, self.pcap_writer = self.pcap_writer, None
+                if old:
+                    old.close()
+                if arg:
+                    try:
+                        self.pcap_writer = PCAPNGWriter(arg[0], **arg[1])
+                    except OSError as e:
+                        self._event("pcap_error", f"{arg[0]}: {e}")
+
+    def _event(self, kind, value):
+        try:
+            self._events.put_nowait((kind, value))
+        except queue.Full:
+            pass
+
+    def on_response(self, text):
+        self._event("response", text)
+
+    def on_stats(self, st):
+        self._event("stats", st)
+
+    def on_beacon_summary(self, summary):
+        self._words[DeviceShm.H_BEACON_DEDUP] += summary["count"]
+
+    def on_packet(self, channel, rssi, timestamp, payload, writer):
+        words = self._words
+        slot = type_slot(payload)
+        words[DeviceShm.H_PACKETS] += 1
+        words[DeviceShm.H_SEQ_LOST] = self.decoder.seq_lost
+        words[self._chan_base + channel] += 1
+        words[self._type_base + slot] += 1
+        words[self._rssi_base + max(0, min(SHM_RSSI_BINS - 1, (rssi + 100) // 5))] += 1
+        unix_us = self.clock.to_unix_us(timestamp)
+        self.ring.push(unix_us, zlib.crc32(payload), len(payload), channel, rssi, slot,
+                       payload[4:10], payload[10:16])
+
+        if writer:
+            writer.write_packet(self.port, unix_us, channel, rssi, payload)
+            if writer.error and writer is not self._pcap_reported:
+                self._pcap_reported = writer
+                self._event("pcap_error", str(writer.error))
+
+        self.aggregates.add(payload, channel, rssi, unix_us)
+        if unix_us >= self._agg_next:
+            self._agg_next = unix_us + AGG_PUSH_US
+            self._event("aggregates", self.aggregates.snapshot(AGG_PUSH_ROWS))
+
+    def close(self):
+        if self.pcap_writer:
+            self.pcap_writer.close()
+        try:
+            self.ser.close()
+        except Exception:
+            pass
+        self._words = self.ring = None
+        self.shm.close()
+
+
+def capture_worker_main(port, shm_name, cmd_queue, event_queue, stop_event):
+    """Entry point of a capture worker process."""
+    try:
+        device = WorkerDevice(port, shm_name, cmd_queue, event_queue, stop_event)
+    except (serial.SerialException, OSError):
+        return
+    threading.Thread(target=device.command_loop, daemon=True).start()
+    device_reader_loop(device, lambda: device.pcap_writer)
+    device.close()
+
+
+class CaptureWorker:
+    """GUI-side handle for a device whose reader runs in its own process."""
+
+    def __init__(self, dev):
+        ctx = multiprocessing.get_context("spawn")   # fork is unsafe with Tk
+        self.shm = DeviceShm()
+        self.stop_event = ctx.Event()
+        self._commands = ctx.Queue()
+        self._events = ctx.Queue(maxsize=1000)
+        self.ring = PacketRing(self.shm.rows, self.shm.words, DeviceShm.H_ROW_HEAD)
+        self._packets = 0
+        self._counts = self.shm.counts()
+        self.proc = ctx.Process(
+            target=capture_worker_main,
+            args=(dev.port, self.shm.name, self._commands, self._events, self.stop_event),
+            daemon=True)
+        self.proc.start()
+
+    def send(self, cmd):
+        self._commands.put(("cmd", cmd))
+
+    def set_pcap(self, path, options=None):
+        """Start (path) or stop (None) this worker's own PCAPNG file; options
+        are the PCAPNGWriter rotation keywords."""
+        self._commands.put(("pcap", (path, options or {}) if path else None))
+
+    def poll(self, dev, channel_counts, frame_type_counts, rssi_bins, max_rows):
+        """Fold new counters and events into dev and the GUI totals, and
+        return up to max_rows of the most recent packets as PacketRecords."""
+        while True:
+            try:
+                kind, value = self._events.get_nowait()
+            except queue.Empty:
+                break
+            if kind == "response":
+                dev.on_response(value)
+            elif kind == "stats":
+                dev.on_stats(value)
+            elif kind == "aggregates":
+                dev.worker_aggregates = value
+            elif kind == "pcap_error":
+                dev.pcap_error = value
+
+        words = self.shm.words
+        packets = words[DeviceShm.H_PACKETS]
+        dev.pps_counter += packets - self._packets
+        dev.pkt_count = self._packets = packets
+        dev.beacon_dedup = words[DeviceShm.H_BEACON_DEDUP]
+        dev.seq_lost = words[DeviceShm.H_SEQ_LOST]
+
+        counts = self.shm.counts()
+        last = self._counts
+        for ch in range(256):
+            if counts[ch] != last[ch]:
+                channel_counts[ch] = channel_counts.get(ch, 0) + counts[ch] - last[ch]
+        for slot in range(SHM_TYPE_SLOTS):
+            i = 256 + slot
+            if counts[i] != last[i]:
+                name = slot_name(slot)
+                frame_type_counts[name] = frame_type_counts.get(name, 0) + counts[i] - last[i]
+        for b in range(SHM_RSSI_BINS):
+            i = 256 + SHM_TYPE_SLOTS + b
+            rssi_bins[b] += counts[i] - last[i]
+        self._counts = counts
+
+        return packet_records(dev, self.ring.take(max_rows, newest=True))
+
+    def close(self):
+        self.stop_event.set()
+        self._commands.put(None)
+        self.proc.join(timeout=2.0)
+        if self.proc.is_alive():
+            self.proc.terminate()
+            self.proc.join(timeout=1.0)
+        self.ring = None
+        self.shm.close(unlink=True)
+
+
+# =============================================================================
+# Capture replay
+# =============================================================================
+#
+# OPEN maps a recorded PCAPNG (or classic pcap) read-only and indexes it
+# once into <capture>.pidx: one column per field, sorted by timestamp.
+# Time ranges are a bisect on the timestamp column and filters scan the
+# small columns, so neither touches the capture again; the table reads
+# the MAC addresses of the rows it is showing from the mapped file.
+
+PIDX_MAGIC = b"5DRAPIDX"
+PIDX_VERSION = 1
+PIDX_HEADER = struct.Struct("<8sIIQqQ")  # magic, version, names length, capture size, mtime ns, packets
+# name, typecode; widest first so every column stays aligned
+PIDX_COLUMNS = (("ts", "q"), ("offset", "Q"), ("bss", "I"), ("length", "H"),
+                ("iface", "H"), ("channel", "B"), ("rssi", "b"), ("slot", "B"))
+PCAPNG_BOM = 0x1A2B3C4D
+PCAP_MAGIC_US = 0xA1B2C3D4
+PCAP_MAGIC_NS = 0xA1B23C4D
+LINKTYPE_IEEE802_11 = 105
+REPLAY_BUCKETS = 60          # Points of the rate charts over the selected time range
+# Radiotap fields up to dBm signal: (present bit, alignment, size)
+RADIOTAP_FIELDS = ((0, 8, 8), (1, 1, 1), (2, 1, 1), (3, 2, 4), (4, 2, 2), (5, 1, 1))
+
+
+def freq_channel(freq):
+    if freq == 2484:
+        return 14
+    if 2407 < freq < 2484:
+        return (freq - 2407) // 5
+    if freq >= 5000:
+        return (freq - 5000) // 5
+    return 0
+
+
+def radiotap_fields(buf, off, end):
+    """(header length, channel, dBm signal) of the radiotap header at off."""
+    if end - off < 8:
+        return end - off, 0, 0
+    hlen = buf[off + 2] | buf[off + 3] << 8
+    present = struct.unpack_from("<I", buf, off + 4)[0]
+    if hlen == RADIOTAP_HDR.size and present == RADIOTAP_PRESENT and off + hlen <= end:
+        # What PCAPNGWriter writes
+        f = RADIOTAP_HDR.unpack_from(buf, off)
+        return hlen, freq_channel(f[5]), f[7]
+    channel = rssi = 0
+    p, word = off + 8, present
+    while word & (1 << 31) and p + 4 <= off + hlen:
+        word = struct.unpack_from("<I", buf, p)[0]
+        p += 4
+    for bit, align, size in RADIOTAP_FIELDS:
+        if not present & (1 << bit):
+            continue
+        p += -(p - off) % align
+        if p + size > off + hlen:
+            break
+        if bit == 3:
+            channel = freq_channel(struct.unpack_from("<H", buf, p)[0])
+        elif bit == 5:
+            rssi = struct.unpack_from("<b", buf, p)[0]
+        p += size
+    return hlen, channel, rssi
+
+
+def scan_capture(buf, default_name="capture"):
+    """Yield (interface name, unix us, channel, rssi, payload offset,
+    payload length) for every 802.11 frame in a mapped capture. A block
+    cut short at the end (a file still being written) ends the scan."""
+    n = len(buf)
+    if n < 24:
+        raise ValueError("not a capture file")
+    magic = struct.unpack_from("<I", buf, 0)[0]
+    if magic in (PCAP_MAGIC_US, PCAP_MAGIC_NS):
+        linktype = struct.unpack_from("<I", buf, 20)[0]
+        per_sec = 1_000_000 if magic == PCAP_MAGIC_US else 1_000_000_000
+        pos = 24
+        while pos + 16 <= n:
+            sec, frac, caplen, _ = struct.unpack_from("<IIII", buf, pos)
+            data, end = pos + 16, pos + 16 + caplen
+            if end > n:
+                break
+            yield (default_name, sec * 1_000_000 + frac * 1_000_000 // per_sec,
+                   *_link_payload(buf, linktype, data, end))
+            pos = end
+        return
+    if magic != PCAPNG_SHB:
+        raise ValueError("not a PCAPNG or pcap file (big-endian files are not supported)")
+
+    ifaces = []   # Per section: (name, linktype, units per second)
+    pos = 0
+    while pos + 12 <= n:
+        btype, blen = struct.unpack_from("<II", buf, pos)
+        if blen < 12 or pos + blen > n:
+            break
+        if btype == PCAPNG_SHB:
+            if struct.unpack_from("<I", buf, pos + 8)[0] != PCAPNG_BOM:
+                raise ValueError("big-endian PCAPNG is not supported")
+            ifaces = []
+        elif btype == PCAPNG_IDB:
+            linktype = struct.unpack_from("<H", buf, pos + 8)[0]
+            name, per_sec = f"{default_name}:{len(ifaces)}", 1_000_000
+            opt, end = pos + 16, pos + blen - 4
+            while opt + 4 <= end:
+                code, olen = struct.unpack_from("<HH", buf, opt)
+                if code == PCAPNG_OPT_END:
+                    break
+                value = bytes(buf[opt + 4:opt + 4 + olen])
+                if code == PCAPNG_OPT_IF_NAME:
+                    name = value.decode("utf-8", "replace")
+                elif code == PCAPNG_OPT_IF_TSRESOL and value:
+                    res = value[0]
+                    per_sec = 2 ** (res & 0x7F) if res & 0x80 else 10 ** res
+                opt += 4 + olen + (-olen % 4)
+            ifaces.append((name, linktype, per_sec))
+        elif btype == PCAPNG_EPB:
+            iface, hi, lo, caplen, _ = struct.unpack_from("<IIIII", buf, pos + 8)
+            if iface < len(ifaces):
+                name, linktype, per_sec = ifaces[iface]
+                data = pos + 28
+                yield (name, (hi << 32 | lo) * 1_000_000 // per_sec,
+                       *_link_payload(buf, linktype, data, min(data + caplen, pos + blen - 4)))
+        pos += blen
+
+
+def _link_payload(buf, linktype, data, end):
+    """(channel, rssi, 802.11 offset, 802.11 length) of one packet."""
+    if linktype == LINKTYPE_IEEE802_11_RADIOTAP:
+        hlen, channel, rssi = radiotap_fields(buf, data, end)
+        data = min(data + hlen, end)
+        return channel, rssi, data, end - data
+    return 0, 0, data, end - data
+
+
+class CaptureIndex:
+    """Column index of a capture file, kept next to it as <capture>.pidx.
+
+    Layout: PIDX_HEADER, the interface names as JSON padded to 8 bytes,
+    then the PIDX_COLUMNS one after another, each `packets` entries long
+    and all in timestamp order: Unix us, 802.11 payload offset in the
+    capture, CRC-32 of the BSSID (0 = none), payload length, interface,
+    channel, RSSI and type_slot(). The index is reused while the capture's
+    size and mtime match, and held in memory if it cannot be written.
+    """
+
+    def __init__(self, path, progress=None):
+        self.path = path
+        self.name = os.path.basename(path)
+        st = os.stat(path)
+        if not st.st_size:
+            raise ValueError("empty capture")
+        with open(path, "rb") as f:
+            self._capture = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        self._index_map = None
+        blob = self._load(path + ".pidx", st)
+        if blob is None:
+            try:
+                blob = self._build(st, progress)
+            except Exception:
+                self._capture.close()
+                raise
+            try:
+                tmp = path + ".pidx.tmp"
+                with open(tmp, "wb") as f:
+                    f.write(blob)
+                os.replace(tmp, path + ".pidx")
+            except OSError:
+                pass
+        self._open(blob)
+
+    def _load(self, index_path, st):
+        try:
+            with open(index_path, "rb") as f:
+                mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        except (OSError, ValueError):
+            return None
+        if len(mm) >= PIDX_HEADER.size:
+            magic, version, _, size, mtime, _ = PIDX_HEADER.unpack_from(mm)
+            if (magic, version, size, mtime) == (PIDX_MAGIC, PIDX_VERSION,
+                                                 st.st_size, st.st_mtime_ns):
+                self._index_map = mm
+                return mm
+        mm.close()
+        return None
+
+    def _build(self, st, progress):
+        cols = {key: array.array(code) for key, code in PIDX_COLUMNS}
+        ts, offset, bss, length = cols["ts"], cols["offset"], cols["bss"], cols["length"]
+        iface, channel, rssi, slot = cols["iface"], cols["channel"], cols["rssi"], cols["slot"]
+        buf = self._capture
+        ids = {}
+        in_order, last = True, -1 << 63
+        step = max(1, len(buf) // 100)
+        next_report = step
+        for name, unix_us, ch, sig, off, plen in scan_capture(buf, self.name):
+            hdr = buf[off:off + min(plen, 24)]
+            fields = dissect_frame(hdr)
+            bssid = fields[4] if fields else None
+            ts.append(unix_us)
+            offset.append(off)
+            bss.append((zlib.crc32(bssid) or 1) if bssid else 0)
+            length.append(min(plen, 0xFFFF))
+            iface.append(ids.setdefault(name, len(ids)))
+            channel.append(ch & 0xFF)
+            rssi.append(max(-128, min(127, sig)))
+            slot.append(type_slot(hdr))
+            if unix_us < last:
+                in_order = False
+            last = unix_us
+            if progress and off >= next_report:
+                progress(off / len(buf))
+                next_report = off + step
+
+        if not in_order:
+            # Devices interleave by arrival; the index is by device time
+            order = sorted(range(len(ts)), key=ts.__getitem__)
+            for key, code in PIDX_COLUMNS:
+                col = cols[key]
+                cols[key] = array.array(code, (col[i] for i in order))
+
+        names = json.dumps(sorted(ids, key=ids.get)).encode()
+        names += b" " * (-len(names) % 8)
+        blob = bytearray(PIDX_HEADER.pack(PIDX_MAGIC, PIDX_VERSION, len(names),
+                                          st.st_size, st.st_mtime_ns, len(ts)))
+        blob += names
+        for key, _ in PIDX_COLUMNS:
+            blob += cols[key].tobytes()
+        return blob
+
+    def _open(self, blob):
+        _, _, names_len, _, _, count = PIDX_HEADER.unpack_from(blob)
+        pos = PIDX_HEADER.size
+        self.names = json.loads(bytes(blob[pos:pos + names_len]))
+        self.short_names = [n.split("usbmodem")[-1] if "usbmodem" in n else n.split("/")[-1]
+                            for n in self.names]
+        pos += names_len
+        self.count = count
+        self._blob = blob
+        self._view = memoryview(blob)
+        self._col_start = {}
+        for key, code in PIDX_COLUMNS:
+            size = array.array(code).itemsize * count
+            self._col_start[key] = pos
+            setattr(self, key, self._view[pos:pos + size].cast(code))
+            pos += size
+        self.first_us = self.ts[0] if count else 0
+        self.last_us = self.ts[count - 1] if count else 0
+
+    def close(self):
+        for key, _ in PIDX_COLUMNS:
+            getattr(self, key).release()
+        self._view.release()
+        if self._index_map is not None:
+            self._index_map.close()
+        self._capture.close()
+
+    # --- Queries ---
+
+    def time_range(self, start_us=None, end_us=None):
+        """Index positions [lo, hi) with start_us <= ts < end_us."""
+        lo = 0 if start_us is None else bisect.bisect_left(self.ts, start_us)
+        hi = self.count if end_us is None else bisect.bisect_left(self.ts, end_us, lo)
+        return lo, hi
+
+    def query(self, lo, hi, terms):
+        """Positions in [lo, hi) whose columns match every (column, values)
+        term: a range when there are no terms, else an array('I')."""
+        if not terms:
+            return range(lo, hi)
+        terms = sorted(terms, key=lambda t: len(t[1]))
+        key, values = terms[0]
+        if not values:
+            return array.array("I")
+        if key in ("channel", "slot") and len(values) == 1:
+            # One byte value: let find() walk the column
+            base = self._col_start[key]
+            needle = bytes(values)
+            find = self._blob.find
+            cand = []
+            i = find(needle, base + lo, base + hi)
+            while i >= 0:
+                cand.append(i - base)
+                i = find(needle, i + 1, base + hi)
+        else:
+            col = getattr(self, key)
+            cand = [i for i in range(lo, hi) if col[i] in values]
+        for key, values in terms[1:]:
+            col = getattr(self, key)
+            cand = [i for i in cand if col[i] in values]
+        return array.array("I", cand)
+
+    def payload(self, i):
+        off = self.offset[i]
+        return self._capture[off:off + self.length[i]]
+
+    def row(self, i):
+        """PacketTable row of index position i."""
+        payload = self.payload(i)
+        dev = self.iface[i]
+        return (i + 1, dev, self.short_names[dev], self.channel[i], self.rssi[i],
+                self.length[i], slot_name(self.slot[i]),
+                format_mac(payload[4:10]) if len(payload) >= 10 else "?",
+                format_mac(payload[10:16]) if len(payload) >= 16 else "?")
+
+    def summary(self, positions):
+        """Chart inputs for the selected positions: (channel counts, frame
+        type counts, RSSI bins, ReplayDevice per interface)."""
+        n = len(positions)
+        devices = [ReplayDevice(idx, name) for idx, name in enumerate(self.short_names)]
+        if not n:
+            return {}, {}, [0] * SHM_RSSI_BINS, devices
+        ts = self.ts
+        t0, t1 = ts[positions[0]], ts[positions[n - 1]]
+        width = max(1, (t1 - t0 + 1) / REPLAY_BUCKETS)
+        per_bucket = [Counter() for _ in range(REPLAY_BUCKETS)]
+        if isinstance(positions, range):
+            lo, hi = positions.start, positions.stop
+            channels = Counter(self.channel[lo:hi])
+            slots = Counter(self.slot[lo:hi])
+            rssis = Counter(self.rssi[lo:hi])
+            a = lo
+            for b in range(REPLAY_BUCKETS):
+                z = hi if b == REPLAY_BUCKETS - 1 else bisect.bisect_left(
+                    ts, t0 + (b + 1) * width, a, hi)
+                per_bucket[b].update(self.iface[a:z])
+                a = z
+        else:
+            channel, slot, rssi, iface = self.channel, self.slot, self.rssi, self.iface
+            channels, slots, rssis = Counter(), Counter(), Counter()
+            for i in positions:
+                channels[channel[i]] += 1
+                slots[slot[i]] += 1
+                rssis[rssi[i]] += 1
+                per_bucket[min(REPLAY_BUCKETS - 1, int((ts[i] - t0) / width))][iface[i]] += 1
+
+        type_counts = {}
+        for s, c in slots.items():
+            name = slot_name(s)
+            type_counts[name] = type_counts.get(name, 0) + c
+        rssi_bins = [0] * SHM_RSSI_BINS
+        for r, c in rssis.items():
+            rssi_bins[max(0, min(SHM_RSSI_BINS - 1, (r + 100) // 5))] += c
+        seconds = width / 1e6
+        for dev in devices:
+            total = 0
+            for counts in per_bucket:
+                count = counts.get(dev.device_idx, 0)
+                total += count
+                dev.pps_ring.append(count / seconds)
+                dev.total_ring.append(total)
+        return dict(channels), type_counts, rssi_bins, devices
+
+
+class ReplayDevice:
+    """What the rate charts read from a DeviceState, for one interface of
+    an opened capture: one ring entry per REPLAY_BUCKETS slice."""
+
+    def __init__(self, device_idx, port_short):
+        self.device_idx = device_idx
+        self.port_short = port_short
+        self.color = DEVICE_COLORS[device_idx % len(DEVICE_COLORS)]
+        self.pps_ring = RingBuffer(REPLAY_BUCKETS)
+        self.total_ring = RingBuffer(REPLAY_BUCKETS)
+        self.usb_kbps_ring = RingBuffer(REPLAY_BUCKETS)
+
+
+class ReplayView:
+    """PacketTable source over a query result of a CaptureIndex."""
+
+    def __init__(self, index, positions):
+        self.index = index
+        self.positions = positions
+
+    def __len__(self):
+        return len(self.positions)
+
+    def row(self, i):
+        return self.index.row(self.positions[i])
+
+
+def replay_terms(index, text):
+    """Parse filter text against an index: (start us, end us, terms).
+
+    Same terms as the live table, answered from the index columns: ch:N,
+    dev:X (interface names), bss:MAC and t:A-B (seconds from the first
+    packet, either end optional). Other words match frame type names.
+    """
+    start = end = None
+    terms = []
+    for word in text.lower().split():
+        key, _, value = word.partition(":")
+        if key == "ch" and value.isdigit():
+            terms.append(("channel", {int(value)}))
+        elif key == "dev" and value:
+            terms.append(("iface", {i for i, n in enumerate(index.names) if value in n.lower()}))
+        elif key == "bss" and value:
+            try:
+                mac = bytes.fromhex(value.replace(":", "").replace("-", ""))
+            except ValueError:
+                mac = b""
+            terms.append(("bss", {zlib.crc32(mac) or 1} if len(mac) == 6 else set()))
+        elif key == "t" and value:
+            a, _, b = value.partition("-")
+            try:
+                if a:
+                    start = index.first_us + int(float(a) * 1e6)
+                if b:
+                    end = index.first_us + int(float(b) * 1e6)
+            except ValueError:
+                pass
+        else:
+            terms.append(("slot", {s for s in range(SHM_TYPE_SLOTS)
+                                   if word in slot_name(s).lower()}))
+    return start, end, terms
+
+
 # =============================================================================
 # GUI components
 # =============================================================================
@@ -399,7 +1325,7 @@ class DeviceCard(tk.Frame):
 
         self.snap_var = tk.StringVar(value="0")
         self._snap_last_sent = "0"
-        snap_entry = tk.Entry(snap_frame, textvariable=self.snap_var, width=6,
+        snap_entry = tk.Entry(snap_frame, textvariable=self.snap_var, width=14,
                               font=FONT_MONO_XS, bg=COLORS['bg_tertiary'],
                               fg=COLORS['text'], insertbackground=COLORS['text'],
                               relief=tk.FLAT)
@@ -407,7 +1333,7 @@ class DeviceCard(tk.Frame):
         snap_entry.bind("<Return>", lambda e: self._on_snaplen_apply())
         snap_entry.bind("<FocusOut>", lambda e: self._on_snaplen_apply())
 
-        tk.Label(snap_frame, text="(0=full)", font=("Menlo", 8),
+        tk.Label(snap_frame, text="(0=full, HDR)", font=("Menlo", 8),
                  bg=COLORS['bg_secondary'], fg=COLORS['text_dim']).pack(side=tk.LEFT)
 
         # Stats row
@@ -415,7 +1341,13 @@ class DeviceCard(tk.Frame):
                                     font=FONT_MONO_XS,
                                     bg=COLORS['bg_secondary'],
                                     fg=COLORS['text_dim'])
-        self.stats_label.pack(fill=tk.X, padx=8, pady=(2, 6))
+        self.stats_label.pack(fill=tk.X, padx=8, pady=(2, 0))
+
+        # Device-side telemetry from MSG_TYPE_STATS
+        self.telemetry_label = tk.Label(self, text="", font=("Menlo", 8),
+                                        bg=COLORS['bg_secondary'],
+                                        fg=COLORS['text_dim'], anchor="w")
+        self.telemetry_label.pack(fill=tk.X, padx=8, pady=(0, 6))
 
     def _on_channel_change(self, event=None):
         ch = self.ch_var.get()
@@ -448,7 +1380,8 @@ class DeviceCard(tk.Frame):
         try:
             val = int(val_str)
         except ValueError:
-            return
+            # Per-type form, e.g. "MGMT 0 DATA HDR CTRL HDR"
+            val = val_str.upper()
         self.device.send_command(f"SNAPLEN {val}")
         self.device.snaplen = val
         self._snap_last_sent = val_str
@@ -456,8 +1389,26 @@ class DeviceCard(tk.Frame):
     def update_stats(self):
         pps = self.device.pps_ring.values()
         current_pps = pps[-1] if pps else 0
-        self.stats_label.config(
-            text=f"CAP:{self.device.pkt_count}  DROP:{self.device.drop_count}  PPS:{current_pps}")
+        text = f"CAP:{self.device.pkt_count}  DROP:{self.device.drop_count}  PPS:{current_pps}"
+        if self.device.beacon_dedup:
+            text += f"  BDUP:{self.device.beacon_dedup}"
+        lost = self.device.seq_lost if self.device.worker else self.device.decoder.seq_lost
+        if lost:
+            text += f"  GAP:{lost}"
+        clock = self.device.clock
+        if clock.syncs:
+            text += f"  SYNC:±{clock.rtt_us // 2}us {clock.drift_ppm:+.1f}ppm"
+        self.stats_label.config(text=text)
+
+        st = self.device.stats
+        if st:
+            ring_pct = st["ring_hwm"] * 100 // st["ring_size"] if st["ring_size"] else 0
+            self.telemetry_label.config(
+                text=f"USB:{st['usb_bytes_per_s'] / 1024:.0f}K  RING:{ring_pct}%  "
+                     f"CB:{st['cb_cycles_avg']}/{st['cb_cycles_max']}  "
+                     f"SW:{st['switch_us'] / 1000:.0f}ms  "
+                     f"LOST:{st['drop_raw_full']}/{st['drop_ring_full']}/{st['drop_usb']}  "
+                     f"SHED:{st['shed_truncated']}/{st['shed_dropped']}")
 
     def update_from_status(self, text):
         # STATUS format: "CH 1 BAND 2.4G FILTER MGMT DATA CTRL SNAPLEN 0 ..."
@@ -482,91 +1433,416 @@ class DeviceCard(tk.Frame):
                 self.band_label.config(text=band)
 
 
-class PacketRateChart(tk.Canvas):
-    def __init__(self, parent, **kwargs):
-        super().__init__(parent, bg=COLORS['bg_secondary'],
-                         highlightthickness=0, **kwargs)
-        self._lines = {}  # device_idx -> list of canvas line IDs
-        self._title_id = None
-        self.bind("<Configure>", self._on_resize)
+class PacketTable(tk.Frame):
+    """Virtualized packet table.
 
-    def _on_resize(self, event=None):
-        self._redraw_title()
+    Rows live in a fixed ring of TABLE_CAPACITY tuples; the Treeview only
+    ever holds one recycled item per visible line, so appending and
+    redrawing cost the same whether 100 or 100k packets are kept. An
+    optional filter keeps a list of matching ring positions, extended as
+    rows arrive. Row tuple: (seq, device_idx, port_short, channel, rssi,
+    length, frame_type, da, sa). set_source() shows a ReplayView instead;
+    appended rows still go to the ring meanwhile.
+    """
 
-    def _redraw_title(self):
-        w = self.winfo_width()
-        if self._title_id:
-            self.delete(self._title_id)
+    COLUMNS = ("seq", "dev", "ch", "rssi", "len", "type", "da", "sa")
+    WIDTHS = {"seq": 60, "dev": 80, "ch": 40, "rssi": 50,
+              "len": 50, "type": 100, "da": 140, "sa": 140}
+    LABELS = {"seq": "#", "dev": "Device", "ch": "Ch", "rssi": "RSSI",
+              "len": "Len", "type": "Type", "da": "DA", "sa": "SA"}
+
+    def __init__(self, parent, on_follow_change=None, capacity=None, **kwargs):
+        super().__init__(parent, bg=COLORS['bg'], **kwargs)
+        self.capacity = capacity or TABLE_CAPACITY
+        self._rows = [None] * self.capacity
+        self._count = 0             # Rows ever appended; ring holds the last `capacity`
+        self._matches = None        # Ring positions passing the filter, or None
+        self._match_start = 0
+        self._filter = []
+        self._source = None         # ReplayView shown instead of the ring
+        self._top = 0               # First visible row, as an index into the view
+        self._shown = []            # Values last written to each item
+        self._iids = []
+        self._dirty = True
+        self.follow = True
+        self.privacy = False
+        self._on_follow_change = on_follow_change
+
+        self.tree = ttk.Treeview(self, columns=self.COLUMNS, show="headings",
+                                 selectmode="none")
+        for col in self.COLUMNS:
+            self.tree.heading(col, text=self.LABELS[col])
+            self.tree.column(col, width=self.WIDTHS[col], minwidth=30)
+        for i, color in enumerate(DEVICE_COLORS):
+            self.tree.tag_configure(f"dev{i}", foreground=color)
+
+        self.scrollbar = ttk.Scrollbar(self, orient=tk.VERTICAL, command=self._on_scrollbar)
+        self.scrollbar.pack(side=tk.RIGHT, fill=tk.Y)
+        self.tree.pack(fill=tk.BOTH, expand=True)
+
+        self.tree.bind("<Configure>", lambda e: self.after_idle(self._fit_rows))
+        self.tree.bind("<MouseWheel>", self._on_wheel)
+        self.tree.bind("<Button-4>", lambda e: self._scroll(-3))
+        self.tree.bind("<Button-5>", lambda e: self._scroll(3))
+        for key, delta in (("<Up>", -1), ("<Down>", 1), ("<Prior>", "page-"),
+                           ("<Next>", "page+")):
+            self.tree.bind(key, lambda e, d=delta: self._scroll(d))
+        self.tree.bind("<Home>", lambda e: self._scroll(-self._view_len()))
+        self.tree.bind("<End>", lambda e: self.set_follow(True))
+        self.tree.bind("<Button-1>", lambda e: self.tree.focus_set())
+
+    # --- Data ---
+
+    def append(self, rows):
+        cap = self.capacity
+        for row in rows:
+            pos = self._count
+            self._rows[pos % cap] = row
+            self._count = pos + 1
+            if self._matches is not None and self._match(row):
+                self._matches.append(pos)
+        if rows:
+            self._dirty = True
+
+    def clear(self):
+        self._rows = [None] * self.capacity
+        self._count = 0
+        self._top = 0
+        if self._matches is not None:
+            self._matches = []
+            self._match_start = 0
+        self._dirty = True
+
+    def set_filter(self, text):
+        """Space-separated terms, all of which must match: ch:N or dev:X,
+        otherwise a case-insensitive substring of the type, DA or SA."""
+        terms = []
+        for word in text.lower().split():
+            key, _, value = word.partition(":")
+            if key == "ch" and value.isdigit():
+                terms.append(("ch", int(value)))
+            elif key == "dev" and value:
+                terms.append(("dev", value))
+            else:
+                terms.append(("text", word))
+        self._filter = terms
+        if terms:
+            low = max(0, self._count - self.capacity)
+            self._matches = [pos for pos in range(low, self._count)
+                             if self._match(self._rows[pos % self.capacity])]
+        else:
+            self._matches = None
+        self._match_start = 0
+        self._top = 0
+        self._dirty = True
+
+    def _match(self, row):
+        for kind, value in self._filter:
+            if kind == "ch":
+                if row[3] != value:
+                    return False
+            elif kind == "dev":
+                if value not in row[2].lower():
+                    return False
+            elif (value not in row[6].lower() and value not in row[7] and
+                  value not in row[8]):
+                return False
+        return True
+
+    def set_source(self, source):
+        """Show source (len() and row(i)) from its first row, or None to
+        go back to the live ring."""
+        self._source = source
+        self._top = 0
+        self._dirty = True
+        self.set_follow(source is None)
+
+    def _view_len(self):
+        if self._source is not None:
+            return len(self._source)
+        low = max(0, self._count - self.capacity)
+        if self._matches is None:
+            return self._count - low
+        # Drop matches that have fallen out of the ring
+        m, start = self._matches, self._match_start
+        while start < len(m) and m[start] < low:
+            start += 1
+        if start > 4096 and start > len(m) // 2:
+            del m[:start]
+            start = 0
+        self._match_start = start
+        return len(m) - start
+
+    def _view_row(self, i):
+        if self._source is not None:
+            return self._source.row(i)
+        if self._matches is None:
+            pos = max(0, self._count - self.capacity) + i
+        else:
+            pos = self._matches[self._match_start + i]
+        return self._rows[pos % self.capacity]
+
+    # --- View ---
+
+    def _fit_rows(self):
+        """Keep exactly one item per line that fits in the widget."""
+        height = self.tree.winfo_height()
+        if not self._iids:
+            self._iids.append(self.tree.insert("", tk.END, values=()))
+            self._shown.append(None)
+            self.tree.update_idletasks()
+        bbox = self.tree.bbox(self._iids[0])
+        if not bbox:
+            return
+        y, row_h = bbox[1], bbox[3]
+        lines = max(1, (height - y) // max(1, row_h))
+        while len(self._iids) < lines:
+            self._iids.append(self.tree.insert("", tk.END, values=()))
+            self._shown.append(None)
+        while len(self._iids) > lines:
+            self.tree.delete(self._iids.pop())
+            self._shown.pop()
+        self.refresh(force=True)
+
+    def refresh(self, force=False):
+        """Redraw the visible rows if anything changed."""
+        if not (self._dirty or force):
+            return
+        self._dirty = False
+        n = self._view_len()
+        lines = len(self._iids)
+        if self.follow:
+            self._top = max(0, n - lines)
+        self._top = max(0, min(self._top, n - lines))
+
+        privacy = self.privacy
+        for line, iid in enumerate(self._iids):
+            i = self._top + line
+            if i < n:
+                seq, dev_idx, port, ch, rssi, length, name, da, sa = self._view_row(i)
+                if privacy:
+                    da = sa = "[redacted]"
+                values = (seq, port, ch, rssi, length, name, da, sa)
+                tag = f"dev{dev_idx % len(DEVICE_COLORS)}"
+            else:
+                values, tag = (), ""
+            shown = (values, tag)
+            if self._shown[line] != shown:
+                self.tree.item(iid, values=values, tags=(tag,) if tag else ())
+                self._shown[line] = shown
+
+        if n > lines:
+            self.scrollbar.set(self._top / n, (self._top + lines) / n)
+        else:
+            self.scrollbar.set(0.0, 1.0)
+
+    def set_follow(self, follow):
+        if follow != self.follow:
+            self.follow = follow
+            if self._on_follow_change:
+                self._on_follow_change(follow)
+        self.refresh(force=True)
+
+    def _scroll(self, delta):
+        lines = len(self._iids)
+        if delta == "page-":
+            delta = -lines
+        elif delta == "page+":
+            delta = lines
+        self._top = max(0, self._top + delta)
+        # Scrolling to the end resumes following, anything else pauses it
+        self.set_follow(self._top + lines >= self._view_len())
+
+    def _on_wheel(self, event):
+        step = event.delta if abs(event.delta) < 120 else event.delta // 120
+        self._scroll(-3 * step)
+
+    def _on_scrollbar(self, *args):
+        n = self._view_len()
+        lines = len(self._iids)
+        if args[0] == "moveto":
+            self._top = int(float(args[1]) * n)
+            self.set_follow(self._top + lines >= n)
+        elif args[0] == "scroll":
+            count = int(args[1])
+            self._scroll(count * lines if args[2] == "pages" else count)
+
+
+class AnalyticsWindow(tk.Toplevel):
+    """Live per-BSSID and per-station tables, merged over all devices.
+
+    Shows the AGG_VIEW_ROWS busiest entries of each, refreshed every
+    AGG_VIEW_MS; Treeview items are kept and rewritten in place.
+    """
+
+    BSS_COLUMNS = (("bssid", "BSSID", 130), ("ssid", "SSID", 170), ("channel", "Ch", 40),
+                   ("rssi", "RSSI", 50), ("beacons", "Beacons", 70), ("frames", "Frames", 70),
+                   ("data", "Data", 70), ("retry", "Retry%", 60), ("stations", "STAs", 50))
+    STA_COLUMNS = (("mac", "Station", 130), ("bssid", "BSSID", 130), ("rssi", "RSSI", 50),
+                   ("frames", "Frames", 70), ("data", "Data", 70), ("retry", "Retry%", 60),
+                   ("probes", "Probes", 60), ("ssids", "Probed SSIDs", 240))
+    REDACTED = ("bssid", "mac", "ssid", "ssids")
+
+    def __init__(self, gui):
+        super().__init__(gui.root, bg=COLORS['bg'])
+        self.title("Access points / stations")
+        self.geometry("960x640")
+        self._gui = gui
+        self._tables = []   # (tree, columns, item ids)
+        for title, columns in (("ACCESS POINTS", self.BSS_COLUMNS),
+                               ("STATIONS", self.STA_COLUMNS)):
+            tk.Label(self, text=title, font=FONT_MONO_XS, anchor=tk.W,
+                     bg=COLORS['bg'], fg=COLORS['text_dim']).pack(fill=tk.X, padx=8, pady=(6, 2))
+            frame = tk.Frame(self, bg=COLORS['bg'])
+            frame.pack(fill=tk.BOTH, expand=True, padx=8)
+            tree = ttk.Treeview(frame, columns=[c for c, _, _ in columns],
+                                show="headings", selectmode="none")
+            for col, label, width in columns:
+                tree.heading(col, text=label)
+                tree.column(col, width=width, minwidth=30)
+            bar = ttk.Scrollbar(frame, orient=tk.VERTICAL, command=tree.yview)
+            tree.configure(yscrollcommand=bar.set)
+            bar.pack(side=tk.RIGHT, fill=tk.Y)
+            tree.pack(fill=tk.BOTH, expand=True)
+            self._tables.append((tree, columns, []))
+        self.summary = tk.Label(self, text="", font=FONT_MONO_XS, anchor=tk.W,
+                                bg=COLORS['bg'], fg=COLORS['text_dim'])
+        self.summary.pack(fill=tk.X, padx=8, pady=4)
+        self._after_id = None
+        self._refresh()
+
+    def destroy(self):
+        if self._after_id:
+            self.after_cancel(self._after_id)
+        super().destroy()
+
+    def _refresh(self):
+        bss_rows, sta_rows = self._gui.aggregate_tables()
+        privacy = self._gui.privacy_mode
+        for (tree, columns, iids), rows in zip(self._tables, (bss_rows, sta_rows)):
+            rows = sorted(rows, key=lambda r: -r["frames"])[:AGG_VIEW_ROWS]
+            while len(iids) < len(rows):
+                iids.append(tree.insert("", tk.END))
+            while len(iids) > len(rows):
+                tree.delete(iids.pop())
+            for iid, row in zip(iids, rows):
+                tree.item(iid, values=[self._cell(row, col, privacy) for col, _, _ in columns])
+        self.summary.config(text=f"{len(bss_rows)} BSSIDs  {len(sta_rows)} stations")
+        self._after_id = self.after(AGG_VIEW_MS, self._refresh)
+
+    def _cell(self, row, col, privacy):
+        if col == "retry":
+            return f"{100 * row['retries'] / row['frames']:.1f}" if row["frames"] else "-"
+        value = row[col]
+        if privacy and col in self.REDACTED:
+            return "[redacted]"
+        if col == "ssids":
+            return ", ".join(value)
+        if col == "ssid" and value == "":
+            return "<hidden>"
+        return "-" if value is None else value
+
+
+class ChartCanvas(tk.Canvas):
+    """Base for the charts: items are created once and then only adjusted.
+
+    _set_coords() and _set() remember what each item was last given and
+    skip the Tk call when nothing changed, so an idle chart costs almost
+    nothing to update.
+    """
+
+    def __init__(self, parent, title, **kwargs):
+        super().__init__(parent, bg=COLORS['bg_secondary'],
+                         highlightthickness=0, **kwargs)
         self._title_id = self.create_text(
-            w // 2, 12, text="PACKETS/SEC", font=FONT_MONO_XS,
-            fill=COLORS['text_dim'])
+            0, 12, text=title, font=FONT_MONO_XS, fill=COLORS['text_dim'])
+        self._size = (0, 0)
+        self._coords = {}   # item -> last coords
+        self._opts = {}     # item -> last itemconfig options
+        self.bind("<Configure>", self._on_configure)
+
+    def _on_configure(self, event):
+        self._size = (event.width, event.height)
+        self.coords(self._title_id, event.width // 2, 12)
+
+    def _set_coords(self, item, *xy):
+        xy = tuple(int(v) for v in xy)
+        if self._coords.get(item) != xy:
+            self.coords(item, *xy)
+            self._coords[item] = xy
+
+    def _set(self, item, **opts):
+        last = self._opts.setdefault(item, {})
+        changed = {k: v for k, v in opts.items() if last.get(k) != v}
+        if changed:
+            self.itemconfig(item, **changed)
+            last.update(changed)
+
+    def _delete(self, item):
+        self.delete(item)
+        self._coords.pop(item, None)
+        self._opts.pop(item, None)
+
+
+class PacketRateChart(ChartCanvas):
+    """Rolling line per device of one RingBuffer attribute (default: PPS)."""
+
+    def __init__(self, parent, title="PACKETS/SEC", series="pps_ring", legend=False, **kwargs):
+        super().__init__(parent, title, **kwargs)
+        self._series = series
+        self._legend = legend
+        self._lines = {}       # device_idx -> polyline item
+        self._labels = {}      # device_idx -> legend text item
 
     def update_chart(self, devices):
-        w = self.winfo_width()
-        h = self.winfo_height()
+        w, h = self._size
         if w < 20 or h < 30:
             return
 
         margin_top = 24
-        margin_bottom = 4
+        margin_bottom = 16 if self._legend else 4
         margin_left = 4
         margin_right = 4
         plot_w = w - margin_left - margin_right
         plot_h = h - margin_top - margin_bottom
 
-        # Find max PPS across all devices
-        max_pps = 1
-        for dev in devices:
-            vals = dev.pps_ring.values()
-            if vals:
-                m = max(vals)
-                if m > max_pps:
-                    max_pps = m
-
-        # Remove lines for devices no longer present
-        active_idxs = {d.device_idx for d in devices}
-        for idx in list(self._lines.keys()):
-            if idx not in active_idxs:
-                for lid in self._lines[idx]:
-                    self.delete(lid)
-                del self._lines[idx]
-
-        for dev in devices:
-            vals = dev.pps_ring.values()
-            if len(vals) < 2:
-                if dev.device_idx in self._lines:
-                    for lid in self._lines[dev.device_idx]:
-                        self.delete(lid)
-                    self._lines[dev.device_idx] = []
-                continue
-
-            n = len(vals)
-            points = []
-            for i, v in enumerate(vals):
-                x = margin_left + (i / max(n - 1, 1)) * plot_w
-                y = margin_top + plot_h - (v / max_pps) * plot_h
-                points.append((x, y))
+        series = [(dev, getattr(dev, self._series).values()) for dev in devices]
+        peak = max([1] + [max(vals) for _, vals in series if vals])
 
-            # Reuse or create line segments
-            existing = self._lines.get(dev.device_idx, [])
-            needed = len(points) - 1
-            while len(existing) < needed:
-                lid = self.create_line(0, 0, 0, 0, fill=dev.color, width=2)
-                existing.append(lid)
-            while len(existing) > needed:
-                self.delete(existing.pop())
+        # Remove items of devices no longer present
+        active = {dev.device_idx for dev in devices}
+        for items in (self._lines, self._labels):
+            for idx in [i for i in items if i not in active]:
+                self._delete(items.pop(idx))
 
-            for i in range(needed):
-                self.coords(existing[i],
-                            points[i][0], points[i][1],
-                            points[i + 1][0], points[i + 1][1])
-
-            self._lines[dev.device_idx] = existing
-
-        self._redraw_title()
-
-
-class ChannelActivityChart(tk.Canvas):
+        legend_x = margin_left + 4
+        for dev, vals in series:
+            line = self._lines.get(dev.device_idx)
+            if line is None:
+                line = self._lines[dev.device_idx] = self.create_line(
+                    0, 0, 0, 0, fill=dev.color, width=2)
+            if len(vals) < 2:
+                self._set(line, state="hidden")
+            else:
+                n = len(vals)
+                xy = []
+                for i, v in enumerate(vals):
+                    xy.append(margin_left + i * plot_w / (n - 1))
+                    xy.append(margin_top + plot_h - v * plot_h / peak)
+                self._set_coords(line, *xy)
+                self._set(line, state="normal")
+
+            if self._legend:
+                label = self._labels.get(dev.device_idx)
+                if label is None:
+                    label = self._labels[dev.device_idx] = self.create_text(
+                        0, 0, text=dev.port_short, font=("Menlo", 7),
+                        fill=dev.color, anchor=tk.W)
+                self._set_coords(label, legend_x, h - 6)
+                legend_x += len(dev.port_short) * 6 + 10
+
+
+class ChannelActivityChart(ChartCanvas):
     """Bar chart showing packet counts per channel.
 
     Uses exponential decay so bars fade smoothly instead of resetting to zero.
@@ -575,44 +1851,39 @@ class ChannelActivityChart(tk.Canvas):
 
     # Fixed channel positions: 2.4G left, gap, 5G right
     DISPLAY_CHANNELS = CHANNELS_24G + CHANNELS_5G
+    LABELED = (1, 6, 11, 14, 36, 52, 100, 140, 165)
 
     def __init__(self, parent, **kwargs):
-        super().__init__(parent, bg=COLORS['bg_secondary'],
-                         highlightthickness=0, **kwargs)
-        self._title_id = None
+        super().__init__(parent, "CHANNEL ACTIVITY", **kwargs)
         # Smoothed values per channel (exponential moving average)
         self._smooth = {ch: 0.0 for ch in self.DISPLAY_CHANNELS}
         self._decay = 0.7  # retain 70% of previous value each update
-        self.bind("<Configure>", lambda e: self._draw_title())
-
-    def _draw_title(self):
-        w = self.winfo_width()
-        if self._title_id:
-            self.delete(self._title_id)
-        self._title_id = self.create_text(
-            w // 2, 12, text="CHANNEL ACTIVITY", font=FONT_MONO_XS,
-            fill=COLORS['text_dim'])
+        # Color: cyan for 2.4G, magenta for 5G
+        self._bars = [self.create_rectangle(
+            0, 0, 0, 0, outline="",
+            fill=COLORS['accent_cyan'] if ch <= 14 else COLORS['accent_magenta'])
+            for ch in self.DISPLAY_CHANNELS]
+        self._labels = {ch: self.create_text(
+            0, 0, text=str(ch), font=("Menlo", 7), fill=COLORS['text_dim'])
+            for ch in self.LABELED}
 
     def update_chart(self, channel_counts):
-        self.delete("bars")
-        self.delete("labels")
-        w = self.winfo_width()
-        h = self.winfo_height()
-        if w < 20 or h < 30:
-            self._draw_title()
-            return
-
         # Update smoothed values: blend new counts with decayed old values
         for ch in self.DISPLAY_CHANNELS:
             new_val = channel_counts.get(ch, 0)
             self._smooth[ch] = self._smooth[ch] * self._decay + new_val * (1 - self._decay)
 
+        w, h = self._size
+        if w < 20 or h < 30:
+            return
+
         margin_top = 26
         margin_bottom = 18
         margin_left = 4
         margin_right = 4
         plot_w = w - margin_left - margin_right
         plot_h = h - margin_top - margin_bottom
+        base = margin_top + plot_h
 
         n = len(self.DISPLAY_CHANNELS)
         max_val = max(self._smooth.values()) if self._smooth else 1
@@ -622,50 +1893,30 @@ class ChannelActivityChart(tk.Canvas):
         bar_w = max(2, (plot_w - gap * n) / n)
 
         for i, ch in enumerate(self.DISPLAY_CHANNELS):
-            val = self._smooth[ch]
-            bar_h = (val / max_val) * plot_h
             x = margin_left + i * (bar_w + gap)
-            y = margin_top + plot_h - bar_h
-
-            # Color: cyan for 2.4G, magenta for 5G
-            color = COLORS['accent_cyan'] if ch <= 14 else COLORS['accent_magenta']
-
-            self.create_rectangle(
-                x, y, x + bar_w, margin_top + plot_h,
-                fill=color, outline="", tags="bars")
+            y = base - (self._smooth[ch] / max_val) * plot_h
+            self._set_coords(self._bars[i], x, y, x + bar_w, base)
+            if ch in self._labels:
+                self._set_coords(self._labels[ch], x + bar_w / 2, base + 8)
 
-            # Label select channels
-            if ch in (1, 6, 11, 14, 36, 52, 100, 140, 165):
-                self.create_text(
-                    x + bar_w / 2, margin_top + plot_h + 8,
-                    text=str(ch), font=("Menlo", 7),
-                    fill=COLORS['text_dim'], tags="labels")
 
-        self._draw_title()
+class FrameTypeChart(ChartCanvas):
+    TOP_N = 8
+    TYPE_COLORS = ['#00d4ff', '#ff2daa', '#00ff88', '#ff8800',
+                   '#b388ff', '#ffdd00', '#ff4444', '#44ffdd']
 
-
-class FrameTypeChart(tk.Canvas):
     def __init__(self, parent, **kwargs):
-        super().__init__(parent, bg=COLORS['bg_secondary'],
-                         highlightthickness=0, **kwargs)
-        self._title_id = None
-        self.bind("<Configure>", lambda e: self._draw_title())
-
-    def _draw_title(self):
-        w = self.winfo_width()
-        if self._title_id:
-            self.delete(self._title_id)
-        self._title_id = self.create_text(
-            w // 2, 12, text="FRAME TYPES", font=FONT_MONO_XS,
-            fill=COLORS['text_dim'])
+        super().__init__(parent, "FRAME TYPES", **kwargs)
+        self._bars = [self.create_rectangle(0, 0, 0, 0, outline="", state="hidden",
+                                            fill=self.TYPE_COLORS[i % len(self.TYPE_COLORS)])
+                      for i in range(self.TOP_N)]
+        self._labels = [self.create_text(0, 0, text="", font=("Menlo", 8), anchor=tk.E,
+                                         fill=COLORS['text'], state="hidden")
+                        for _ in range(self.TOP_N)]
 
     def update_chart(self, type_counts):
-        self.delete("bars")
-        self.delete("labels")
-        w = self.winfo_width()
-        h = self.winfo_height()
-        if w < 20 or h < 30 or not type_counts:
-            self._draw_title()
+        w, h = self._size
+        if w < 20 or h < 30:
             return
 
         margin_top = 26
@@ -675,54 +1926,49 @@ class FrameTypeChart(tk.Canvas):
         plot_w = w - margin_left - margin_right
         plot_h = h - margin_top - margin_bottom
 
-        sorted_types = sorted(type_counts.items(), key=lambda x: -x[1])[:8]
-        if not sorted_types:
-            return
+        sorted_types = sorted(type_counts.items(), key=lambda x: -x[1])[:self.TOP_N]
         max_count = sorted_types[0][1] if sorted_types else 1
         if max_count == 0:
             max_count = 1
 
-        n = len(sorted_types)
-        bar_h = max(3, plot_h / max(n, 1) - 3)
-        type_colors = ['#00d4ff', '#ff2daa', '#00ff88', '#ff8800',
-                       '#b388ff', '#ffdd00', '#ff4444', '#44ffdd']
+        n = max(len(sorted_types), 1)
+        bar_h = max(3, plot_h / n - 3)
 
-        for i, (name, count) in enumerate(sorted_types):
-            bar_w = (count / max_count) * plot_w
+        for i in range(self.TOP_N):
+            bar, label = self._bars[i], self._labels[i]
+            if i >= len(sorted_types):
+                self._set(bar, state="hidden")
+                self._set(label, state="hidden")
+                continue
+            name, count = sorted_types[i]
             y = margin_top + i * (plot_h / n)
-            self.create_rectangle(
-                margin_left, y, margin_left + bar_w, y + bar_h,
-                fill=type_colors[i % len(type_colors)], outline="", tags="bars")
-            self.create_text(
-                margin_left - 4, y + bar_h / 2,
-                text=name[:8], font=("Menlo", 8), anchor=tk.E,
-                fill=COLORS['text'], tags="labels")
+            self._set_coords(bar, margin_left, y, margin_left + (count / max_count) * plot_w,
+                             y + bar_h)
+            self._set_coords(label, margin_left - 4, y + bar_h / 2)
+            self._set(bar, state="normal")
+            self._set(label, text=name[:8], state="normal")
 
-        self._draw_title()
 
+class RSSIChart(ChartCanvas):
+    BINS = 18
 
-class RSSIChart(tk.Canvas):
     def __init__(self, parent, **kwargs):
-        super().__init__(parent, bg=COLORS['bg_secondary'],
-                         highlightthickness=0, **kwargs)
-        self._title_id = None
-        self.bind("<Configure>", lambda e: self._draw_title())
-
-    def _draw_title(self):
-        w = self.winfo_width()
-        if self._title_id:
-            self.delete(self._title_id)
-        self._title_id = self.create_text(
-            w // 2, 12, text="RSSI DISTRIBUTION", font=FONT_MONO_XS,
-            fill=COLORS['text_dim'])
+        super().__init__(parent, "RSSI DISTRIBUTION", **kwargs)
+        self._bars = []
+        for i in range(self.BINS):
+            # Red to green gradient
+            ratio = i / (self.BINS - 1)
+            color = f"#{int(255 * (1 - ratio)):02x}{int(255 * ratio):02x}44"
+            self._bars.append(self.create_rectangle(0, 0, 0, 0, fill=color, outline=""))
+        # Label endpoints
+        self._low = self.create_text(0, 0, text="-100", font=("Menlo", 7),
+                                     anchor=tk.W, fill=COLORS['text_dim'])
+        self._high = self.create_text(0, 0, text="-10", font=("Menlo", 7),
+                                      anchor=tk.E, fill=COLORS['text_dim'])
 
     def update_chart(self, rssi_bins):
-        self.delete("bars")
-        self.delete("labels")
-        w = self.winfo_width()
-        h = self.winfo_height()
+        w, h = self._size
         if w < 20 or h < 30:
-            self._draw_title()
             return
 
         margin_top = 26
@@ -731,6 +1977,7 @@ class RSSIChart(tk.Canvas):
         margin_right = 4
         plot_w = w - margin_left - margin_right
         plot_h = h - margin_top - margin_bottom
+        base = margin_top + plot_h
 
         n = len(rssi_bins)
         max_count = max(rssi_bins) if rssi_bins else 1
@@ -738,35 +1985,15 @@ class RSSIChart(tk.Canvas):
             max_count = 1
         bar_w = max(2, plot_w / n - 1)
 
-        for i, count in enumerate(rssi_bins):
-            bar_h = (count / max_count) * plot_h
+        for i, count in enumerate(rssi_bins[:self.BINS]):
             x = margin_left + i * (plot_w / n)
-            y = margin_top + plot_h - bar_h
-
-            # Red to green gradient
-            ratio = i / max(n - 1, 1)
-            r = int(255 * (1 - ratio))
-            g = int(255 * ratio)
-            color = f"#{r:02x}{g:02x}44"
-
-            self.create_rectangle(
-                x, y, x + bar_w, margin_top + plot_h,
-                fill=color, outline="", tags="bars")
-
-        # Label endpoints
-        self.create_text(
-            margin_left + 4, margin_top + plot_h + 8,
-            text="-100", font=("Menlo", 7), anchor=tk.W,
-            fill=COLORS['text_dim'], tags="labels")
-        self.create_text(
-            w - margin_right - 4, margin_top + plot_h + 8,
-            text="-10", font=("Menlo", 7), anchor=tk.E,
-            fill=COLORS['text_dim'], tags="labels")
+            self._set_coords(self._bars[i], x, base - (count / max_count) * plot_h,
+                             x + bar_w, base)
+        self._set_coords(self._low, margin_left + 4, base + 8)
+        self._set_coords(self._high, w - margin_right - 4, base + 8)
 
-        self._draw_title()
 
-
-class DeviceTotalChart(tk.Canvas):
+class DeviceTotalChart(PacketRateChart):
     """Rolling line chart of total packets captured per device.
 
     Each device gets its own colored line. Lines that fall behind
@@ -775,99 +2002,8 @@ class DeviceTotalChart(tk.Canvas):
     """
 
     def __init__(self, parent, **kwargs):
-        super().__init__(parent, bg=COLORS['bg_secondary'],
-                         highlightthickness=0, **kwargs)
-        self._lines = {}      # device_idx -> list of canvas line IDs
-        self._legend_ids = [] # canvas IDs for legend text
-        self._title_id = None
-        self.bind("<Configure>", lambda e: self._redraw_title())
-
-    def _redraw_title(self):
-        w = self.winfo_width()
-        if self._title_id:
-            self.delete(self._title_id)
-        self._title_id = self.create_text(
-            w // 2, 12, text="TOTAL PKTS / DEVICE", font=FONT_MONO_XS,
-            fill=COLORS['text_dim'])
-
-    def update_chart(self, devices):
-        w = self.winfo_width()
-        h = self.winfo_height()
-        if w < 20 or h < 30:
-            return
-
-        margin_top = 24
-        margin_bottom = 16
-        margin_left = 4
-        margin_right = 4
-        plot_w = w - margin_left - margin_right
-        plot_h = h - margin_top - margin_bottom
-
-        # Collect all total-pkt ring buffer values; find global max
-        all_series = {}
-        global_max = 1
-        for dev in devices:
-            vals = dev.total_ring.values()
-            all_series[dev.device_idx] = (vals, dev.color, dev.port_short)
-            if vals:
-                m = max(vals)
-                if m > global_max:
-                    global_max = m
-
-        # Clean up lines for removed devices
-        active_idxs = {d.device_idx for d in devices}
-        for idx in list(self._lines.keys()):
-            if idx not in active_idxs:
-                for lid in self._lines[idx]:
-                    self.delete(lid)
-                del self._lines[idx]
-
-        # Clear old legend
-        for lid in self._legend_ids:
-            self.delete(lid)
-        self._legend_ids.clear()
-
-        legend_y = h - 6
-        legend_x = margin_left + 4
-
-        for dev_idx, (vals, color, name) in all_series.items():
-            if len(vals) < 2:
-                if dev_idx in self._lines:
-                    for lid in self._lines[dev_idx]:
-                        self.delete(lid)
-                    self._lines[dev_idx] = []
-                continue
-
-            n = len(vals)
-            points = []
-            for i, v in enumerate(vals):
-                x = margin_left + (i / max(n - 1, 1)) * plot_w
-                y = margin_top + plot_h - (v / global_max) * plot_h
-                points.append((x, y))
-
-            existing = self._lines.get(dev_idx, [])
-            needed = len(points) - 1
-            while len(existing) < needed:
-                lid = self.create_line(0, 0, 0, 0, fill=color, width=2)
-                existing.append(lid)
-            while len(existing) > needed:
-                self.delete(existing.pop())
-
-            for i in range(needed):
-                self.coords(existing[i],
-                            points[i][0], points[i][1],
-                            points[i + 1][0], points[i + 1][1])
-
-            self._lines[dev_idx] = existing
-
-            # Legend entry
-            lid = self.create_text(
-                legend_x, legend_y, text=name, font=("Menlo", 7),
-                fill=color, anchor=tk.W)
-            self._legend_ids.append(lid)
-            legend_x += len(name) * 6 + 10
-
-        self._redraw_title()
+        super().__init__(parent, title="TOTAL PKTS / DEVICE", series="total_ring",
+                         legend=True, **kwargs)
 
 
 # =============================================================================
@@ -875,7 +2011,9 @@ class DeviceTotalChart(tk.Canvas):
 # =============================================================================
 
 class SnifferGUI:
-    def __init__(self):
+    def __init__(self, workers=False, pcap_options=None, dedup_ms=DEDUP_WINDOW_MS,
+                 snapshot=None, snapshot_s=AGG_SNAPSHOT_S, hop_revisit_s=HOP_MAX_REVISIT_S,
+                 open_capture=None):
         self.root = tk.Tk()
         self.root.title("The WiFIVEdra")
         self.root.geometry("1400x850")
@@ -887,16 +2025,33 @@ class SnifferGUI:
         self.device_cards = {}  # port -> DeviceCard
         self.next_device_idx = 0
         self.global_seq = 0
-        self.table_row_count = 0
         self.scanner_queue = queue.Queue()
         self.scanner_stop = threading.Event()
         self.pcap_writer = None
+        self.pcap_path = None   # With workers, each device writes <path>-<port>.pcapng
         self.recording = False
+        self.workers = workers  # One capture process per device
+        self.pcap_options = pcap_options or {}  # PCAPNGWriter rotation settings
 
         # Stats for charts
         self.channel_counts = {}       # counts since last chart update
         self.frame_type_counts = {}
         self.rssi_bins = [0] * 18
+        self.merger = StreamMerger()   # Orders the table across devices
+        self.dedup_us = dedup_ms * 1000
+        self.dedup = FrameDedup(self.dedup_us) if dedup_ms else None
+        self._dedup_horizon = 0
+        self.device_ports = {}         # device_idx -> port_short, for merged rows
+        self.analytics = None          # AnalyticsWindow while open
+        self.snapshot_path = snapshot  # Aggregates written here every snapshot_s
+        self.snapshot_s = snapshot_s
+        self._snapshot_error = None    # Last write failure shown, until one succeeds
+        self._chart_jobs = []          # charts still to draw this tick
+        self._chart_render_id = None
+        self._chart_pass_ms = 0.0      # drawing time of the pass in progress
+        self.chart_render_ms = 0.0     # smoothed drawing time per pass
+        self.replay = None             # CaptureIndex while a capture is open
+        self._replay_job = None        # (path, progress, result) while indexing
 
         # UI toggles
         self.privacy_mode = False
@@ -904,7 +2059,13 @@ class SnifferGUI:
         self.channel_hopping = False
         self.hop_interval_ms = 500
         self.hop_timer_id = None
-        self.hop_positions = {}  # device port -> index into ALL_CHANNELS
+        self.hop_replan_id = None
+        self.hop_max_revisit_ms = hop_revisit_s * 1000
+        self.hop_planner = None  # HopPlanner while hopping
+        self.hop_plans = {}      # device port -> (dwell_ms, [(channel, weight), ...]) sent
+        self.hop_fleet = set()   # ports the current plan was made for
+        self.hop_positions = {}  # device port -> tick index, for host-stepped devices
+        self._hop_observed = 0.0
 
         # Configure ttk styles
         self._setup_styles()
@@ -924,6 +2085,10 @@ class SnifferGUI:
         self.root.after(75, self._update_packets)
         self.root.after(1000, self._update_charts)
         self.root.after(2000, self._update_devices)
+        if self.snapshot_path:
+            self.root.after(self.snapshot_s * 1000, self._write_snapshot)
+        if open_capture:
+            self.root.after(100, lambda: self._open_replay(open_capture))
 
         # Keyboard shortcuts
         self.root.bind("<Command-k>", lambda e: self._clear_table())
@@ -998,6 +2163,12 @@ class SnifferGUI:
             bg=COLORS['bg_tertiary'], fg=COLORS['text_dim'])
         self.pkt_count_label.pack(side=tk.LEFT, padx=16)
 
+        # Chart drawing time per update, from _render_charts
+        self.render_label = tk.Label(
+            toolbar, text="", font=FONT_MONO_XS,
+            bg=COLORS['bg_tertiary'], fg=COLORS['text_dim'])
+        self.render_label.pack(side=tk.LEFT)
+
         # Right side buttons
         self.clear_btn = tk.Button(
             toolbar, text="CLEAR", font=FONT_MONO_SM,
@@ -1017,6 +2188,16 @@ class SnifferGUI:
             command=self._toggle_recording)
         self.rec_btn.pack(side=tk.RIGHT, padx=4)
 
+        # Browse a recorded capture instead of live traffic
+        self.open_btn = tk.Button(
+            toolbar, text="OPEN", font=FONT_MONO_SM,
+            bg=COLORS['bg_secondary'], fg=COLORS['text'],
+            activebackground=COLORS['border'],
+            activeforeground=COLORS['text_bright'],
+            relief=tk.FLAT, padx=12, pady=4,
+            command=self._toggle_replay)
+        self.open_btn.pack(side=tk.RIGHT, padx=4)
+
     def _build_main_area(self):
         # Main container: sidebar | content
         main = tk.Frame(self.root, bg=COLORS['bg'])
@@ -1088,7 +2269,15 @@ class SnifferGUI:
             row=0, column=7, sticky="ns")
 
         self.device_total_chart = DeviceTotalChart(self.chart_area)
-        self.device_total_chart.grid(row=0, column=8, sticky="nsew", padx=(0, 1))
+        self.device_total_chart.grid(row=0, column=8, sticky="nsew", padx=(0, 0))
+
+        tk.Frame(self.chart_area, bg=COLORS['border'], width=1).grid(
+            row=0, column=9, sticky="ns")
+
+        # Fed by the devices' MSG_TYPE_STATS records
+        self.usb_chart = PacketRateChart(self.chart_area, title="USB KB/SEC",
+                                         series="usb_kbps_ring")
+        self.usb_chart.grid(row=0, column=10, sticky="nsew", padx=(0, 1))
 
         # Default: equal weight for all chart columns
         self._set_chart_weights(normal=True)
@@ -1110,6 +2299,10 @@ class SnifferGUI:
             btn_bar, text="PRIVACY", command=self._toggle_privacy, **btn_style)
         self.privacy_btn.pack(side=tk.LEFT, padx=(8, 4), pady=3)
 
+        self.analytics_btn = tk.Button(
+            btn_bar, text="APS / STAS", command=self._open_analytics, **btn_style)
+        self.analytics_btn.pack(side=tk.LEFT, padx=4, pady=3)
+
         self.scroll_btn = tk.Button(
             btn_bar, text="AUTO SCROLL: ON", command=self._toggle_auto_scroll,
             **btn_style)
@@ -1131,32 +2324,23 @@ class SnifferGUI:
             relief=tk.FLAT)
         self.hop_interval_entry.pack(side=tk.LEFT, padx=(2, 8), pady=3)
 
-        # Packet table (fills remaining space)
-        table_frame = tk.Frame(content, bg=COLORS['bg'])
-        table_frame.pack(fill=tk.BOTH, expand=True)
-
-        columns = ("seq", "dev", "ch", "rssi", "len", "type", "da", "sa")
-        self.tree = ttk.Treeview(table_frame, columns=columns,
-                                 show="headings", selectmode="browse")
-
-        col_widths = {"seq": 60, "dev": 80, "ch": 40, "rssi": 50,
-                      "len": 50, "type": 100, "da": 140, "sa": 140}
-        col_labels = {"seq": "#", "dev": "Device", "ch": "Ch", "rssi": "RSSI",
-                      "len": "Len", "type": "Type", "da": "DA", "sa": "SA"}
-
-        for col in columns:
-            self.tree.heading(col, text=col_labels[col])
-            self.tree.column(col, width=col_widths[col], minwidth=30)
-
-        # Configure per-device color tags
-        for i, color in enumerate(DEVICE_COLORS):
-            self.tree.tag_configure(f"dev{i}", foreground=color)
+        # Table filter, e.g. "beacon ch:6" (Return applies, empty clears);
+        # with a capture open also bss:MAC and t:A-B
+        tk.Label(btn_bar, text="FILTER:", font=FONT_MONO_XS,
+                 bg=COLORS['bg_tertiary'], fg=COLORS['text_dim']).pack(
+            side=tk.LEFT, padx=(8, 0))
+        self.filter_var = tk.StringVar(value="")
+        filter_entry = tk.Entry(
+            btn_bar, textvariable=self.filter_var, width=24,
+            font=FONT_MONO_XS, bg=COLORS['bg_tertiary'],
+            fg=COLORS['text'], insertbackground=COLORS['text'],
+            relief=tk.FLAT)
+        filter_entry.pack(side=tk.LEFT, padx=(2, 8), pady=3)
+        filter_entry.bind("<Return>", lambda e: self._apply_filter())
 
-        scrollbar = ttk.Scrollbar(table_frame, orient=tk.VERTICAL,
-                                  command=self.tree.yview)
-        self.tree.configure(yscrollcommand=scrollbar.set)
-        scrollbar.pack(side=tk.RIGHT, fill=tk.Y)
-        self.tree.pack(fill=tk.BOTH, expand=True)
+        # Packet table (fills remaining space)
+        self.table = PacketTable(content, on_follow_change=self._on_table_follow)
+        self.table.pack(fill=tk.BOTH, expand=True)
 
     def _on_sidebar_configure(self, event=None):
         self.sidebar_canvas.configure(
@@ -1169,34 +2353,23 @@ class SnifferGUI:
     # --- Periodic callbacks ---
 
     def _update_packets(self):
-        """Drain packet queues from all devices, insert into table."""
-        batch = []
+        """Drain packet queues from all devices, merge them by device
+        timestamp and insert into table."""
+        merger = self.merger
         for dev in list(self.devices.values()):
-            drained = 0
-            while drained < 200:
-                try:
-                    rec = dev.packet_queue.get_nowait()
-                    batch.append(rec)
-                    drained += 1
-                except queue.Empty:
-                    break
-
-        if batch:
-            privacy = self.privacy_mode
-            privacy_mac = "[redacted]"
-            privacy_str = "[privacy]"
-
-            for rec in batch:
-                self.global_seq += 1
-                tag = f"dev{rec.device_idx % len(DEVICE_COLORS)}"
-                da = privacy_mac if privacy else rec.da
-                sa = privacy_mac if privacy else rec.sa
-                self.tree.insert("", tk.END, values=(
-                    self.global_seq, rec.port_short, rec.channel,
-                    rec.rssi, rec.length, rec.frame_type,
-                    da, sa
-                ), tags=(tag,))
-                self.table_row_count += 1
+            merger.add(dev.device_idx)
+            if dev.worker:
+                # Chart counts come complete from the worker; the rows are
+                # only the most recent packets
+                for rec in dev.worker.poll(dev, self.channel_counts,
+                                           self.frame_type_counts,
+                                           self.rssi_bins, TABLE_DRAIN_MAX):
+                    merger.push(dev.device_idx, rec.timestamp, rec)
+                continue
+            records = packet_records(dev, dev.ring.take(TABLE_DRAIN_MAX))
+            dev.drop_count = dev.ring.lost
+            for rec in records:
+                merger.push(dev.device_idx, rec.timestamp, rec)
 
                 # Update chart stats
                 ch = rec.channel
@@ -1206,22 +2379,48 @@ class SnifferGUI:
                 rssi_idx = max(0, min(17, (rec.rssi + 100) // 5))
                 self.rssi_bins[rssi_idx] += 1
 
-            # Prune if needed
-            if self.table_row_count > MAX_TABLE_ROWS:
-                children = self.tree.get_children()
-                for iid in children[:PRUNE_AMOUNT]:
-                    self.tree.delete(iid)
-                self.table_row_count -= PRUNE_AMOUNT
-
-            if self.auto_scroll:
-                self.tree.yview_moveto(1.0)
+        batch = [(rec, None) for rec in merger.pop_ready()]
+        if self.dedup:
+            # The merged stream is in time order, so its newest timestamp
+            # settles everything a bucket older
+            for rec, _ in batch:
+                ts_us = int(rec.timestamp * 1_000_000)
+                self.dedup.offer(rec.digest, ts_us, rec.device_idx, rec.rssi, rec)
+                self._dedup_horizon = max(self._dedup_horizon, ts_us)
+            deadline = int((time.time() - MERGE_LATENCY_S) * 1_000_000)
+            batch = self.dedup.pop_ready(max(self._dedup_horizon, deadline))
 
-            self.pkt_count_label.config(text=f"{self.global_seq} packets")
+        if batch:
+            seq = self.global_seq
+            rows = []
+            for rec, seen in batch:
+                seq += 1
+                port = rec.port_short
+                if seen and len(seen) > 1:
+                    # Best-RSSI device first, then the others that saw it
+                    port += "".join("+" + self.device_ports.get(idx, "?")
+                                    for idx, _ in seen if idx != rec.device_idx)
+                rows.append((seq, rec.device_idx, port, rec.channel,
+                             rec.rssi, rec.length, rec.frame_type, rec.da, rec.sa))
+            self.global_seq = seq
+            self.table.append(rows)
+            text = f"{self.global_seq} packets"
+            if self.dedup and self.dedup.suppressed:
+                text += f"  ({self.dedup.suppressed} dup)"
+            if not (self.replay or self._replay_job):
+                self.pkt_count_label.config(text=text)
+        self.table.refresh()
+        if self.recording:
+            self.root.after_idle(self._check_recording)   # May open a dialog
 
         self.root.after(75, self._update_packets)
 
     def _update_charts(self):
-        """Update PPS ring buffers and redraw charts."""
+        """Sample the per-second counters and queue the charts for drawing.
+
+        Drawing happens in _render_charts, a few charts per slice, so a
+        slow redraw never holds off _update_packets for long.
+        """
         devices = list(self.devices.values())
 
         for dev in devices:
@@ -1234,16 +2433,47 @@ class SnifferGUI:
             if port in self.devices:
                 card.update_stats()
 
-        # Redraw charts — channel chart uses smoothing internally,
-        # pass current window counts then reset for next window
-        self.pps_chart.update_chart(devices)
-        self.device_total_chart.update_chart(devices)
-        self.channel_chart.update_chart(self.channel_counts)
-        self.channel_counts = {}
-        self.frame_chart.update_chart(self.frame_type_counts)
-        self.rssi_chart.update_chart(self.rssi_bins)
+        # Channel chart uses smoothing internally; hand it this window's
+        # counts and start the next window now, not when it gets drawn
+        channel_counts, self.channel_counts = self.channel_counts, {}
+        if self.hop_planner:
+            self.hop_planner.count(channel_counts)
+        frame_type_counts = dict(self.frame_type_counts)
+        rssi_bins = list(self.rssi_bins)
 
         self.root.after(1000, self._update_charts)
+        if self.replay:
+            return   # The charts show the capture's selection
+
+        # A pass still unfinished from last tick is stale; start over
+        self._chart_jobs = [
+            lambda: self.pps_chart.update_chart(devices),
+            lambda: self.device_total_chart.update_chart(devices),
+            lambda: self.usb_chart.update_chart(devices),
+            lambda: self.channel_chart.update_chart(channel_counts),
+            lambda: self.frame_chart.update_chart(frame_type_counts),
+            lambda: self.rssi_chart.update_chart(rssi_bins),
+        ]
+        self._chart_pass_ms = 0.0
+        if self._chart_render_id is None:
+            self._chart_render_id = self.root.after_idle(self._render_charts)
+
+    def _render_charts(self):
+        """Draw queued charts until CHART_BUDGET_MS is used, then yield."""
+        start = time.perf_counter()
+        while self._chart_jobs:
+            self._chart_jobs.pop(0)()
+            if (time.perf_counter() - start) * 1000 >= CHART_BUDGET_MS:
+                break
+        self._chart_pass_ms += (time.perf_counter() - start) * 1000
+
+        if self._chart_jobs:
+            self._chart_render_id = self.root.after(
+                CHART_SLICE_GAP_MS, self._render_charts)
+            return
+        self._chart_render_id = None
+        self.chart_render_ms = self.chart_render_ms * 0.8 + self._chart_pass_ms * 0.2
+        self.render_label.config(text=f"draw {self.chart_render_ms:.1f} ms")
 
     def _update_devices(self):
         """Process scanner events, poll device STATUS."""
@@ -1259,6 +2489,10 @@ class SnifferGUI:
             elif action == "remove" and port in self.devices:
                 self._remove_device(port)
 
+        # Hot-plugged or removed devices: split the channels again
+        if self.channel_hopping and set(self.devices) != self.hop_fleet:
+            self._plan_hops()
+
         # Poll STATUS for each device
         for dev in list(self.devices.values()):
             dev.send_command("STATUS")
@@ -1266,6 +2500,7 @@ class SnifferGUI:
             while True:
                 try:
                     resp = dev.response_queue.get_nowait()
+                    self._note_hop_response(dev, resp)
                     if dev.port in self.device_cards:
                         self.device_cards[dev.port].update_from_status(resp)
                 except queue.Empty:
@@ -1284,14 +2519,17 @@ class SnifferGUI:
             return
 
         try:
-            # Flush any stale data
+            # Back to SLIP in case a previous session left LEN framing on,
+            # then flush the reply and any stale data
+            ser.write(b"FRAMING SLIP\n")
+            time.sleep(0.1)
             ser.reset_input_buffer()
             ser.write(b"STATUS\n")
             time.sleep(0.3)
 
             confirmed = False
             status_text = ""
-            decoder = SLIPDecoder()
+            decoder = FrameDecoder()
 
             # Read multiple chunks — STATUS response may be buried behind
             # a flood of packet data on busy devices
@@ -1314,7 +2552,7 @@ class SnifferGUI:
                         if "CH" in text.upper():
                             status_text = text
                             confirmed = True
-                    elif parsed[0] == MSG_TYPE_PACKET:
+                    elif parsed[0] in (MSG_TYPE_PACKET, MSG_TYPE_BATCH, MSG_TYPE_STATS):
                         # Valid SLIP-decoded packet confirms this is a 5dra device
                         confirmed = True
 
@@ -1343,7 +2581,11 @@ class SnifferGUI:
         color = DEVICE_COLORS[idx % len(DEVICE_COLORS)]
 
         dev = DeviceState(port, idx, color)
-        dev.ser = ser
+        self.device_ports[idx] = dev.port_short
+        if self.workers:
+            ser.close()     # The worker process reopens the port
+        else:
+            dev.ser = ser
 
         # Parse initial status: "CH 1 BAND 2.4G FILTER ..."
         parts = status_text.split()
@@ -1356,12 +2598,28 @@ class SnifferGUI:
             elif token == "BAND" and i + 1 < len(parts):
                 dev.band = parts[i + 1]
 
-        # Start reader thread
-        dev.thread = threading.Thread(
-            target=device_reader_loop,
-            args=(dev, lambda: self.pcap_writer),
-            daemon=True)
-        dev.thread.start()
+        # Start reader thread, or a capture process with --workers
+        if self.workers:
+            dev.worker = CaptureWorker(dev)
+            if self.pcap_path:
+                dev.worker.set_pcap(self._worker_pcap_path(dev), self.pcap_options)
+        else:
+            dev.thread = threading.Thread(
+                target=device_reader_loop,
+                args=(dev, lambda: self.pcap_writer),
+                daemon=True)
+            dev.thread.start()
+
+        # Length-prefixed framing is much cheaper to decode; firmware without
+        # it answers ERR and stays on SLIP
+        dev.send_command("FRAMING LEN")
+        # Credit flow control: the device sheds deliberately instead of
+        # stalling on USB writes when this host falls behind
+        dev.send_command(f"FLOW {FLOW_WINDOW}")
+        # Sequence-numbered packet headers, for the GAP count
+        dev.send_command("PKTHDR 2")
+        # Several records per USB write
+        dev.send_command("BATCH ON")
 
         self.devices[port] = dev
 
@@ -1379,12 +2637,8 @@ class SnifferGUI:
             return
 
         dev = self.devices.pop(port)
-        dev.stop_event.set()
-
-        try:
-            dev.ser.close()
-        except Exception:
-            pass
+        dev.stop()
+        self.merger.drop(dev.device_idx)
 
         if port in self.device_cards:
             self.device_cards[port].destroy()
@@ -1393,9 +2647,11 @@ class SnifferGUI:
     # --- Actions ---
 
     def _clear_table(self):
-        for item in self.tree.get_children():
-            self.tree.delete(item)
-        self.table_row_count = 0
+        self.merger.clear()
+        if self.dedup:
+            self.dedup = FrameDedup(self.dedup_us)
+        self.table.clear()
+        self.table.refresh()
         self.global_seq = 0
         self.channel_counts = {}
         self.frame_type_counts = {}
@@ -1403,33 +2659,150 @@ class SnifferGUI:
         self.channel_chart._smooth = {ch: 0.0 for ch in ChannelActivityChart.DISPLAY_CHANNELS}
         self.pkt_count_label.config(text="0 packets")
 
+    def _apply_filter(self):
+        if self.replay:
+            self._replay_query(self.filter_var.get())
+        else:
+            self.table.set_filter(self.filter_var.get())
+
+    # --- Capture replay ---
+
+    def _toggle_replay(self):
+        if self._replay_job:
+            return
+        if self.replay:
+            self._close_replay()
+            return
+        path = filedialog.askopenfilename(
+            filetypes=[("Captures", "*.pcapng *.pcap"), ("All files", "*.*")],
+            title="Open capture")
+        if path:
+            self._open_replay(path)
+
+    def _open_replay(self, path):
+        """Index path on a thread (a reused .pidx opens at once), then
+        show it."""
+        job = {"path": path, "progress": 0.0, "result": None}
+
+        def build():
+            def progress(fraction):
+                job["progress"] = fraction
+            try:
+                job["result"] = CaptureIndex(path, progress)
+            except (OSError, ValueError) as e:
+                job["result"] = e
+
+        self._replay_job = job
+        self.open_btn.config(state=tk.DISABLED)
+        threading.Thread(target=build, daemon=True).start()
+        self._poll_replay()
+
+    def _poll_replay(self):
+        job = self._replay_job
+        result = job["result"]
+        if result is None:
+            self.pkt_count_label.config(
+                text=f"indexing {os.path.basename(job['path'])} {job['progress']:.0%}")
+            self.root.after(200, self._poll_replay)
+            return
+        self._replay_job = None
+        self.open_btn.config(state=tk.NORMAL)
+        if isinstance(result, Exception):
+            self.pkt_count_label.config(text=f"{self.global_seq} packets")
+            print(f"[OPEN] {job['path']}: {result}")
+            messagebox.showerror("Open capture",
+                                 f"Could not open {job['path']}:\n{result}",
+                                 parent=self.root)
+            return
+        self.replay = result
+        self.open_btn.config(text="LIVE", fg=COLORS['accent_cyan'])
+        self._replay_query(self.filter_var.get())
+
+    def _replay_query(self, text):
+        """Show and chart the packets of the open capture matching text."""
+        index = self.replay
+        start, end, terms = replay_terms(index, text)
+        lo, hi = index.time_range(start, end)
+        view = ReplayView(index, index.query(lo, hi, terms))
+        self.table.set_source(view)
+
+        channel_counts, type_counts, rssi_bins, devices = index.summary(view.positions)
+        span = (index.last_us - index.first_us) / 1e6
+        self.pkt_count_label.config(
+            text=f"{index.name}: {len(view)} of {index.count} packets, {span:.1f} s")
+        self.channel_chart._smooth = {ch: channel_counts.get(ch, 0)
+                                      for ch in ChannelActivityChart.DISPLAY_CHANNELS}
+        self._chart_jobs = [
+            lambda: self.pps_chart.update_chart(devices),
+            lambda: self.device_total_chart.update_chart(devices),
+            lambda: self.usb_chart.update_chart(devices),
+            lambda: self.channel_chart.update_chart(channel_counts),
+            lambda: self.frame_chart.update_chart(type_counts),
+            lambda: self.rssi_chart.update_chart(rssi_bins),
+        ]
+        self._chart_pass_ms = 0.0
+        if self._chart_render_id is None:
+            self._chart_render_id = self.root.after_idle(self._render_charts)
+
+    def _close_replay(self):
+        self.table.set_source(None)
+        self.replay.close()
+        self.replay = None
+        self.open_btn.config(text="OPEN", fg=COLORS['text'])
+        self.table.set_filter(self.filter_var.get())
+        self.channel_chart._smooth = {ch: 0.0 for ch in ChannelActivityChart.DISPLAY_CHANNELS}
+        self.pkt_count_label.config(text=f"{self.global_seq} packets")
+
     def _toggle_privacy(self):
         self.privacy_mode = not self.privacy_mode
         if self.privacy_mode:
             self.privacy_btn.config(bg=COLORS['accent_magenta'], fg='#ffffff')
-            # Redact all existing rows
-            for iid in self.tree.get_children():
-                vals = list(self.tree.item(iid, "values"))
-                vals[6] = "[redacted]"  # DA
-                vals[7] = "[redacted]"  # SA
-                self.tree.item(iid, values=vals)
         else:
             self.privacy_btn.config(bg='#ffffff', fg='#000000')
-            # Note: can't un-redact already displayed rows (data not stored),
-            # but new rows will show real addresses
+        # Addresses are redacted when rows are drawn, so this applies to
+        # every row already in the table as well
+        self.table.privacy = self.privacy_mode
+        self.table.refresh(force=True)
+
+    def aggregate_tables(self):
+        """Per-BSSID and per-station rows merged over all devices."""
+        return merge_aggregates([dev.aggregate_snapshot()
+                                 for dev in list(self.devices.values())])
+
+    def _open_analytics(self):
+        if self.analytics and self.analytics.winfo_exists():
+            self.analytics.lift()
+            return
+        self.analytics = AnalyticsWindow(self)
+
+    def _write_snapshot(self):
+        # Schedule first, so a dialog waiting to be closed doesn't delay the next try
+        self.root.after(self.snapshot_s * 1000, self._write_snapshot)
+        try:
+            write_snapshot(self.snapshot_path, *self.aggregate_tables())
+        except OSError as e:
+            print(f"[SNAPSHOT] {e}")
+            # Retried every snapshot_s: report each new failure once
+            if str(e) != self._snapshot_error:
+                self._snapshot_error = str(e)
+                messagebox.showerror("Snapshot",
+                                     f"Could not write {self.snapshot_path}:\n{e}",
+                                     parent=self.root)
+            return
+        self._snapshot_error = None
 
     def _toggle_auto_scroll(self):
-        self.auto_scroll = not self.auto_scroll
-        if self.auto_scroll:
-            self.scroll_btn.config(text="AUTO SCROLL: ON")
-            self.tree.yview_moveto(1.0)
-        else:
-            self.scroll_btn.config(text="AUTO SCROLL: OFF")
+        self.table.set_follow(not self.auto_scroll)
+
+    def _on_table_follow(self, follow):
+        """Table started or stopped following new packets (button or scroll)."""
+        self.auto_scroll = follow
+        self.scroll_btn.config(text="AUTO SCROLL: ON" if follow else "AUTO SCROLL: OFF")
 
     def _set_chart_weights(self, normal=True):
         """Set grid column weights for chart area. When hopping, channel chart is wider."""
         if normal:
-            for col in (0, 2, 4, 6, 8):
+            for col in (0, 2, 4, 6, 8, 10):
                 self.chart_area.grid_columnconfigure(col, weight=1)
         else:
             # Channel chart (col 2) gets 3x weight
@@ -1438,6 +2811,7 @@ class SnifferGUI:
             self.chart_area.grid_columnconfigure(4, weight=1)
             self.chart_area.grid_columnconfigure(6, weight=1)
             self.chart_area.grid_columnconfigure(8, weight=1)
+            self.chart_area.grid_columnconfigure(10, weight=1)
 
     def _toggle_channel_hopping(self):
         if self.channel_hopping:
@@ -1450,11 +2824,11 @@ class SnifferGUI:
         if not devices:
             return
 
-        # Parse interval
+        # Parse interval; the firmware scheduler goes down to 10 ms
         try:
             interval = int(self.hop_interval_var.get())
-            if interval < 50:
-                interval = 50
+            if interval < 10:
+                interval = 10
         except ValueError:
             interval = 500
         self.hop_interval_ms = interval
@@ -1462,44 +2836,107 @@ class SnifferGUI:
         self.channel_hopping = True
         self.hop_btn.config(bg=COLORS['accent_green'], fg='#000000')
 
-        # Distribute devices evenly across all channels
-        n_dev = len(devices)
-        n_ch = len(ALL_CHANNELS)
-        spacing = n_ch / n_dev
-        for i, dev in enumerate(devices):
-            start_idx = int(i * spacing) % n_ch
-            self.hop_positions[dev.port] = start_idx
-            ch = ALL_CHANNELS[start_idx]
-            dev.send_command(f"CH {ch}")
-            dev.channel = ch
-            dev.channel_pending = True
-            if dev.port in self.device_cards:
-                self.device_cards[dev.port].ch_var.set(str(ch))
+        # Split the channels between the devices; activity reshapes the
+        # plan every HOP_REPLAN_MS
+        self.hop_planner = HopPlanner(ALL_CHANNELS, interval, self.hop_max_revisit_ms)
+        self._hop_observed = time.monotonic()
+        self._plan_hops()
+        self.hop_replan_id = self.root.after(HOP_REPLAN_MS, self._replan_hops)
 
         # Enlarge channel chart
         self._set_chart_weights(normal=False)
 
-        # Start hop timer
+        # Start hop timer (only steps devices without firmware HOP)
         self._hop_tick()
 
+    def _plan_hops(self):
+        """Recompute the fleet plan and send each device its changed part."""
+        plans = self.hop_planner.plan(self.devices)
+        self.hop_fleet = set(self.devices)
+        for port in list(self.hop_plans):
+            if port not in self.devices:
+                del self.hop_plans[port]
+                self.hop_positions.pop(port, None)
+        for port, dev in list(self.devices.items()):
+            plan = plans.get(port)
+            if plan is None:
+                # More radios than channels: this one would double up
+                if dev.hop_mode in ("pending", "firmware"):
+                    dev.send_command("HOP OFF")
+                dev.hop_mode = None
+                self.hop_plans.pop(port, None)
+            elif plan != self.hop_plans.get(port):
+                self._start_device_hop(dev, plan)
+
+    def _replan_hops(self):
+        now = time.monotonic()
+        self.hop_planner.observe(now - self._hop_observed, self._bssids_per_channel())
+        self._hop_observed = now
+        self._plan_hops()
+        self.hop_replan_id = self.root.after(HOP_REPLAN_MS, self._replan_hops)
+
+    def _bssids_per_channel(self):
+        horizon = time.time() - HOP_BSSID_WINDOW_S
+        counts = {}
+        for row in self.aggregate_tables()[0]:
+            if row["last_seen"] >= horizon and row["channel"]:
+                counts[row["channel"]] = counts.get(row["channel"], 0) + 1
+        return counts
+
+    def _start_device_hop(self, dev, plan):
+        """Hand the device its plan as HOP. Until it answers, the host does
+        not step it; on ERR it falls back to CH ticks from _hop_tick."""
+        slots = plan[1]
+        self.hop_plans[dev.port] = plan
+        self.hop_positions[dev.port] = 0
+        if dev.hop_mode != "host":
+            dev.send_command(hop_command(*plan))
+            if dev.hop_mode != "firmware":
+                dev.hop_mode = "pending"
+        ch = slots[0][0]
+        dev.channel = ch
+        dev.channel_pending = dev.hop_mode == "host"
+        if dev.hop_mode == "host":
+            dev.send_command(f"CH {ch}")
+        if dev.port in self.device_cards:
+            self.device_cards[dev.port].ch_var.set(str(ch))
+
+    def _note_hop_response(self, dev, resp):
+        if dev.hop_mode != "pending":
+            return
+        if resp.startswith("OK HOP"):
+            dev.hop_mode = "firmware"
+            # Cross-band hops without a promiscuous restart, where the driver allows
+            dev.send_command("BANDMODE AUTO")
+        elif resp.startswith("ERR unknown command") or resp.startswith("ERR invalid hop"):
+            # Older firmware: step it from the host as before
+            dev.hop_mode = "host"
+
     def _hop_tick(self):
+        """Step devices without firmware HOP through their plan, one base
+        dwell per tick (a weight-w entry takes w ticks)."""
         if not self.channel_hopping:
             return
-        n_ch = len(ALL_CHANNELS)
+        interval = self.hop_interval_ms
         for dev in list(self.devices.values()):
-            if dev.port not in self.hop_positions:
-                # New device joined during hopping — slot it in
-                self.hop_positions[dev.port] = 0
-            idx = (self.hop_positions[dev.port] + 1) % n_ch
+            plan = self.hop_plans.get(dev.port)
+            if dev.hop_mode != "host" or plan is None:
+                continue
+            interval = min(interval, plan[0])
+            ticks = [ch for ch, w in plan[1] for _ in range(w)]
+            idx = (self.hop_positions.get(dev.port, 0) + 1) % len(ticks)
             self.hop_positions[dev.port] = idx
-            ch = ALL_CHANNELS[idx]
+            ch = ticks[idx]
+            if ch == dev.channel:
+                continue
             dev.send_command(f"CH {ch}")
             dev.channel = ch
             dev.channel_pending = True
             if dev.port in self.device_cards:
                 self.device_cards[dev.port].ch_var.set(str(ch))
 
-        self.hop_timer_id = self.root.after(self.hop_interval_ms, self._hop_tick)
+        # Host-driven hops are limited by the serial command path
+        self.hop_timer_id = self.root.after(max(interval, 50), self._hop_tick)
 
     def _stop_hopping(self):
         self.channel_hopping = False
@@ -1507,6 +2944,16 @@ class SnifferGUI:
         if self.hop_timer_id:
             self.root.after_cancel(self.hop_timer_id)
             self.hop_timer_id = None
+        if self.hop_replan_id:
+            self.root.after_cancel(self.hop_replan_id)
+            self.hop_replan_id = None
+        for dev in list(self.devices.values()):
+            if dev.hop_mode in ("pending", "firmware"):
+                dev.send_command("HOP OFF")
+            dev.hop_mode = None
+        self.hop_planner = None
+        self.hop_plans.clear()
+        self.hop_fleet = set()
         self.hop_positions.clear()
         self._set_chart_weights(normal=True)
 
@@ -1518,31 +2965,62 @@ class SnifferGUI:
             if self.pcap_writer:
                 self.pcap_writer.close()
                 self.pcap_writer = None
+            if self.pcap_path:
+                self.pcap_path = None
+                for dev in list(self.devices.values()):
+                    dev.worker.set_pcap(None)
         else:
             # Start recording
             path = filedialog.asksaveasfilename(
-                defaultextension=".pcap",
-                filetypes=[("PCAP files", "*.pcap"), ("All files", "*.*")],
+                defaultextension=".pcapng",
+                filetypes=[("PCAPNG files", "*.pcapng"), ("All files", "*.*")],
                 title="Save PCAP capture")
             if not path:
                 return
-            self.pcap_writer = PCAPWriter(path)
+            if self.workers:
+                self.pcap_path = path
+                for dev in list(self.devices.values()):
+                    dev.worker.set_pcap(self._worker_pcap_path(dev), self.pcap_options)
+            else:
+                try:
+                    self.pcap_writer = PCAPNGWriter(path, dedup_us=self.dedup_us,
+                                                    **self.pcap_options)
+                except OSError as e:
+                    messagebox.showerror("Record", f"Could not create {path}:\n{e}",
+                                         parent=self.root)
+                    return
             self.recording = True
             self.rec_btn.config(fg=COLORS['accent_red'], bg='#2a0a0a')
 
+    def _check_recording(self):
+        """Stop recording, and say why, once a PCAPNG writer has failed."""
+        if self.pcap_writer and self.pcap_writer.error:
+            error = f"{self.pcap_writer.error}"
+        else:
+            failed = [dev for dev in self.devices.values() if dev.pcap_error]
+            if not failed:
+                return
+            error = "\n".join(f"{dev.port_short}: {dev.pcap_error}" for dev in failed)
+        for dev in self.devices.values():
+            dev.pcap_error = None
+        self._toggle_recording()
+        messagebox.showerror("Record", f"Recording stopped:\n{error}", parent=self.root)
+
+    def _worker_pcap_path(self, dev):
+        root, ext = os.path.splitext(self.pcap_path)
+        return f"{root}-{dev.port_short}{ext or '.pcapng'}"
+
     def _on_close(self):
         """Clean shutdown."""
         if self.channel_hopping:
             self._stop_hopping()
         self.scanner_stop.set()
         for dev in list(self.devices.values()):
-            dev.stop_event.set()
-            try:
-                dev.ser.close()
-            except Exception:
-                pass
+            dev.stop()
         if self.pcap_writer:
             self.pcap_writer.close()
+        if self.replay:
+            self.replay.close()
         self.root.destroy()
 
     def run(self):
@@ -1554,5 +3032,40 @@ class SnifferGUI:
 # =============================================================================
 
 if __name__ == "__main__":
-    app = SnifferGUI()
+    parser = argparse.ArgumentParser(
+        description="5dra WiFi Packet Sniffer — Multi-Device GUI")
+    parser.add_argument("--workers", action="store_true",
+                        help="Run each device reader in its own process; the "
+                             "table then shows a sample of recent packets and "
+                             "PCAP recording writes one file per device")
+    parser.add_argument("--rotate-mb", type=int, metavar="MB", default=0,
+                        help="Split recordings into NNNNN segments of MB megabytes")
+    parser.add_argument("--rotate-min", type=int, metavar="MIN", default=0,
+                        help="Split recordings into segments of MIN minutes")
+    parser.add_argument("--keep", type=int, metavar="N", default=0,
+                        help="With rotation, keep only the newest N segments")
+    parser.add_argument("--dedup-ms", type=int, metavar="MS", default=DEDUP_WINDOW_MS,
+                        help="Show and record a frame captured by several devices "
+                             f"within MS once (default: {DEDUP_WINDOW_MS}; 0=off)")
+    parser.add_argument("--snapshot", metavar="FILE", default=None,
+                        help="Write the per-BSSID/per-station tables to FILE "
+                             "(JSON, or FILE-bssids.csv/FILE-stations.csv for .csv)")
+    parser.add_argument("--snapshot-s", type=int, metavar="SEC", default=AGG_SNAPSHOT_S,
+                        help=f"With --snapshot, rewrite FILE every SEC seconds "
+                             f"(default: {AGG_SNAPSHOT_S})")
+    parser.add_argument("--open", metavar="FILE", default=None,
+                        help="Start with a recorded PCAPNG/pcap open (indexed "
+                             "into FILE.pidx on first use)")
+    parser.add_argument("--hop-revisit-s", type=int, metavar="SEC", default=HOP_MAX_REVISIT_S,
+                        help="While hopping, visit every channel at least every SEC "
+                             f"seconds (default: {HOP_MAX_REVISIT_S})")
+    args = parser.parse_args()
+
+    app = SnifferGUI(workers=args.workers, dedup_ms=args.dedup_ms,
+                     snapshot=args.snapshot, snapshot_s=args.snapshot_s,
+                     hop_revisit_s=args.hop_revisit_s, open_capture=args.open, pcap_options={
+        "rotate_bytes": args.rotate_mb << 20,
+        "rotate_secs": args.rotate_min * 60,
+        "keep": args.keep,
+    })
     app.run()